@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "workload.h"
+
+/**
+ * Writes the benchmark programs into the given directory. The scale
+ * multiplies the iteration counts, not the call depth (bounded by the
+ * number of frames) nor the size of the data segments.
+ */
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        printf("Usage: genWorkloads dir [scale]\n");
+        exit(1);
+    }
+    int scale = argc == 3 ? atoi(argv[2]) : 1;
+    if (scale < 1) {
+        printf("Invalid scale %s\n", argv[2]);
+        exit(1);
+    }
+    char path[4096];
+    FILE* file;
+#define WORKLOAD(name, call) \
+    snprintf(path, sizeof(path), "%s/%s.abm", argv[1], name); \
+    if ((file = fopen(path, "w")) == NULL) { \
+        perror("Could not write workload"); \
+        exit(-1); \
+    } \
+    call; \
+    fclose(file);
+
+    WORKLOAD("arith", writeArithmetic(file, 5000 * scale));
+    WORKLOAD("calls", writeCallChain(file, 100, 20 * scale));
+    WORKLOAD("callLoop", writeCallLoop(file, 5000 * scale));
+    WORKLOAD("data", writeDataSegment(file, 2000, 200));
+    WORKLOAD("register", writeLargeSegment(file, 1000000));
+    WORKLOAD("pointers", writePointerWalk(file, 40, scale));
+    WORKLOAD("block", writeBlockTransfer(file, 40, scale));
+    WORKLOAD("vector", writeVectorKernels(file, 100000, 10 * scale));
+    WORKLOAD("counter", writeSharedCounter(file, 500 * scale));
+    WORKLOAD("atomic", writeAtomicCounter(file, 500 * scale));
+    WORKLOAD("aliasAtomic", writeAliasedAtomic(file, 50 * scale));
+    WORKLOAD("producer", writeProducer(file, 200 * scale));
+    WORKLOAD("consumer", writeConsumer(file, 200 * scale));
+#undef WORKLOAD
+    return 0;
+}
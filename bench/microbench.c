@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "memmng.h"
+#include "object.h"
+#include "scanner.h"
+#include "socket.h"
+#include "vm.h"
+#include "workload.h"
+
+#define NAMES 10000
+// Iterations and values pushed per iteration of the stack benchmark
+#define STACK_ITERATIONS 20000
+#define STACK_DEPTH 64
+// Minimum duration of one measurement
+#define MIN_SECONDS 0.2
+
+static VM vm;
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void report(const char* name, long long operations, double seconds) {
+    const char* version = getenv("BENCH_VERSION");
+    printf("{\"version\":\"%s\",\"suite\":\"micro\",\"name\":\"%s\",\"ops\":%lld," \
+        "\"seconds\":%.6f,\"ns_per_op\":%.2f}\n", version != NULL ? version : "unknown", \
+        name, operations, seconds, seconds * 1e9 / operations);
+    fflush(stdout);
+}
+
+static char* generate(void (*writer)(FILE*, int, int), int a, int b) {
+    char* source;
+    size_t size;
+    FILE* file = open_memstream(&source, &size);
+    writer(file, a, b);
+    fclose(file);
+    return source;
+}
+
+static void benchScanner(const char* source) {
+    long long tokens = 0;
+    double start = now(), seconds;
+    do {
+        initScanner(source);
+        while (scanToken().type != TOKEN_EOF) {
+            tokens++;
+        }
+    } while ((seconds = now() - start) < MIN_SECONDS);
+    report("scanToken", tokens, seconds);
+}
+
+static void benchCompiler(const char* name, const char* source) {
+    // The data segment is sent to the bus while compiling
+    int socket_fd = open("/dev/null", O_WRONLY);
+    if (socket_fd < 0) {
+        perror("Could not open /dev/null");
+        exit(-1);
+    }
+    long long compiles = 0;
+    double start = now(), seconds;
+    do {
+        initVM(&vm);
+        if (compile(socket_fd, &vm, source) == NULL) {
+            printf("Could not compile benchmark source\n");
+            exit(1);
+        }
+        freeVM(&vm);
+        compiles++;
+    } while ((seconds = now() - start) < MIN_SECONDS);
+    close(socket_fd);
+    report(name, compiles, seconds);
+}
+
+/**
+ * Compiles and runs a program that only uses the stack and jumps, and
+ * reports the time per instruction run.
+ */
+static void benchStack(const char* source) {
+    // The VM says goodbye to the bus when it halts
+    int socket_fd = open("/dev/null", O_WRONLY);
+    if (socket_fd < 0) {
+        perror("Could not open /dev/null");
+        exit(-1);
+    }
+    // copy, gofalse, the pushes and adds, pop, push, -, goto
+    long long perIteration = 2 + STACK_DEPTH + STACK_DEPTH - 1 + 4;
+    long long instructions = 0;
+    double start = now(), seconds;
+    do {
+        initVM(&vm);
+        FunctionObject* function = compile(socket_fd, &vm, source);
+        if (function == NULL || interpretFunction(socket_fd, &vm, function) != INTERPRET_OK) {
+            printf("Could not run benchmark source\n");
+            exit(1);
+        }
+        freeVM(&vm);
+        instructions += perIteration * STACK_ITERATIONS;
+    } while ((seconds = now() - start) < MIN_SECONDS);
+    close(socket_fd);
+    report("runStack", instructions, seconds);
+}
+
+static void benchTable() {
+    InternTable strings;
+    Table globals;
+    Heap heap;
+    initInternTable(&strings);
+    initHeap(&heap);
+    initTable(&globals);
+    char names[NAMES][16];
+    int lengths[NAMES];
+    String* keys[NAMES];
+    for (int i = 0; i < NAMES; i++) {
+        lengths[i] = sprintf(names[i], "name%d", i);
+        keys[i] = copyString(&strings, &heap, names[i], lengths[i]);
+        int address = i;
+        tableSetValueAddress(&globals, keys[i], numberValue(i), &address);
+    }
+
+    long long operations = 0;
+    double start = now(), seconds;
+    do {
+        for (int i = 0; i < NAMES; i++) {
+            keys[i] = copyString(&strings, &heap, names[i], lengths[i]);
+        }
+        operations += NAMES;
+    } while ((seconds = now() - start) < MIN_SECONDS);
+    report("copyString", operations, seconds);
+
+    Value value;
+    long long found = 0;
+    operations = 0;
+    start = now();
+    do {
+        for (int i = 0; i < NAMES; i++) {
+            found += tableGetValue(&globals, keys[i], &value) >= 0;
+        }
+        operations += NAMES;
+    } while ((seconds = now() - start) < MIN_SECONDS);
+    if (found != operations) {
+        printf("tableGetValue missed %lld keys\n", operations - found);
+        exit(1);
+    }
+    report("tableGetValue", operations, seconds);
+    freeTable(&globals);
+    freeInternTable(&strings);
+    freeHeap(&heap);
+}
+
+static int connectToBus() {
+    int socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (socket_fd < 0) {
+        return -1;
+    }
+    struct hostent* hptr = gethostbyname(HOST);
+    if (!hptr || hptr->h_addrtype != AF_INET) {
+        close(socket_fd);
+        return -1;
+    }
+    struct sockaddr_in saddr;
+    memset(&saddr, 0, sizeof(saddr));
+    saddr.sin_family = AF_INET;
+    saddr.sin_addr.s_addr = ((struct in_addr*) hptr->h_addr_list[0])->s_addr;
+    saddr.sin_port = htons(PORT);
+    if (connect(socket_fd, (struct sockaddr*)&saddr, sizeof(saddr)) < 0) {
+        close(socket_fd);
+        return -1;
+    }
+    return socket_fd;
+}
+
+static void exchange(int socket_fd, char* buffer, bool reply) {
+    if (write(socket_fd, buffer, 1024) <= 0) {
+        perror("Could not write to bus");
+        exit(-1);
+    }
+    // Messages are fixed size, TCP may still split them
+    for (int done = 0; reply && done < 1024;) {
+        int valread = read(socket_fd, buffer + done, 1024 - done);
+        if (valread <= 0) {
+            perror("Could not read from bus");
+            exit(-1);
+        }
+        done += valread;
+    }
+}
+
+/**
+ * Connects as a core, the same way abm.exe does, and times BusRd
+ * requests of one global. Skipped if no bus is listening.
+ */
+static void benchBus() {
+    int socket_fd = connectToBus();
+    int snoop_socket_fd = socket_fd < 0 ? -1 : connectToBus();
+    if (snoop_socket_fd < 0) {
+        printf("{\"suite\":\"micro\",\"name\":\"busRoundTrip\",\"skipped\":\"no bus on port %d\"}\n", PORT);
+        if (socket_fd >= 0) {
+            close(socket_fd);
+        }
+        return;
+    }
+    char buffer[1024] = "add benchValue ";
+    exchange(socket_fd, buffer, false);
+    long long operations = 0;
+    double start = now(), seconds;
+    do {
+        memset(buffer, '\0', sizeof(buffer));
+        strcpy(buffer, "1 benchValue");
+        exchange(socket_fd, buffer, true);
+        operations++;
+    } while ((seconds = now() - start) < MIN_SECONDS);
+    report("busRoundTrip", operations, seconds);
+    memset(buffer, '\0', sizeof(buffer));
+    strcpy(buffer, "ret");
+    exchange(socket_fd, buffer, false);
+    close(socket_fd);
+    close(snoop_socket_fd);
+}
+
+int main(int argc, char* argv[]) {
+    bool bus = argc == 2 && strcmp(argv[1], "--bus") == 0;
+    if (argc > 2 || (argc == 2 && !bus)) {
+        printf("Usage: microbench [--bus]\n");
+        exit(1);
+    }
+    char* calls = generate(writeCallChain, 100, 10);
+    char* data = generate(writeDataSegment, 2000, 200);
+    char* stack = generate(writeStackLoop, STACK_ITERATIONS, STACK_DEPTH);
+
+    benchScanner(calls);
+    benchCompiler("compileCalls", calls);
+    benchCompiler("compileData", data);
+    benchStack(stack);
+    benchTable();
+    if (bus) {
+        benchBus();
+    }
+    free(calls);
+    free(data);
+    free(stack);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Runs the benchmark suite and prints one JSON object per line.
+# Usage: bench/run.sh [scale], from the repository root after make.
+# A bus is started for the duration of the run, so none may be running.
+
+SCALE=${1:-1}
+DIR=$(mktemp -d)
+BENCH_VERSION=$(git describe --always --dirty 2>/dev/null || echo unknown)
+export BENCH_VERSION
+
+now() {
+    date +%s%N
+}
+
+# Prints the result of one workload, given its start time in nanoseconds
+report() {
+    printf '{"version":"%s","suite":"workload","name":"%s","cores":%d,"seconds":%s,"status":%d}\n' \
+        "$BENCH_VERSION" "$1" "$2" "$(echo "$3" "$(now)" | awk '{ printf "%.6f", ($2 - $1) / 1e9 }')" "$4"
+}
+
+./bench/genWorkloads.exe "$DIR" "$SCALE" || exit 1
+
+# Retry for a bit, in case the bus of a previous run is still exiting
+for attempt in $(seq 10); do
+    ./bus.exe 2>/dev/null &
+    BUS=$!
+    sleep 0.3
+    kill -0 $BUS 2>/dev/null && break
+    sleep 1
+done
+if ! kill -0 $BUS 2>/dev/null; then
+    echo "Could not start bus.exe" >&2
+    exit 1
+fi
+
+for name in arith calls callLoop data register pointers block vector aliasAtomic; do
+    start=$(now)
+    ./abm.exe "$DIR/$name.abm" > /dev/null
+    report $name 1 "$start" $?
+done
+
+# Both cores of the bus: the second core connects once the first one is
+# accepted, so the main and snoop sockets of each core are not interleaved.
+# The 0.1s stagger is included in the reported time.
+start=$(now)
+./abm.exe "$DIR/counter.abm" > /dev/null & FIRST=$!
+sleep 0.1
+./abm.exe "$DIR/counter.abm" > /dev/null
+status=$?
+wait $FIRST || status=$?
+report counter 2 "$start" $status
+
+start=$(now)
+./abm.exe "$DIR/atomic.abm" > /dev/null & FIRST=$!
+sleep 0.1
+./abm.exe "$DIR/atomic.abm" > /dev/null
+status=$?
+wait $FIRST || status=$?
+report atomic 2 "$start" $status
+
+start=$(now)
+./abm.exe "$DIR/consumer.abm" > /dev/null & FIRST=$!
+sleep 0.1
+./abm.exe "$DIR/producer.abm" > /dev/null
+status=$?
+wait $FIRST || status=$?
+report producerConsumer 2 "$start" $status
+
+./bench/microbench.exe --bus
+
+kill $BUS
+wait $BUS 2>/dev/null
+rm -rf "$DIR"
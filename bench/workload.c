@@ -0,0 +1,196 @@
+#include "workload.h"
+
+// The bus reads the names of one .int line from a single 1024 byte message
+#define NAMES_PER_LINE 64
+
+static void writeGlobals(FILE* file, const char* prefix, int count) {
+    for (int i = 0; i < count; i++) {
+        if (i % NAMES_PER_LINE == 0) {
+            fprintf(file, i == 0 ? "    .int" : "\n    .int");
+        }
+        fprintf(file, " %s%d", prefix, i);
+    }
+    fprintf(file, "\n");
+}
+
+// Writes "label <name>" followed by the test "<variable> < <limit>"
+static void writeLoopHead(FILE* file, const char* name, const char* variable, int limit) {
+    fprintf(file, "label %s\n    rvalue %s\n    push %d\n    <\n    gofalse %s_end\n", \
+        name, variable, limit, name);
+}
+
+static void writeIncrement(FILE* file, const char* variable) {
+    fprintf(file, "    lvalue %s\n    rvalue %s\n    push 1\n    +\n    :=\n", variable, variable);
+}
+
+static void writeLoopTail(FILE* file, const char* name, const char* variable) {
+    writeIncrement(file, variable);
+    fprintf(file, "    goto %s\nlabel %s_end\n", name, name);
+}
+
+void writeArithmetic(FILE* file, int iterations) {
+    // abm.exe needs a data segment, result is only written once at the end
+    fprintf(file, ".data\n    .int result\n.text\n    lvalue i\n    push 0\n    :=\n" \
+        "    lvalue acc\n    push 0\n    :=\n");
+    writeLoopHead(file, "loop", "i", iterations);
+    fprintf(file, "    lvalue acc\n    rvalue acc\n    rvalue i\n    push 3\n    *\n    +\n" \
+        "    push 1000\n    div\n    :=\n");
+    writeLoopTail(file, "loop", "i");
+    fprintf(file, "    lvalue result\n    rvalue acc\n    :=\n    rvalue result\n    print\n    halt\n");
+}
+
+void writeCallChain(FILE* file, int depth, int repeats) {
+    fprintf(file, ".data\n    .int calls\n.text\n    lvalue r\n    push 0\n    :=\n");
+    writeLoopHead(file, "loop", "r", repeats);
+    fprintf(file, "    begin\n    call f0\n    end\n");
+    writeLoopTail(file, "loop", "r");
+    fprintf(file, "    rvalue calls\n    print\n    halt\n");
+    for (int i = 0; i < depth - 1; i++) {
+        fprintf(file, "label f%d\n    begin\n    call f%d\n    end\n    return\n", i, i + 1);
+    }
+    fprintf(file, "label f%d\n", depth - 1);
+    writeIncrement(file, "calls");
+    fprintf(file, "    return\n");
+}
+
+void writeCallLoop(FILE* file, int iterations) {
+    fprintf(file, ".data\n    .int result\n.text\n    lvalue i\n    push 0\n    :=\n" \
+        "    lvalue acc\n    push 0\n    :=\n");
+    writeLoopHead(file, "loop", "i", iterations);
+    fprintf(file, "    begin\n    lvalue x\n    rvalue acc\n    :=\n    lvalue y\n    rvalue i\n    :=\n" \
+        "    call mix\n    lvalue acc\n    rvalue z\n    :=\n    end\n");
+    writeLoopTail(file, "loop", "i");
+    fprintf(file, "    lvalue result\n    rvalue acc\n    :=\n    rvalue result\n    print\n    halt\n");
+    fprintf(file, "label mix\n    lvalue z\n    rvalue x\n    rvalue y\n    +\n    push 1000\n    div\n" \
+        "    :=\n    return\n");
+}
+
+void writeStackLoop(FILE* file, int iterations, int depth) {
+    fprintf(file, ".data\n    .int result\n.text\n    push %d\nlabel loop\n    copy\n    gofalse done\n", iterations);
+    for (int i = 0; i < depth; i++) {
+        fprintf(file, "    push %d\n", i);
+    }
+    for (int i = 1; i < depth; i++) {
+        fprintf(file, "    +\n");
+    }
+    fprintf(file, "    pop\n    push 1\n    -\n    goto loop\nlabel done\n    halt\n");
+}
+
+void writeDataSegment(FILE* file, int globals, int touched) {
+    fprintf(file, ".data\n");
+    writeGlobals(file, "g", globals);
+    fprintf(file, ".text\n");
+    // Spread the touched globals over the whole segment
+    int stride = touched < globals ? globals / touched : 1;
+    for (int i = 0; i < globals; i += stride) {
+        fprintf(file, "    lvalue g%d\n    push %d\n    :=\n", i, i);
+    }
+    fprintf(file, "    push 0\n");
+    for (int i = 0; i < globals; i += stride) {
+        fprintf(file, "    rvalue g%d\n    +\n", i);
+    }
+    fprintf(file, "    print\n    halt\n");
+}
+
+void writeLargeSegment(FILE* file, int globals) {
+    fprintf(file, ".data\n    .int");
+    for (int i = 0; i < globals; i++) {
+        fprintf(file, " r%d", i);
+    }
+    fprintf(file, "\n.text\n    rvalue r%d\n    print\n    halt\n", globals - 1);
+}
+
+void writePointerWalk(FILE* file, int elements, int passes) {
+    fprintf(file, ".data\n");
+    writeGlobals(file, "e", elements);
+    fprintf(file, ".text\n    lvalue sum\n    push 0\n    :=\n    lvalue pass\n    push 0\n    :=\n");
+    writeLoopHead(file, "outer", "pass", passes);
+    fprintf(file, "    lvalue i\n    push 0\n    :=\n");
+    writeLoopHead(file, "inner", "i", elements);
+    fprintf(file, "    lvalue p\n    lvalue e0\n    rvalue i\n    +\n    :&\n" \
+        "    lvalue p\n    rvalue i\n    rvalue pass\n    +\n    :=\n" \
+        "    lvalue sum\n    rvalue sum\n    rvalue p\n    +\n    :=\n");
+    writeLoopTail(file, "inner", "i");
+    writeLoopTail(file, "outer", "pass");
+    fprintf(file, "    rvalue sum\n    print\n    halt\n");
+}
+
+void writeBlockTransfer(FILE* file, int elements, int passes) {
+    fprintf(file, ".data\n    .int e[%d]\n", elements);
+    fprintf(file, ".text\n    lvalue sum\n    push 0\n    :=\n    lvalue pass\n    push 0\n    :=\n");
+    writeLoopHead(file, "outer", "pass", passes);
+    fprintf(file, "    lvalue e\n");
+    for (int i = 0; i < elements; i++) {
+        fprintf(file, "    rvalue pass\n    push %d\n    +\n", i);
+    }
+    fprintf(file, "    push %d\n    store\n    lvalue sum\n    rvalue sum\n" \
+        "    lvalue e\n    push %d\n    load\n", elements, elements);
+    for (int i = 0; i < elements; i++) {
+        fprintf(file, "    +\n");
+    }
+    fprintf(file, "    :=\n");
+    writeLoopTail(file, "outer", "pass");
+    fprintf(file, "    rvalue sum\n    print\n    halt\n");
+}
+
+void writeVectorKernels(FILE* file, int elements, int passes) {
+    fprintf(file, ".data\n    .int a[%d] b[%d] c[%d]\n", elements, elements, elements);
+    fprintf(file, ".text\n    lvalue sum\n    push 0\n    :=\n    lvalue pass\n    push 0\n    :=\n");
+    writeLoopHead(file, "loop", "pass", passes);
+    fprintf(file, "    lvalue a\n    rvalue pass\n    push %d\n    vfill\n" \
+        "    lvalue b\n    push 2\n    push %d\n    vfill\n" \
+        "    lvalue c\n    lvalue a\n    lvalue b\n    push %d\n    vmul\n" \
+        "    lvalue c\n    lvalue c\n    lvalue a\n    push %d\n    vadd\n" \
+        "    lvalue b\n    lvalue c\n    push %d\n    vcopy\n", \
+        elements, elements, elements, elements, elements);
+    fprintf(file, "    lvalue sum\n    rvalue sum\n    lvalue b\n    push %d\n    vsum\n    +\n    :=\n", \
+        elements);
+    writeLoopTail(file, "loop", "pass");
+    fprintf(file, "    rvalue sum\n    print\n    halt\n");
+}
+
+void writeSharedCounter(FILE* file, int increments) {
+    fprintf(file, ".data\n    .int counter\n.text\n    lvalue i\n    push 0\n    :=\n");
+    writeLoopHead(file, "loop", "i", increments);
+    writeIncrement(file, "counter");
+    writeLoopTail(file, "loop", "i");
+    fprintf(file, "    rvalue counter\n    print\n    halt\n");
+}
+
+void writeAtomicCounter(FILE* file, int increments) {
+    fprintf(file, ".data\n    .int counter\n.text\n    lvalue i\n    push 0\n    :=\n");
+    writeLoopHead(file, "loop", "i", increments);
+    fprintf(file, "    lvalue counter\n    push 1\n    fadd\n    pop\n");
+    writeLoopTail(file, "loop", "i");
+    fprintf(file, "    rvalue counter\n    print\n    halt\n");
+}
+
+void writeAliasedAtomic(FILE* file, int increments) {
+    // "shared" is stored before "pad", and seen right after "view" too
+    fprintf(file, ".data\n    .int shared pad\n    .int view shared\n.text\n" \
+        "    lvalue sum\n    push 0\n    :=\n    lvalue i\n    push 0\n    :=\n");
+    writeLoopHead(file, "loop", "i", increments);
+    fprintf(file, "    lvalue shared\n    rvalue i\n    :=\n" \
+        "    lvalue view\n    push 1\n    +\n    push 1\n    fadd\n    pop\n" \
+        "    lvalue sum\n    rvalue sum\n    rvalue shared\n    +\n    :=\n");
+    writeLoopTail(file, "loop", "i");
+    fprintf(file, "    rvalue sum\n    print\n    halt\n");
+}
+
+void writeProducer(FILE* file, int items) {
+    fprintf(file, ".data\n    .int slot ready\n.text\n    lvalue i\n    push 0\n    :=\n");
+    writeLoopHead(file, "loop", "i", items);
+    fprintf(file, "    lvalue slot\n    rvalue i\n    :=\n    lvalue ready\n    rvalue i\n    :=\n");
+    writeLoopTail(file, "loop", "i");
+    fprintf(file, "    halt\n");
+}
+
+void writeConsumer(FILE* file, int items) {
+    fprintf(file, ".data\n    .int slot ready\n.text\n    lvalue sum\n    push 0\n    :=\n" \
+        "    lvalue polls\n    push 0\n    :=\n");
+    fprintf(file, "label loop\n    rvalue ready\n    push %d\n    <\n    rvalue polls\n" \
+        "    push %d\n    <\n    &\n    gofalse loop_end\n", items - 1, items * 16);
+    fprintf(file, "    lvalue sum\n    rvalue sum\n    rvalue slot\n    +\n    :=\n");
+    writeLoopTail(file, "loop", "polls");
+    fprintf(file, "    rvalue sum\n    print\n    halt\n");
+}
@@ -0,0 +1,144 @@
+#ifndef workload_h
+#define workload_h
+
+#include <stdio.h>
+
+/**
+ * @brief Writes a loop of the given number of iterations that only
+ * does arithmetic on one local variable.
+ *
+ * @param file
+ * @param iterations
+ */
+void writeArithmetic(FILE* file, int iterations);
+
+/**
+ * @brief Writes depth functions, each calling the next one, and a main
+ * that calls the first function repeats times.
+ *
+ * @param file
+ * @param depth must stay below FRAMES_CAPACITY
+ * @param repeats
+ */
+void writeCallChain(FILE* file, int depth, int repeats);
+
+/**
+ * @brief Writes a loop of the given number of iterations that calls a
+ * small function with two parameters and one result, all of them locals.
+ *
+ * @param file
+ * @param iterations
+ */
+void writeCallLoop(FILE* file, int iterations);
+
+/**
+ * @brief Writes a loop that only uses the stack, so it runs without a
+ * bus: the counter stays on the stack, and every iteration pushes depth
+ * numbers and adds them up.
+ *
+ * @param file
+ * @param iterations
+ * @param depth
+ */
+void writeStackLoop(FILE* file, int iterations, int depth);
+
+/**
+ * @brief Writes a data segment of the given number of globals, then
+ * assigns about touched of them and sums them.
+ *
+ * @param file
+ * @param globals
+ * @param touched each one takes a constant for its name and one for its value
+ */
+void writeDataSegment(FILE* file, int globals, int touched);
+
+/**
+ * @brief Writes a data segment of the given number of globals on a single
+ * .int line, so registering it streams many messages to the bus as one
+ * block, then reads the last global.
+ *
+ * @param file
+ * @param globals
+ */
+void writeLargeSegment(FILE* file, int globals);
+
+/**
+ * @brief Writes an array of elements globals that is walked passes times
+ * through a pointer, writing and reading each element.
+ *
+ * @param file
+ * @param elements
+ * @param passes
+ */
+void writePointerWalk(FILE* file, int elements, int passes);
+
+/**
+ * @brief Writes the same passes as writePointerWalk(), over an array
+ * declared in the data segment: every pass stores all the elements with
+ * one store, then sums them with one load.
+ *
+ * @param file
+ * @param elements
+ * @param passes
+ */
+void writeBlockTransfer(FILE* file, int elements, int passes);
+
+/**
+ * @brief Writes passes of every vector instruction over three arrays of
+ * the given number of elements, each pass adding the sum of one of them.
+ *
+ * @param file
+ * @param elements
+ * @param passes
+ */
+void writeVectorKernels(FILE* file, int elements, int passes);
+
+/**
+ * @brief Writes a program incrementing a shared global counter. Running
+ * it on both cores makes the counter line bounce between them.
+ *
+ * @param file
+ * @param increments
+ */
+void writeSharedCounter(FILE* file, int increments);
+
+/**
+ * @brief Writes the program of writeSharedCounter() with each increment
+ * done by fadd, so running it on both cores loses no increment.
+ *
+ * @param file
+ * @param increments
+ */
+void writeAtomicCounter(FILE* file, int increments);
+
+/**
+ * @brief Writes a loop that stores to a global, increments it by fadd
+ * through an alias address, and reads it back by name. The alias comes
+ * from a second .int line that lists the global after a new name. The
+ * sum of the values read back is printed.
+ *
+ * @param file
+ * @param increments
+ */
+void writeAliasedAtomic(FILE* file, int increments);
+
+/**
+ * @brief Writes the producer side of a one slot queue: every item is
+ * stored in slot, then published by storing its index in ready.
+ *
+ * @param file
+ * @param items
+ */
+void writeProducer(FILE* file, int items);
+
+/**
+ * @brief Writes the consumer side of the queue written by writeProducer().
+ * It polls ready until the last item is published, bounded by a number of
+ * polls so it terminates even if the producer runs first.
+ *
+ * @param file
+ * @param items
+ */
+void writeConsumer(FILE* file, int items);
+
+#endif
@@ -14,7 +14,7 @@ void initCache(Cache* cache) {
     for (int i = 0; i < 3; i++) {
         cache->entries[i].address = -1;
         cache->entries[i].key = NULL;
-        cache->entries[i].value = (Value){NUM_VALUE, {.number = 0}};
+        cache->entries[i].value = numberValue(0);
         cache->lastUsed[i] = -1;
         cache->states[i] = INVALID;
         // pthread_mutex_init(&cache->lineLock[i], NULL);
@@ -28,3 +28,50 @@ void initCache(Cache* cache) {
 void freeCache(Cache* cache) {
     initCache(cache);
 }
+
+int replaceLRU(Cache* cache, int* clock) {
+    int minIndex = 0;
+    for (int i = 1; i < 3; i++) {
+        if (cache->lastUsed[minIndex] > cache->lastUsed[i]) {
+            minIndex = i;
+        }
+    }
+    cache->lastUsed[minIndex] = *clock;
+    (*clock)++;
+    return minIndex;
+}
+
+State processorTransition(Protocol protocol, State state, Action action, \
+    bool othersHaveCopy, BusAction* busAction) {
+    *busAction = BUS_NONE;
+    switch (action) {
+        case PROCESSOR_READ:
+            if (state == INVALID) {     // Read miss
+                *busAction = BUS_READ;
+                return protocol == PROTOCOL_MESI && !othersHaveCopy ? EXCLUSIVE : SHARED;
+            }
+            return state;
+        case PROCESSOR_WRITE:
+            if (state == INVALID) {     // Write miss
+                *busAction = BUS_READ_X;
+            } else if (state == SHARED) {   // Other copies have to be invalidated
+                *busAction = BUS_UPGRADE;
+            }
+            return MODIFIED;
+    }
+    return state;
+}
+
+State snoopTransition(State state, BusAction busAction, bool* suppliesData) {
+    *suppliesData = state == MODIFIED && busAction != BUS_NONE;
+    switch (busAction) {
+        case BUS_NONE:
+            return state;
+        case BUS_READ:
+            return state == INVALID ? INVALID : SHARED;
+        case BUS_READ_X:
+        case BUS_UPGRADE:
+            return INVALID;
+    }
+    return state;
+}
@@ -14,9 +14,22 @@ typedef enum {
 typedef enum {
     INVALID,
     SHARED,
-    MODIFIED
+    MODIFIED,
+    EXCLUSIVE,
 } State;
 
+typedef enum {
+    PROTOCOL_MSI,
+    PROTOCOL_MESI,
+} Protocol;
+
+typedef enum {
+    BUS_NONE,
+    BUS_READ,
+    BUS_READ_X,
+    BUS_UPGRADE,
+} BusAction;
+
 typedef struct Cache{
     Entry entries[3];
     int addressData[3][5];
@@ -29,4 +42,43 @@ typedef struct Cache{
 void initCache(Cache* cache);
 void freeCache(Cache* cache);
 
+/**
+ * @brief Returns the index of the least recently used line and marks it
+ * as used at the current clock, which is then advanced.
+ * 
+ * @param cache 
+ * @param clock 
+ * @return int 
+ */
+int replaceLRU(Cache* cache, int* clock);
+
+/**
+ * @brief Coherence rule for a processor access to a line in the given
+ * state. Returns the next state of the line and sets busAction to the
+ * transaction that has to be placed on the bus (BUS_NONE on a hit).
+ * othersHaveCopy is only used by MESI to choose between SHARED and
+ * EXCLUSIVE on a read miss.
+ * 
+ * @param protocol 
+ * @param state 
+ * @param action 
+ * @param othersHaveCopy 
+ * @param busAction 
+ * @return State 
+ */
+State processorTransition(Protocol protocol, State state, Action action, \
+    bool othersHaveCopy, BusAction* busAction);
+
+/**
+ * @brief Coherence rule for a line that observes another core's bus
+ * transaction. Returns the next state of the line and sets suppliesData
+ * if the line is dirty and has to be written back (cache-to-cache transfer).
+ * 
+ * @param state 
+ * @param busAction 
+ * @param suppliesData 
+ * @return State 
+ */
+State snoopTransition(State state, BusAction busAction, bool* suppliesData);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,537 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "memmng.h"
+#include "timing.h"
+#include "trace.h"
+
+#define MAX_CONFIGS 1024
+#define ADDRESS_KEY (1ull << 32)
+
+/**
+ * struct Access - One processor access replayed by the simulator
+ * @a: id -> uint32_t : dense index of the accessed symbol or address
+ * @b: core -> uint16_t : core performing the access, starting at 0
+ * @c: action -> uint16_t : PROCESSOR_READ or PROCESSOR_WRITE
+ */
+typedef struct {
+    uint32_t id;
+    uint16_t core;
+    uint16_t action;
+} Access;
+
+/**
+ * struct Workload - All accesses of the replayed trace(s)
+ * @a: count -> int : number of accesses
+ * @b: capacity -> int : maximum number of accesses
+ * @c: accesses -> Access* : accesses in replay order
+ * @d: timestamps -> uint64_t* : timestamp of each access, used to merge traces
+ * @e: cores -> int : number of cores found in the trace(s)
+ * @f: ids -> int : number of distinct symbols and addresses
+ */
+typedef struct {
+    int count;
+    int capacity;
+    Access* accesses;
+    uint64_t* timestamps;
+    int cores;
+    int ids;
+} Workload;
+
+/**
+ * struct IdMap - Maps a symbol hash or address to a dense index
+ * @a: count -> int : number of keys
+ * @b: capacity -> int : number of slots, always a power of 2
+ * @c: keys -> uint64_t* : symbol hash, or address | ADDRESS_KEY
+ * @d: values -> uint32_t* : dense index of the key, UINT32_MAX if slot is empty
+ */
+typedef struct {
+    int count;
+    int capacity;
+    uint64_t* keys;
+    uint32_t* values;
+} IdMap;
+
+typedef struct {
+    Protocol protocol;
+    int lines;
+} SimConfig;
+
+typedef struct {
+    long accesses;
+    long hits;
+    long busReads;
+    long busReadXs;
+    long upgrades;
+    long writeBacks;
+    long transfers;
+    uint64_t cycles;
+    uint64_t maxCoreCycles;
+} SimStats;
+
+/**
+ * struct SimCache - Fully associative LRU cache of one simulated core
+ * @a: lines -> int : number of lines
+ * @b: used -> int : number of lines holding a symbol
+ * @c: lineOf -> int* : line of every dense id, -1 if not cached
+ * @d: ids -> uint32_t* : dense id stored in every line
+ * @e: states -> State* : coherence state of every line
+ * @f: prev, next -> int* : LRU list links, head is the most recently used
+ */
+typedef struct {
+    int lines;
+    int used;
+    int* lineOf;
+    uint32_t* ids;
+    State* states;
+    int* prev;
+    int* next;
+    int head;
+    int tail;
+} SimCache;
+
+static Workload workload;
+static IdMap idMap;
+static SimConfig configs[MAX_CONFIGS];
+static SimStats results[MAX_CONFIGS];
+static int configCount = 0;
+static int nextConfig = 0;
+
+static uint32_t hashName(const char* key, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static void growIdMap() {
+    int capacity = idMap.capacity < 1024 ? 1024 : idMap.capacity * 2;
+    uint64_t* keys = (uint64_t*)reallocate(NULL, 0, sizeof(uint64_t) * capacity);
+    uint32_t* values = (uint32_t*)reallocate(NULL, 0, sizeof(uint32_t) * capacity);
+    for (int i = 0; i < capacity; i++) {
+        values[i] = UINT32_MAX;
+    }
+    for (int i = 0; i < idMap.capacity; i++) {
+        if (idMap.values[i] == UINT32_MAX) {
+            continue;
+        }
+        uint32_t index = (uint32_t)(idMap.keys[i] * 0x9E3779B97F4A7C15ull >> 32) & (capacity - 1);
+        while (values[index] != UINT32_MAX) {
+            index = (index + 1) & (capacity - 1);
+        }
+        keys[index] = idMap.keys[i];
+        values[index] = idMap.values[i];
+    }
+    reallocate(idMap.keys, sizeof(uint64_t) * idMap.capacity, 0);
+    reallocate(idMap.values, sizeof(uint32_t) * idMap.capacity, 0);
+    idMap.keys = keys;
+    idMap.values = values;
+    idMap.capacity = capacity;
+}
+
+static uint32_t denseId(uint64_t key) {
+    if (idMap.count + 1 > idMap.capacity / 2) {
+        growIdMap();
+    }
+    uint32_t index = (uint32_t)(key * 0x9E3779B97F4A7C15ull >> 32) & (idMap.capacity - 1);
+    while (idMap.values[index] != UINT32_MAX) {
+        if (idMap.keys[index] == key) {
+            return idMap.values[index];
+        }
+        index = (index + 1) & (idMap.capacity - 1);
+    }
+    idMap.keys[index] = key;
+    idMap.values[index] = (uint32_t)idMap.count++;
+    return idMap.values[index];
+}
+
+static void addAccess(uint64_t timestamp, int core, Action action, uint64_t key) {
+    if (workload.capacity < workload.count + 1) {
+        int prevCapacity = workload.capacity;
+        workload.capacity = prevCapacity < 1024 ? 1024 : prevCapacity * 2;
+        workload.accesses = (Access*)reallocate(workload.accesses, \
+            sizeof(Access) * prevCapacity, sizeof(Access) * workload.capacity);
+        workload.timestamps = (uint64_t*)reallocate(workload.timestamps, \
+            sizeof(uint64_t) * prevCapacity, sizeof(uint64_t) * workload.capacity);
+    }
+    workload.accesses[workload.count] = (Access){denseId(key), (uint16_t)core, (uint16_t)action};
+    workload.timestamps[workload.count] = timestamp;
+    workload.count++;
+    if (core + 1 > workload.cores) {
+        workload.cores = core + 1;
+    }
+}
+
+/**
+ * @brief Reads a binary trace written by --trace. Every file is one core,
+ * only processor reads and writes of global memory are replayed. Only the
+ * header.count records are read, the rest of a file that was not closed
+ * is not written yet. A trace without records, or with more than the file
+ * holds, is rejected.
+ *
+ * @param file
+ * @param core
+ * @return true
+ * @return false
+ */
+static bool readBinaryTrace(FILE* file, int core) {
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || \
+        header.recordSize != sizeof(TraceRecord)) {
+        return false;
+    }
+    long start = ftell(file);
+    fseek(file, 0, SEEK_END);
+    uint64_t stored = (uint64_t)(ftell(file) - start) / sizeof(TraceRecord);
+    fseek(file, start, SEEK_SET);
+    if (header.count == 0 || header.count > stored) {
+        fprintf(stderr, "Trace counts %llu records, the file holds %llu\n", \
+            (unsigned long long)header.count, (unsigned long long)stored);
+        return false;
+    }
+    TraceRecord records[TRACE_RING_CAPACITY];
+    size_t read;
+    for (uint64_t left = header.count; left > 0; left -= read) {
+        size_t wanted = left < TRACE_RING_CAPACITY ? (size_t)left : TRACE_RING_CAPACITY;
+        if ((read = fread(records, sizeof(TraceRecord), wanted, file)) != wanted) {
+            return false;
+        }
+        for (size_t i = 0; i < read; i++) {
+            TraceRecord* record = &records[i];
+            if ((record->event != TRACE_PROCESSOR_READ && record->event != TRACE_PROCESSOR_WRITE) || \
+                (record->detail & TRACE_NOT_FOUND)) {
+                continue;
+            }
+            uint64_t key = record->id;
+            if (record->detail & TRACE_BY_ADDRESS) {
+                key |= ADDRESS_KEY;
+            }
+            addAccess(record->timestamp, core, record->event == TRACE_PROCESSOR_READ ? \
+                PROCESSOR_READ : PROCESSOR_WRITE, key);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a text trace with one access per line: "core r|w id", where
+ * core starts at 1 and id is either an address or a variable name.
+ * Lines beginning with # are ignored.
+ *
+ * @param file
+ * @return true
+ * @return false
+ */
+static bool readTextTrace(FILE* file) {
+    char line[1024], op[16], id[1000];
+    int core;
+    uint64_t order = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "%d %15s %999s", &core, op, id) != 3 || core < 1) {
+            fprintf(stderr, "Malformed trace line: %s", line);
+            return false;
+        }
+        uint64_t key;
+        char* end;
+        unsigned long address = strtoul(id, &end, 10);
+        if (*end == '\0') {
+            key = (uint64_t)(uint32_t)address | ADDRESS_KEY;
+        } else {
+            key = hashName(id, (int)strlen(id));
+        }
+        addAccess(order++, core - 1, (op[0] == 'w' || op[0] == 'W') ? \
+            PROCESSOR_WRITE : PROCESSOR_READ, key);
+    }
+    return true;
+}
+
+static int compareTimestamps(const void* a, const void* b) {
+    int i = *(const int*)a, j = *(const int*)b;
+    if (workload.timestamps[i] != workload.timestamps[j]) {
+        return workload.timestamps[i] < workload.timestamps[j] ? -1 : 1;
+    }
+    return i - j;
+}
+
+// Interleaves the accesses of several per-core traces by timestamp
+static void mergeTraces() {
+    int* order = (int*)reallocate(NULL, 0, sizeof(int) * workload.count);
+    for (int i = 0; i < workload.count; i++) {
+        order[i] = i;
+    }
+    qsort(order, workload.count, sizeof(int), compareTimestamps);
+    Access* accesses = (Access*)reallocate(NULL, 0, sizeof(Access) * workload.count);
+    for (int i = 0; i < workload.count; i++) {
+        accesses[i] = workload.accesses[order[i]];
+    }
+    reallocate(workload.accesses, sizeof(Access) * workload.capacity, 0);
+    reallocate(order, sizeof(int) * workload.count, 0);
+    workload.accesses = accesses;
+    workload.capacity = workload.count;
+}
+
+static void initSimCache(SimCache* cache, int lines, int ids) {
+    cache->lines = lines;
+    cache->used = 0;
+    cache->head = -1;
+    cache->tail = -1;
+    cache->lineOf = (int*)reallocate(NULL, 0, sizeof(int) * ids);
+    cache->ids = (uint32_t*)reallocate(NULL, 0, sizeof(uint32_t) * lines);
+    cache->states = (State*)reallocate(NULL, 0, sizeof(State) * lines);
+    cache->prev = (int*)reallocate(NULL, 0, sizeof(int) * lines);
+    cache->next = (int*)reallocate(NULL, 0, sizeof(int) * lines);
+    memset(cache->lineOf, 0xff, sizeof(int) * ids);
+}
+
+static void freeSimCache(SimCache* cache, int ids) {
+    reallocate(cache->lineOf, sizeof(int) * ids, 0);
+    reallocate(cache->ids, sizeof(uint32_t) * cache->lines, 0);
+    reallocate(cache->states, sizeof(State) * cache->lines, 0);
+    reallocate(cache->prev, sizeof(int) * cache->lines, 0);
+    reallocate(cache->next, sizeof(int) * cache->lines, 0);
+}
+
+static void unlinkLine(SimCache* cache, int line) {
+    if (cache->prev[line] != -1) {
+        cache->next[cache->prev[line]] = cache->next[line];
+    } else {
+        cache->head = cache->next[line];
+    }
+    if (cache->next[line] != -1) {
+        cache->prev[cache->next[line]] = cache->prev[line];
+    } else {
+        cache->tail = cache->prev[line];
+    }
+}
+
+static void makeMostRecent(SimCache* cache, int line) {
+    cache->prev[line] = -1;
+    cache->next[line] = cache->head;
+    if (cache->head != -1) {
+        cache->prev[cache->head] = line;
+    }
+    cache->head = line;
+    if (cache->tail == -1) {
+        cache->tail = line;
+    }
+}
+
+static void simulate(SimConfig* config, SimStats* stats) {
+    SimCache* caches = (SimCache*)reallocate(NULL, 0, sizeof(SimCache) * workload.cores);
+    uint64_t* coreCycles = (uint64_t*)reallocate(NULL, 0, sizeof(uint64_t) * workload.cores);
+    for (int i = 0; i < workload.cores; i++) {
+        initSimCache(&caches[i], config->lines, workload.ids);
+        coreCycles[i] = 0;
+    }
+    memset(stats, 0, sizeof(SimStats));
+
+    for (int i = 0; i < workload.count; i++) {
+        Access* access = &workload.accesses[i];
+        SimCache* cache = &caches[access->core];
+        int line = cache->lineOf[access->id];
+        State state = line >= 0 ? cache->states[line] : INVALID;
+        bool othersHaveCopy = false;
+        for (int core = 0; core < workload.cores; core++) {
+            int other = caches[core].lineOf[access->id];
+            if (core != access->core && other >= 0 && caches[core].states[other] != INVALID) {
+                othersHaveCopy = true;
+            }
+        }
+
+        BusAction busAction;
+        State next = processorTransition(config->protocol, state, access->action, \
+            othersHaveCopy, &busAction);
+        stats->accesses++;
+        switch (busAction) {
+            case BUS_NONE: stats->hits++; break;
+            case BUS_READ: stats->busReads++; break;
+            case BUS_READ_X: stats->busReadXs++; break;
+            case BUS_UPGRADE: stats->upgrades++; break;
+        }
+        bool transferred = false;
+        if (busAction != BUS_NONE && othersHaveCopy) {
+            for (int core = 0; core < workload.cores; core++) {
+                int other = caches[core].lineOf[access->id];
+                if (core == access->core || other < 0) {
+                    continue;
+                }
+                bool suppliesData;
+                caches[core].states[other] = snoopTransition(caches[core].states[other], \
+                    busAction, &suppliesData);
+                if (suppliesData) {
+                    stats->transfers++;
+                    transferred = true;
+                }
+            }
+        }
+        switch (busAction) {
+            case BUS_NONE:
+                coreCycles[access->core] += costModel.hit;
+                break;
+            case BUS_READ:
+            case BUS_READ_X:
+                coreCycles[access->core] += costModel.arbitration + \
+                    (transferred ? costModel.transfer : costModel.memory);
+                break;
+            case BUS_UPGRADE:
+                coreCycles[access->core] += costModel.arbitration + costModel.invalidation;
+                break;
+        }
+
+        if (line >= 0) {
+            unlinkLine(cache, line);
+        } else if (cache->used < cache->lines) {
+            line = cache->used++;
+        } else {    // Replace the least recently used line
+            line = cache->tail;
+            unlinkLine(cache, line);
+            if (cache->states[line] == MODIFIED) {
+                stats->writeBacks++;
+                coreCycles[access->core] += costModel.arbitration + costModel.memory;
+            }
+            cache->lineOf[cache->ids[line]] = -1;
+        }
+        cache->lineOf[access->id] = line;
+        cache->ids[line] = access->id;
+        cache->states[line] = next;
+        makeMostRecent(cache, line);
+    }
+
+    for (int i = 0; i < workload.cores; i++) {
+        freeSimCache(&caches[i], workload.ids);
+        stats->cycles += coreCycles[i];
+        if (coreCycles[i] > stats->maxCoreCycles) {
+            stats->maxCoreCycles = coreCycles[i];
+        }
+    }
+    reallocate(caches, sizeof(SimCache) * workload.cores, 0);
+    reallocate(coreCycles, sizeof(uint64_t) * workload.cores, 0);
+}
+
+static void* worker(void* arg) {
+    for (;;) {
+        int index = __atomic_fetch_add(&nextConfig, 1, __ATOMIC_RELAXED);
+        if (index >= configCount) {
+            return NULL;
+        }
+        simulate(&configs[index], &results[index]);
+    }
+}
+
+static bool parseConfigs(const char* lineList, const char* protocolList) {
+    char protocols[256];
+    snprintf(protocols, sizeof(protocols), "%s", protocolList);
+    for (char* protocol = strtok(protocols, ","); protocol != NULL; protocol = strtok(NULL, ",")) {
+        Protocol kind;
+        if (strcmp(protocol, "msi") == 0) {
+            kind = PROTOCOL_MSI;
+        } else if (strcmp(protocol, "mesi") == 0) {
+            kind = PROTOCOL_MESI;
+        } else {
+            fprintf(stderr, "Unknown protocol %s\n", protocol);
+            return false;
+        }
+        const char* lines = lineList;
+        while (*lines != '\0') {
+            char* end;
+            long first = strtol(lines, &end, 10), last = first;
+            if (*end == '-') {      // Range of line counts
+                last = strtol(end + 1, &end, 10);
+            }
+            if (first < 1 || last < first) {
+                fprintf(stderr, "Invalid line count list %s\n", lineList);
+                return false;
+            }
+            for (long count = first; count <= last; count++) {
+                if (configCount == MAX_CONFIGS) {
+                    fprintf(stderr, "Too many configurations.\n");
+                    return false;
+                }
+                configs[configCount++] = (SimConfig){kind, (int)count};
+            }
+            lines = *end == ',' ? end + 1 : end;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int threads = 1, traces = 0;
+    const char* lineList = "3";
+    const char* protocolList = "msi";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            lineList = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            protocolList = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            if (!parseCostModel(argv[++i])) {
+                printf("Invalid cost model %s\n", argv[i]);
+                exit(1);
+            }
+        } else {
+            FILE* file = fopen(argv[i], "rb");
+            if (file == NULL) {
+                printf("Error - Could not open file %s.\n", argv[i]);
+                exit(1);
+            }
+            char magic[4];
+            bool isBinary = fread(magic, 1, 4, file) == 4 && memcmp(magic, TRACE_MAGIC, 4) == 0;
+            rewind(file);
+            if (!(isBinary ? readBinaryTrace(file, traces) : readTextTrace(file))) {
+                printf("Error - Could not read trace %s.\n", argv[i]);
+                exit(1);
+            }
+            fclose(file);
+            traces++;
+        }
+    }
+    if (traces == 0) {
+        printf("Usage: sim [-j threads] [-l lines,first-last,...] [-p msi,mesi] " \
+            "[-c name=cycles,...] trace...\n");
+        exit(1);
+    }
+    if (!parseConfigs(lineList, protocolList)) {
+        exit(1);
+    }
+    if (traces > 1) {
+        mergeTraces();
+    }
+    workload.ids = idMap.count;
+
+    if (threads < 1) {
+        threads = 1;
+    }
+    pthread_t* workers = (pthread_t*)reallocate(NULL, 0, sizeof(pthread_t) * threads);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, worker, NULL);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    reallocate(workers, sizeof(pthread_t) * threads, 0);
+
+    printf("protocol,lines,accesses,hits,bus_reads,bus_read_x,upgrades,write_backs,transfers," \
+        "hit_rate,cycles,max_core_cycles\n");
+    for (int i = 0; i < configCount; i++) {
+        SimStats* stats = &results[i];
+        printf("%s,%d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%.4f,%llu,%llu\n", \
+            configs[i].protocol == PROTOCOL_MSI ? "msi" : "mesi", configs[i].lines, \
+            stats->accesses, stats->hits, stats->busReads, stats->busReadXs, stats->upgrades, \
+            stats->writeBacks, stats->transfers, \
+            stats->accesses > 0 ? (double)stats->hits / stats->accesses : 0.0, \
+            (unsigned long long)stats->cycles, (unsigned long long)stats->maxCoreCycles);
+    }
+    return 0;
+}
@@ -8,14 +8,20 @@
 #include <string.h>
 
 #include "compiler.h"
+#include "memmng.h"
 #include "memoryBus.h"
+#include "optimizer.h"
 #include "scanner.h"
 
 Parser parser;
 Compiler* currentCompiler = NULL;
+bool constantStats = false;
+bool optimizeCode = false;
+int inlineThreshold = 16;
+static FlatCode flat;
 
 static Sequence* currentSequence() {
-    return &currentCompiler->function->sequence;
+    return &flat.sequence;
 }
 
 static void errorAt(Token* token, const char* message) {
@@ -35,10 +41,6 @@ static void errorAtCurrent(const char* message) {
     errorAt(&parser.current, message);
 }
 
-static void error(const char* message) {
-    errorAt(&parser.previous, message);
-}
-
 static void advanceParser() {
     parser.previous = parser.current;
 
@@ -81,31 +83,91 @@ static void writeBytes(uint8_t byte1, uint8_t byte2) {
     writeByte(byte2);
 }
 
+/**
+ * @brief Records the constant of the instruction being written. The operand
+ * is a placeholder until the flat code is split into functions, which is
+ * when each function gets its own constants.
+ * 
+ * @param value 
+ * @return uint8_t 
+ */
 static uint8_t makeConstant(Value value) {
-    int index = addValue(currentSequence(), value);
-    if (index > UINT8_MAX) {
-        error("Too many constants in one sequence.");
-        return 0;
+    if (flat.constants.capacity < flat.constants.count + 1) {
+        flat.constantTokens = (Token*)reallocate(flat.constantTokens, \
+            sizeof(Token) * flat.constants.capacity, \
+            sizeof(Token) * (flat.constants.capacity < 16 ? 16 : flat.constants.capacity * 2));
+    }
+    flat.constantTokens[flat.constants.count] = parser.previous;
+    writeValueArray(&flat.constants, value);
+    return 0;
+}
+
+static void addEvent(EventType type, int offset, String* name) {
+    if (flat.eventCapacity < flat.eventCount + 1) {
+        int prevCapacity = flat.eventCapacity;
+        flat.eventCapacity = prevCapacity < 16 ? 16 : prevCapacity * 2;
+        flat.events = (Event*)reallocate(flat.events, sizeof(Event) * prevCapacity, \
+            sizeof(Event) * flat.eventCapacity);
     }
-    return (uint8_t)index;
+    flat.events[flat.eventCount++] = (Event){type, offset, name, parser.previous, NULL};
+}
+
+static void initFlatCode() {
+    initSequence(&flat.sequence);
+    initValueArray(&flat.constants);
+    flat.constantTokens = NULL;
+    flat.events = NULL;
+    flat.eventCount = 0;
+    flat.eventCapacity = 0;
+    initNameList(&flat.calls);
+    initNameList(&flat.globals);
+    flat.lastCall = -1;
 }
 
-static void initCompiler(VM* vm, Compiler* compiler, FunctionType type) {
+static void freeFlatCode() {
+    reallocate(flat.constantTokens, sizeof(Token) * flat.constants.capacity, 0);
+    freeSequence(&flat.sequence);
+    freeValueArray(&flat.constants);
+    reallocate(flat.events, sizeof(Event) * flat.eventCapacity, 0);
+    freeNameList(&flat.calls);
+    freeNameList(&flat.globals);
+    initFlatCode();
+}
+
+static Compiler* initCompiler(FunctionObject* function, FunctionType type, int start) {
+    Compiler* compiler = (Compiler*)reallocate(NULL, 0, sizeof(Compiler));
     compiler->previousCompiler = currentCompiler;
-    compiler->function = NULL;
+    compiler->function = function;
     compiler->type = type;
-    compiler->function = newFunction(vm);
+    initNameList(&compiler->labelList);
+    initNameList(&compiler->encounteredList);
+    compiler->start = start;
+    compiler->end = -1;
+    compiler->declared = false;
+    initConstantPool(&compiler->constants);
     currentCompiler = compiler;
-    if (type != TYPE_DEFAULT) {
-        currentCompiler->function->name = copyString(&vm->strings, vm->objects, parser.previous.start, parser.previous.length);
+    return compiler;
+}
+
+static void reportConstants(Compiler** compilers, int count) {
+    printf("%-20s %10s %10s %10s\n", "function", "constants", "operands", "bytes");
+    for (int i = 0; i < count; i++) {
+        Sequence* sequence = &compilers[i]->function->sequence;
+        int operands = 0;
+        for (int offset = 0; offset < sequence->count; offset += instructionLength(sequence->code[offset])) {
+            if (sequence->code[offset] != OP_WIDE && instructionLength(sequence->code[offset]) > 1) {
+                operands++;
+            }
+        }
+        String* name = compilers[i]->function->name;
+        printf("%-20.*s %10d %10d %10d\n", name == NULL ? 6 : name->length, \
+            name == NULL ? "<main>" : name->characters, sequence->constants.count, operands, sequence->count);
     }
-    initNameList(&currentCompiler->labelList);
 }
 
-static FunctionObject* endCompiler() {
-    FunctionObject* function = currentCompiler->function;
+static void endCompiler(int end) {
+    currentCompiler->end = end;
     currentCompiler = currentCompiler->previousCompiler;
-    return function;
 }
 
 static void declaration(VM* vm);
@@ -116,7 +178,7 @@ static void statement(VM* vm) {
         writeByte(OP_PUSH);
         consumeToken(TOKEN_NUMBER, "Expected a number.");
         int num = atoi(parser.previous.start);
-        uint8_t index = makeConstant((Value){NUM_VALUE, {.number = num}});
+        uint8_t index = makeConstant(numberValue(num));
         writeByte(index);
         // printf("After push\n");
     } else if (matchToken(TOKEN_POP)) {
@@ -125,7 +187,7 @@ static void statement(VM* vm) {
     } else if (matchToken(TOKEN_SHOW)) {
         consumeToken(TOKEN_STRING, "Expected a string.");
         Token* name = &parser.previous; 
-        uint8_t index = makeConstant((Value){OBJ_VALUE, {.obj = (Object*)copyString(&vm->strings, vm->objects, name->start, name->length)}});
+        uint8_t index = makeConstant(objectValue((Object*)copyString(&vm->strings, &vm->heap, name->start, name->length)));
         writeBytes(OP_SHOW, index);
         // printf("After show\n");
     } else if (matchToken(TOKEN_COPY)) {
@@ -136,6 +198,28 @@ static void statement(VM* vm) {
         // printf("After assign\n");
     } else if (matchToken(TOKEN_ASSIGN_ADDRESS)) {
         writeByte(OP_ASSIGN_ADDRESS);
+    } else if (matchToken(TOKEN_LOAD)) {
+        writeByte(OP_LOAD);
+    } else if (matchToken(TOKEN_STORE)) {
+        writeByte(OP_STORE);
+    } else if (matchToken(TOKEN_VADD)) {
+        writeByte(OP_VECTOR_ADD);
+    } else if (matchToken(TOKEN_VSUB)) {
+        writeByte(OP_VECTOR_SUBTRACT);
+    } else if (matchToken(TOKEN_VMUL)) {
+        writeByte(OP_VECTOR_MULTIPLY);
+    } else if (matchToken(TOKEN_VFILL)) {
+        writeByte(OP_VECTOR_FILL);
+    } else if (matchToken(TOKEN_VCOPY)) {
+        writeByte(OP_VECTOR_COPY);
+    } else if (matchToken(TOKEN_VSUM)) {
+        writeByte(OP_VECTOR_SUM);
+    } else if (matchToken(TOKEN_FADD)) {
+        writeByte(OP_FETCH_ADD);
+    } else if (matchToken(TOKEN_CAS)) {
+        writeByte(OP_COMPARE_SWAP);
+    } else if (matchToken(TOKEN_XCHG)) {
+        writeByte(OP_EXCHANGE);
     } else if (matchToken(TOKEN_HALT)) {
         writeByte(OP_HALT);
         // printf("After halt\n");
@@ -187,65 +271,65 @@ static void statement(VM* vm) {
     } else if (matchToken(TOKEN_CALL)) {
         consumeToken(TOKEN_IDENTIFIER, "Expected a name.");
         Token* name = & parser.previous;
-        uint8_t index = makeConstant((Value){OBJ_VALUE, {.obj = (Object*)copyString(&vm->strings, vm->objects, name->start, name->length)}});
+        Value constant = objectValue((Object*)copyString(&vm->strings, &vm->heap, name->start, name->length));
+        uint8_t index = makeConstant(constant);
+        flat.lastCall = currentSequence()->count;
         writeBytes(OP_CALL, index);
+        // Labels of called names start functions
+        addName(&flat.calls, (String*)asObject(constant));
         // printf("After call\n");
     } else if (matchToken(TOKEN_RETURN)) {
+        // Nothing runs between the call and the return, so the callee can take the frame
+        if (flat.lastCall != -1 && flat.lastCall == currentSequence()->count - 2) {
+            currentSequence()->code[flat.lastCall] = OP_TAIL_CALL;
+        }
+        addEvent(EVENT_RETURN, currentSequence()->count, NULL);
         writeByte(OP_RETURN);
         // printf("After return\n");
     } else if (matchToken(TOKEN_LVALUE)) {
         consumeToken(TOKEN_IDENTIFIER, "Expected a name.");
         Token* name = &parser.previous;
-        uint8_t index = makeConstant((Value){OBJ_VALUE, {.obj = (Object*)copyString(&vm->strings, vm->objects, name->start, name->length)}});
+        uint8_t index = makeConstant(objectValue((Object*)copyString(&vm->strings, &vm->heap, name->start, name->length)));
         writeBytes(OP_LVALUE, index);
         // printf("After lvalue\n");
     } else if (matchToken(TOKEN_RVALUE)) {
         consumeToken(TOKEN_IDENTIFIER, "Expected a name.");
         Token* name = &parser.previous;
-        uint8_t index = makeConstant((Value){OBJ_VALUE, {.obj = (Object*)copyString(&vm->strings, vm->objects, name->start, name->length)}});
+        uint8_t index = makeConstant(objectValue((Object*)copyString(&vm->strings, &vm->heap, name->start, name->length)));
         writeBytes(OP_RVALUE, index);
         // printf("After rvalue\n");
     } else if (matchToken(TOKEN_GOTO)) {
         consumeToken(TOKEN_IDENTIFIER, "Expected a name.");
         Token* name = &parser.previous;
-        uint8_t index = makeConstant((Value){OBJ_VALUE, {.obj = (Object*)copyString(&vm->strings, vm->objects, name->start, name->length)}});
+        Value constant = objectValue((Object*)copyString(&vm->strings, &vm->heap, name->start, name->length));
+        uint8_t index = makeConstant(constant);
         writeBytes(OP_JUMP, index);
+        // Rewritten relative to the function when the flat code is split
         int jumpPoint = currentSequence()->count - 1;
         writeBytes(((jumpPoint >> 8) & 0xff), (jumpPoint & 0xff));
-        int labelIndex = getNameIndex(&currentCompiler->labelList, name->start, name->length);
-        if (labelIndex != -1) {
-            currentCompiler->encounteredLabel[labelIndex] = true;
-        } else {
-            addName(&currentCompiler->labelList, name->start, name->length);
-        }
+        addEvent(EVENT_JUMP, jumpPoint, (String*)asObject(constant));
         // printf("After goto\n");
     } else if (matchToken(TOKEN_GOFALSE)) {
         consumeToken(TOKEN_IDENTIFIER, "Expected a name.");
         Token* name = &parser.previous;
-        uint8_t index = makeConstant((Value){OBJ_VALUE, {.obj = (Object*)copyString(&vm->strings, vm->objects, name->start, name->length)}});
+        Value constant = objectValue((Object*)copyString(&vm->strings, &vm->heap, name->start, name->length));
+        uint8_t index = makeConstant(constant);
         writeBytes(OP_JUMP_IF_FALSE, index);
+        // Rewritten relative to the function when the flat code is split
         int jumpPoint = currentSequence()->count - 1;
         writeBytes(((jumpPoint >> 8) & 0xff), (jumpPoint & 0xff));
-        int labelIndex = getNameIndex(&currentCompiler->labelList, name->start, name->length);
-        if (labelIndex != -1) {
-            currentCompiler->encounteredLabel[labelIndex] = true;
-        } else {
-            addName(&currentCompiler->labelList, name->start, name->length);
-        }
+        addEvent(EVENT_JUMP, jumpPoint, (String*)asObject(constant));
         // printf("After gofalse\n");
     } else if (matchToken(TOKEN_GOTRUE)) {
         consumeToken(TOKEN_IDENTIFIER, "Expected a name.");
         Token* name = &parser.previous;
-        uint8_t index = makeConstant((Value){OBJ_VALUE, {.obj = (Object*)copyString(&vm->strings, vm->objects, name->start, name->length)}});
+        Value constant = objectValue((Object*)copyString(&vm->strings, &vm->heap, name->start, name->length));
+        uint8_t index = makeConstant(constant);
         writeBytes(OP_JUMP_IF_TRUE, index);
+        // Rewritten relative to the function when the flat code is split
         int jumpPoint = currentSequence()->count - 1;
         writeBytes(((jumpPoint >> 8) & 0xff), (jumpPoint & 0xff));
-        int labelIndex = getNameIndex(&currentCompiler->labelList, name->start, name->length);
-        if (labelIndex != -1) {
-            currentCompiler->encounteredLabel[labelIndex] = true;
-        } else {
-            addName(&currentCompiler->labelList, name->start, name->length);
-        }
+        addEvent(EVENT_JUMP, jumpPoint, (String*)asObject(constant));
         // printf("After gotrue\n");
     } else if (matchToken(TOKEN_BEGIN)) {
         writeByte(OP_BEGIN);
@@ -256,34 +340,128 @@ static void statement(VM* vm) {
     }
 }
 
-static bool encounteredAllLabels() {
-    for (int i = 0; i < currentCompiler->labelList.count; i++) {
-        if (!currentCompiler->encounteredLabel[i]) {
-            return false;
-        }
+static bool encounteredAllLabels(Compiler* compiler) {
+    return compiler->encounteredList.count == compiler->labelList.count;
+}
+
+static void trackLabel(Compiler* compiler, String* name) {
+    if (isInNameList(&compiler->labelList, name)) {
+        addName(&compiler->encounteredList, name);
+    } else {
+        addName(&compiler->labelList, name);
     }
-    return true;
 }
 
-static FunctionObject* compileFunction(VM* vm, FunctionType type) {
-    Compiler compiler;
-    // printf("init function Compiler\n");
-    initCompiler(vm, &compiler, type);
-    for (;;) {
-        declaration(vm);
+/**
+ * @brief Replays the events of the single pass with every called name
+ * known. A label of a called name opens a function, which is closed by the
+ * first return after which all labels of the function were met twice (a
+ * return right after the function label does not count). Adds every opened
+ * Compiler to compilers, in order of their start.
+ * 
+ * @param vm 
+ * @param compilers 
+ * @param count 
+ * @param capacity 
+ */
+static void replayEvents(VM* vm, Compiler*** compilers, int* count, int* capacity) {
+    for (int i = 0; i < flat.eventCount; i++) {
+        Event* event = &flat.events[i];
+        Compiler* compiler = currentCompiler;
+        if (event->type == EVENT_RETURN) {
+            if (compiler->type == TYPE_FUNCTION && (compiler->declared || event->offset > compiler->start) \
+                && encounteredAllLabels(compiler)) {
+                endCompiler(event->offset + 1);
+            }
+            compiler->declared = true;
+            continue;
+        }
+        compiler->declared = true;
+        if (event->type == EVENT_JUMP) {
+            trackLabel(compiler, event->name);
+            continue;
+        }
+        Value value;
+        if (isInNameList(&flat.calls, event->name)) {
+            FunctionObject* function = newFunction(vm);
+            function->name = event->name;
+            Value fun = objectValue((Object*) function);
+            if (tableGetValue(&compiler->function->labels, event->name, &value) == -2) {
+                errorAt(&event->token, "Function already defined.");
+            }
+            tableSetValue(&compiler->function->labels, event->name, fun);
+            if (*capacity < *count + 1) {
+                int prevCapacity = *capacity;
+                *capacity = prevCapacity < 8 ? 8 : prevCapacity * 2;
+                *compilers = (Compiler**)reallocate(*compilers, sizeof(Compiler*) * prevCapacity, \
+                    sizeof(Compiler*) * *capacity);
+            }
+            (*compilers)[(*count)++] = initCompiler(function, TYPE_FUNCTION, event->offset);
+        } else {
+            trackLabel(compiler, event->name);
+            if (tableGetValue(&compiler->function->labels, event->name, &value) == -2) {
+                errorAt(&event->token, "Label already defined.");
+            }
+            // The offset is known once the function's code is split out
+            tableSetValue(&compiler->function->labels, event->name, numberValue(0));
+            event->function = compiler->function;
+        }
+    }
+    while (currentCompiler->type == TYPE_FUNCTION) {
+        errorAtCurrent("Expected a return before end of function.");
+        endCompiler(flat.sequence.count);
+    }
+}
 
-        if (checkToken(TOKEN_RETURN)) {
-            if (encounteredAllLabels()) {
+/**
+ * @brief Copies every instruction of the flat code to the function that
+ * owns it, giving each function its own constants, the offsets of its
+ * labels and jump points relative to its start. Constant indices above
+ * 255 get an OP_WIDE prefix.
+ * 
+ * @param compilers main first, then functions in order of their start
+ * @param count 
+ */
+static void splitFunctions(Compiler** compilers, int count) {
+    Sequence* code = &flat.sequence;
+    Compiler* owner = compilers[0];
+    int next = 1, event = 0, constant = 0;
+    LineCursor cursor = {0, 0, 0};
+    for (int offset = 0; offset <= code->count;) {
+        // Nested ranges: leave the ended ones, enter the ones starting here
+        for (;;) {
+            if (owner != compilers[0] && owner->end <= offset) {
+                owner = owner->previousCompiler;
+            } else if (next < count && compilers[next]->start == offset) {
+                owner = compilers[next++];
+            } else {
                 break;
             }
-        } else if (checkToken(TOKEN_EOF)) {
+        }
+        for (; event < flat.eventCount && flat.events[event].offset <= offset; event++) {
+            Event* label = &flat.events[event];
+            if (label->type == EVENT_LABEL && label->function != NULL) {
+                tableSetValue(&label->function->labels, label->name, \
+                    numberValue(label->function->sequence.count));
+            }
+        }
+        if (offset == code->count) {
             break;
         }
+
+        // All bytes of an instruction come from the line of its opcode
+        int line = advanceLine(code, &cursor, offset);
+
+        int length = instructionLength(code->code[offset]);
+        Value value = length == 1 ? numberValue(0) : flat.constants.values[constant];
+        if (!writeInstruction(&owner->function->sequence, &owner->constants, code->code[offset], value, line)) {
+            errorAt(&flat.constantTokens[constant], "Too many constants in one sequence.");
+        }
+        if (length > 1) {
+            constant++;
+        }
+        offset += length;
     }
-    consumeToken(TOKEN_RETURN, "Expected a return before end of function.");
-    writeByte(OP_RETURN);
-    // printf("ended function compiler\n");
-    return endCompiler();
 }
 
 static void declaration(VM* vm) {
@@ -292,30 +470,9 @@ static void declaration(VM* vm) {
         // printf("In label\n");
         consumeToken(TOKEN_IDENTIFIER, "Expected a name.");
         Token* name = &parser.previous;
-        String* key = copyString(&vm->strings, vm->objects, name->start, name->length);
-        // uint8_t index = makeConstant((Value){OBJ_VALUE, {.obj = (Object*)key}});
-        if (isInNameList(&functionNames, name->start, name->length)) {
-            // printf("New function\n");
-            FunctionObject* function = compileFunction(vm, TYPE_FUNCTION);
-            Value fun = (Value){OBJ_VALUE, {.obj = (Object*) function}};
-            if (tableGetValue(&currentCompiler->function->labels, key, &fun) == -2) {
-                error("Function already defined.");
-            }
-            tableSetValue(&currentCompiler->function->labels, key, fun);
-        } else {
-            // printf("New Label\n");
-            int labelIndex = getNameIndex(&currentCompiler->labelList, name->start, name->length);
-            if (labelIndex != -1) {
-                currentCompiler->encounteredLabel[labelIndex] = true;
-            } else {
-                addName(&currentCompiler->labelList, name->start, name->length);
-            }
-            Value value = (Value){NUM_VALUE, {.number = currentSequence()->count}};
-            if (tableGetValue(&currentCompiler->function->labels, key, &value) == -2) {
-                error("Label already defined.");
-            }
-            tableSetValue(&currentCompiler->function->labels, key, value);
-        }
+        String* key = copyString(&vm->strings, &vm->heap, name->start, name->length);
+        // Whether it starts a function is only known once all calls are read
+        addEvent(EVENT_LABEL, currentSequence()->count, key);
         // printf("After label\n");
     } else {
         statement(vm);
@@ -324,31 +481,115 @@ static void declaration(VM* vm) {
 
 /**
  * @brief Sends a message to the bus to write the read names to
- * a chunk of memory.
+ * a chunk of memory, and keeps them as the globals of the program.
  * 
  * @param socket_fd 
+ * @param vm 
  */
-static void writeName(int socket_fd) {
-    char buffer[1024] = "add ";
-    int j = 4;
-    while (matchToken(TOKEN_IDENTIFIER)) {
-        Token* name = &parser.previous;
-        for (int i = 0; i < name->length; i++, j++) {
-            buffer[j] = name->start[i];
-        }
-        buffer[j++] = ' ';
-    }
-    buffer[j] = '\0';
-    if (write(socket_fd, buffer, 1024) <= 0) {
+static void writeMessage(int socket_fd, const char* buffer) {
+    // No bus when only compiling to an image
+    if (socket_fd >= 0 && write(socket_fd, buffer, 1024) <= 0) {
         perror("Could not write to bus");
         exit(-1);
     }
 }
 
+void reserveData(int socket_fd, int count) {
+    char buffer[1024] = {0};
+    snprintf(buffer, sizeof(buffer), "rsv %d", count);
+    writeMessage(socket_fd, buffer);
+}
+
+void initDataLine(DataLine* line, int socket_fd) {
+    line->socket_fd = socket_fd;
+    memset(line->buffer, '\0', sizeof(line->buffer));
+    memcpy(line->buffer, "add ", 4);
+    line->length = 4;
+}
+
+bool appendDataName(DataLine* line, const char* name, int length) {
+    // The name, its space and the terminating '\0' must fit
+    if (4 + length + 2 > (int)sizeof(line->buffer)) {
+        return false;
+    }
+    if (line->length + length + 2 > (int)sizeof(line->buffer)) {
+        memcpy(line->buffer, "adc", 3);
+        line->buffer[line->length] = '\0';
+        writeMessage(line->socket_fd, line->buffer);
+        initDataLine(line, line->socket_fd);
+    }
+    memcpy(line->buffer + line->length, name, length);
+    line->length += length;
+    line->buffer[line->length++] = ' ';
+    return true;
+}
+
+void endDataLine(DataLine* line) {
+    line->buffer[line->length] = '\0';
+    writeMessage(line->socket_fd, line->buffer);
+}
+
+// Returns the size of the array given by token, or 0 if it is not between
+// 1 and ARRAY_SIZE_MAX
+static int arraySize(Token* token) {
+    long size = strtol(token->start, NULL, 10);
+    return size >= 1 && size <= ARRAY_SIZE_MAX ? (int)size : 0;
+}
+
+// Returns the number of names declared in the data segment of source
+static int countDataNames(const char* source) {
+    int count = 0;
+    initScanner(source);
+    Token token = scanToken();
+    if (token.type != TOKEN_DATA) {
+        return 0;
+    }
+    for (token = scanToken(); token.type != TOKEN_TEXT && token.type != TOKEN_EOF; token = scanToken()) {
+        if (token.type == TOKEN_IDENTIFIER) {
+            count++;
+        } else if (token.type == TOKEN_NUMBER) {
+            // Size of an array, whose name was counted already. The name
+            // is not sent if the size is invalid
+            count += arraySize(&token) - 1;
+        }
+    }
+    return count;
+}
+
+static void writeName(DataLine* line, VM* vm) {
+    while (matchToken(TOKEN_IDENTIFIER)) {
+        Token name = parser.previous;
+        addName(&flat.globals, copyString(&vm->strings, &vm->heap, name.start, name.length));
+        // An array is sent as name[size], and registered as a single block
+        char declaration[1024];
+        int length = snprintf(declaration, sizeof(declaration), "%.*s", name.length, name.start);
+        if (matchToken(TOKEN_LEFT_BRACKET)) {
+            consumeToken(TOKEN_NUMBER, "Expected the size of the array.");
+            int size = arraySize(&parser.previous);
+            if (size == 0) {
+                char message[64];
+                snprintf(message, sizeof(message), "Array size must be between 1 and %d.", ARRAY_SIZE_MAX);
+                errorAt(&parser.previous, message);
+            }
+            consumeToken(TOKEN_RIGHT_BRACKET, "Expected ']' after the size of the array.");
+            if (size == 0) {
+                continue;
+            }
+            length = snprintf(declaration, sizeof(declaration), "%.*s[%d]", name.length, name.start, size);
+        }
+        if (length >= (int)sizeof(declaration) || !appendDataName(line, declaration, length)) {
+            errorAt(&name, "Name too long for the bus.");
+        }
+    }
+}
+
 FunctionObject* compile(int socket_fd, VM* vm, const char* source) {
+    int dataNames = socket_fd >= 0 ? countDataNames(source) : 0;
+    if (dataNames > 0) {
+        reserveData(socket_fd, dataNames);
+    }
     initScanner(source);
-    Compiler compiler;
-    initCompiler(vm, &compiler, TYPE_DEFAULT);
+    initFlatCode();
 
     parser.hadError = false;
 
@@ -356,14 +597,57 @@ FunctionObject* compile(int socket_fd, VM* vm, const char* source) {
     if (matchToken(TOKEN_DATA)) {
         while (!matchToken(TOKEN_TEXT)) {
             while (matchToken(TOKEN_INT)) {
-                writeName(socket_fd);
+                DataLine line;
+                initDataLine(&line, socket_fd);
+                writeName(&line, vm);
+                endDataLine(&line);
             }
         }
     }
     while (!matchToken(TOKEN_EOF)) {
         declaration(vm);
     }
-    
-    FunctionObject* function = endCompiler();
+
+    FunctionObject* function = newFunction(vm);
+    int count = 1, capacity = 8;
+    Compiler** compilers = (Compiler**)reallocate(NULL, 0, sizeof(Compiler*) * capacity);
+    compilers[0] = initCompiler(function, TYPE_DEFAULT, 0);
+    replayEvents(vm, &compilers, &count, &capacity);
+    compilers[0]->end = flat.sequence.count;
+    splitFunctions(compilers, count);
+    if (optimizeCode && !parser.hadError && inlineThreshold > 0) {
+        FunctionObject** functions = (FunctionObject**)reallocate(NULL, 0, sizeof(FunctionObject*) * count);
+        for (int i = 0; i < count; i++) {
+            functions[i] = compilers[i]->function;
+        }
+        InlineStats stats = {0, 0, 0};
+        inlineCalls(vm, functions, count, &flat.globals, inlineThreshold, &stats);
+        reallocate(functions, sizeof(FunctionObject*) * count, 0);
+        printf("Inlined %d calls: %d -> %d instructions\n", stats.calls, stats.before, stats.after);
+    }
+    if (optimizeCode && !parser.hadError) {
+        OptimizerStats stats = {0, 0, 0};
+        for (int i = 0; i < count; i++) {
+            optimizeFunction(compilers[i]->function, &stats);
+        }
+        printf("Optimized: removed %d of %d instructions, folded %d expressions\n", \
+            stats.removed, stats.instructions, stats.folded);
+    }
+    if (constantStats) {
+        reportConstants(compilers, count);
+    }
+    if (!parser.hadError) {
+        resolveCalls(function);
+    }
+
+    currentCompiler = NULL;
+    for (int i = 0; i < count; i++) {
+        freeNameList(&compilers[i]->labelList);
+        freeNameList(&compilers[i]->encounteredList);
+        freeConstantPool(&compilers[i]->constants);
+        reallocate(compilers[i], sizeof(Compiler), 0);
+    }
+    reallocate(compilers, sizeof(Compiler*) * capacity, 0);
+    freeFlatCode();
     return parser.hadError ? NULL : function;
 }
\ No newline at end of file
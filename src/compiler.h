@@ -4,10 +4,14 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "nameList.h"
 #include "object.h"
 #include "scanner.h"
 #include "vm.h"
 
+// Largest number of elements of an array declared in a data segment
+#define ARRAY_SIZE_MAX (1 << 24)
+
 typedef enum {
     TYPE_DEFAULT,
     TYPE_FUNCTION,
@@ -25,29 +29,149 @@ typedef struct {
     bool hadError;
 } Parser;
 
+typedef enum {
+    EVENT_LABEL,
+    EVENT_JUMP,
+    EVENT_RETURN,
+} EventType;
+
 /**
- * struct Compiler - Stores information to be used during compilation
+ * struct Event - A label, jump or return met in the single pass, replayed
+ * afterwards to split the flat code into functions
+ * @a: type -> EventType : kind of the event
+ * @b: offset -> int : offset in the flat code of the next instruction for a
+ * label, of the name operand for a jump, of OP_RETURN for a return
+ * @c: name -> String* : name of the label or jump target, NULL for a return
+ * @d: token -> Token : token of the name, for error messages
+ * @e: function -> FunctionObject* : function whose labels hold the label,
+ * set while replaying
+ */
+typedef struct {
+    EventType type;
+    int offset;
+    String* name;
+    Token token;
+    FunctionObject* function;
+} Event;
+
+/**
+ * struct FlatCode - Output of the single pass, before it is split into functions
+ * @a: sequence -> Sequence : code and lines of the whole program, constant
+ * operands are only placeholders
+ * @b: constants -> ValueArray : constants in the order of their operands
+ * @c: constantTokens -> Token* : token each constant was made from
+ * @d: events -> Event* : labels, jumps and returns in source order
+ * @e: eventCount, eventCapacity -> int : size of events
+ * @f: calls -> NameList : names of all called functions
+ * @g: globals -> NameList : names declared in the data segment
+ * @h: lastCall -> int : offset of the last OP_CALL, -1 if there is none
+ */
+typedef struct {
+    Sequence sequence;
+    ValueArray constants;
+    Token* constantTokens;
+    Event* events;
+    int eventCount;
+    int eventCapacity;
+    NameList calls;
+    NameList globals;
+    int lastCall;
+} FlatCode;
+
+/**
+ * struct Compiler - A function opened while replaying the events
  * @a: previousCompiler -> Compiler* : stores compiler of enclosing function
  * @b: function -> FunctionObject* : function to be returned when compilation is done, all OpCodes are stored here
  * @c: type -> FunctionType : checks if we are inside a user defined function
  * @d: labelList -> NameList : stores all names of labels inside a function
- * @e: encounteredLabel -> bool[] : keeps track if any label stored in labelList is encountered at least twice
+ * @e: encounteredList -> NameList : labels of labelList encountered at least twice
+ * @f: start, end -> int : range of the function in the flat code
+ * @g: declared -> bool : whether anything was declared since the function label
+ * @h: constants -> ConstantPool : constants of the function
  */
 typedef struct Compiler {
     struct Compiler* previousCompiler;
     FunctionObject* function;
     FunctionType type;
     NameList labelList;
-    bool encounteredLabel[256];
+    NameList encounteredList;
+    int start;
+    int end;
+    bool declared;
+    ConstantPool constants;
 } Compiler;
 
 /**
- * @brief 
+ * struct DataLine - Message to the bus being filled with the names of a
+ * .int line
+ * @a: socket_fd -> int : bus the messages are sent to, -1 for none
+ * @b: buffer -> char[] : the message, "add " followed by names and spaces
+ * @c: length -> int : number of bytes used in buffer
+ *
+ * Description: A line whose names do not fit one message is streamed as
+ * "adc" messages, which the bus continues with the next one, ended by an
+ * "add" message. All of them register a single block.
+ */
+typedef struct {
+    int socket_fd;
+    char buffer[1024];
+    int length;
+} DataLine;
+
+// Print the size of the constant pool of every compiled function
+extern bool constantStats;
+// Run the optimizer of optimizer.h on every compiled function
+extern bool optimizeCode;
+// Largest callee, in instructions, inlined by the optimizer, 0 to not inline
+extern int inlineThreshold;
+
+/**
+ * @brief Compiles source in a single pass into flat code, then splits it
+ * into main and the functions whose labels are called, with their calls
+ * resolved. Returns main, or NULL on errors.
  * 
+ * @param socket_fd bus the data segment is sent to, -1 for none
  * @param vm 
  * @param source 
  * @return FunctionObject* 
  */
 FunctionObject* compile(int socket_fd, VM* vm, const char* source);
 
+/**
+ * @brief Tells the bus that count names are about to be added, so it
+ * sizes its memory for them once.
+ * 
+ * @param socket_fd bus the data segment is sent to, -1 for none
+ * @param count 
+ */
+void reserveData(int socket_fd, int count);
+
+/**
+ * @brief Starts a new .int line, sent to the given bus.
+ * 
+ * @param line 
+ * @param socket_fd -1 for none
+ */
+void initDataLine(DataLine* line, int socket_fd);
+
+/**
+ * @brief Appends a name to the line, first sending what the message holds
+ * if the name does not fit anymore. Returns false if the name is too long
+ * for any message.
+ * 
+ * @param line 
+ * @param name 
+ * @param length 
+ * @return true 
+ * @return false 
+ */
+bool appendDataName(DataLine* line, const char* name, int length);
+
+/**
+ * @brief Sends the last message of the line.
+ * 
+ * @param line 
+ */
+void endDataLine(DataLine* line);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,491 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "image.h"
+#include "memmng.h"
+#include "scanner.h"
+
+#define ALIGNMENT 4
+
+/**
+ * struct Buffer - Growable array of bytes the image is built in
+ * @a: bytes -> uint8_t* : contents of the image
+ * @b: count -> size_t : number of bytes written
+ * @c: capacity -> size_t : maximum number of bytes
+ */
+typedef struct {
+    uint8_t* bytes;
+    size_t count;
+    size_t capacity;
+} Buffer;
+
+/**
+ * struct ImageWriter - Everything collected before the image is written
+ * @a: functions -> FunctionObject** : all functions, main first
+ * @b: functionCount, functionCapacity -> int : size of functions
+ * @c: strings -> String** : all strings, in index order
+ * @d: stringCount, stringCapacity -> int : size of strings
+ * @e: indices -> Table : index of each string in strings
+ */
+typedef struct {
+    FunctionObject** functions;
+    int functionCount;
+    int functionCapacity;
+    String** strings;
+    int stringCount;
+    int stringCapacity;
+    Table indices;
+} ImageWriter;
+
+// Appends size bytes and pads to ALIGNMENT, returns the offset of the bytes
+static uint32_t append(Buffer* buffer, const void* data, size_t size) {
+    size_t padded = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    if (buffer->capacity < buffer->count + padded) {
+        size_t prevCapacity = buffer->capacity;
+        while (buffer->capacity < buffer->count + padded) {
+            buffer->capacity = buffer->capacity < 256 ? 256 : buffer->capacity * 2;
+        }
+        buffer->bytes = (uint8_t*)reallocate(buffer->bytes, prevCapacity, buffer->capacity);
+    }
+    uint32_t offset = (uint32_t)buffer->count;
+    if (data != NULL) {
+        memcpy(buffer->bytes + offset, data, size);
+    } else {
+        memset(buffer->bytes + offset, 0, size);
+    }
+    memset(buffer->bytes + offset + size, 0, padded - size);
+    buffer->count += padded;
+    return offset;
+}
+
+static int addString(ImageWriter* writer, String* string) {
+    Value index;
+    if (tableGetValue(&writer->indices, string, &index) != -1) {
+        return asNumber(index);
+    }
+    if (writer->stringCapacity < writer->stringCount + 1) {
+        int prevCapacity = writer->stringCapacity;
+        writer->stringCapacity = prevCapacity < 16 ? 16 : prevCapacity * 2;
+        writer->strings = (String**)reallocate(writer->strings, \
+            sizeof(String*) * prevCapacity, sizeof(String*) * writer->stringCapacity);
+    }
+    writer->strings[writer->stringCount] = string;
+    tableSetValue(&writer->indices, string, numberValue(writer->stringCount));
+    return writer->stringCount++;
+}
+
+static int findFunction(ImageWriter* writer, FunctionObject* function) {
+    for (int i = 0; i < writer->functionCount; i++) {
+        if (writer->functions[i] == function) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void addFunction(ImageWriter* writer, FunctionObject* function) {
+    if (findFunction(writer, function) != -1) {
+        return;
+    }
+    if (writer->functionCapacity < writer->functionCount + 1) {
+        int prevCapacity = writer->functionCapacity;
+        writer->functionCapacity = prevCapacity < 8 ? 8 : prevCapacity * 2;
+        writer->functions = (FunctionObject**)reallocate(writer->functions, \
+            sizeof(FunctionObject*) * prevCapacity, sizeof(FunctionObject*) * writer->functionCapacity);
+    }
+    writer->functions[writer->functionCount++] = function;
+    // Functions are stored in the labels of the function that declared them
+    for (int i = 0; i < function->labels.capacity; i++) {
+        Entry* entry = &function->labels.entries[i];
+        if (entry->key != NULL && isObject(entry->value)) {
+            addFunction(writer, (FunctionObject*)asObject(entry->value));
+        }
+    }
+}
+
+// Appends the .int lines of the data segment, returns their number
+static uint32_t writeDataSegment(Buffer* buffer, ImageWriter* writer, VM* vm, const char* source) {
+    uint32_t lines = 0, count = 0, countOffset = 0;
+    initScanner(source);
+    Token token = scanToken();
+    if (token.type != TOKEN_DATA) {
+        return 0;
+    }
+    for (token = scanToken(); token.type != TOKEN_TEXT && token.type != TOKEN_EOF;) {
+        if (token.type == TOKEN_INT) {
+            if (lines > 0) {
+                memcpy(buffer->bytes + countOffset, &count, sizeof(count));
+            }
+            count = 0;
+            countOffset = append(buffer, &count, sizeof(count));
+            lines++;
+        } else if (token.type == TOKEN_IDENTIFIER && lines > 0) {
+            // Arrays are kept as the name[size] sent to the bus, the
+            // compiler already checked the brackets
+            Token name = token;
+            char declaration[1024];
+            int length = snprintf(declaration, sizeof(declaration), "%.*s", name.length, name.start);
+            if ((token = scanToken()).type == TOKEN_LEFT_BRACKET) {
+                Token size = scanToken();
+                scanToken();
+                length = snprintf(declaration, sizeof(declaration), "%.*s[%.*s]", name.length, name.start, \
+                    size.length, size.start);
+                token = scanToken();
+            }
+            String* string = copyString(&vm->strings, &vm->heap, declaration, length);
+            int32_t index = addString(writer, string);
+            append(buffer, &index, sizeof(index));
+            count++;
+            continue;
+        }
+        token = scanToken();
+    }
+    if (lines > 0) {
+        memcpy(buffer->bytes + countOffset, &count, sizeof(count));
+    }
+    return lines;
+}
+
+static void writeFunction(Buffer* buffer, ImageWriter* writer, int index, uint32_t recordOffset) {
+    FunctionObject* function = writer->functions[index];
+    Sequence* sequence = &function->sequence;
+    ImageFunction record;
+    record.name = function->name == NULL ? -1 : addString(writer, function->name);
+    record.count = sequence->count;
+    record.codeOffset = append(buffer, sequence->code, sequence->count);
+    record.lineCount = sequence->lineCount;
+    record.linesOffset = append(buffer, sequence->lines, sizeof(LineDelta) * sequence->lineCount);
+
+    record.constantCount = sequence->constants.count;
+    record.constantsOffset = append(buffer, NULL, sizeof(ImageConstant) * record.constantCount);
+    for (int i = 0; i < sequence->constants.count; i++) {
+        Value value = sequence->constants.values[i];
+        ImageConstant constant = {valueType(value), isObject(value) ? \
+            addString(writer, (String*)asObject(value)) : asNumber(value)};
+        memcpy(buffer->bytes + record.constantsOffset + i * sizeof(ImageConstant), \
+            &constant, sizeof(constant));
+    }
+
+    record.labelCount = function->labels.count;
+    record.labelsOffset = append(buffer, NULL, sizeof(ImageLabel) * record.labelCount);
+    for (int i = 0, j = 0; i < function->labels.capacity; i++) {
+        Entry* entry = &function->labels.entries[i];
+        if (entry->key == NULL) {
+            continue;
+        }
+        ImageLabel label = {addString(writer, entry->key), valueType(entry->value), \
+            isObject(entry->value) ? \
+            findFunction(writer, (FunctionObject*)asObject(entry->value)) : asNumber(entry->value)};
+        memcpy(buffer->bytes + record.labelsOffset + (j++) * sizeof(ImageLabel), &label, sizeof(label));
+    }
+    memcpy(buffer->bytes + recordOffset, &record, sizeof(record));
+}
+
+bool isImage(const char* path) {
+    char magic[4];
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    bool result = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && \
+        memcmp(magic, IMAGE_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return result;
+}
+
+bool writeImage(const char* path, VM* vm, FunctionObject* function, const char* source) {
+    ImageWriter writer = {0};
+    initTable(&writer.indices);
+    addFunction(&writer, function);
+
+    Buffer buffer = {NULL, 0, 0};
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    append(&buffer, NULL, sizeof(header));
+    header.dataOffset = (uint32_t)buffer.count;
+    header.dataCount = writeDataSegment(&buffer, &writer, vm, source);
+    header.functionCount = writer.functionCount;
+    header.functionsOffset = append(&buffer, NULL, sizeof(ImageFunction) * writer.functionCount);
+    for (int i = 0; i < writer.functionCount; i++) {
+        writeFunction(&buffer, &writer, i, header.functionsOffset + i * sizeof(ImageFunction));
+    }
+
+    // Strings last, every section above may add some
+    header.stringCount = writer.stringCount;
+    header.stringsOffset = append(&buffer, NULL, sizeof(ImageString) * writer.stringCount);
+    header.charactersOffset = (uint32_t)buffer.count;
+    uint32_t characters = 0;
+    for (int i = 0; i < writer.stringCount; i++) {
+        String* string = writer.strings[i];
+        ImageString record = {characters, string->length, string->hash};
+        memcpy(buffer.bytes + header.stringsOffset + i * sizeof(ImageString), &record, sizeof(record));
+        characters += string->length + 1;
+    }
+    uint32_t offset = append(&buffer, NULL, characters);
+    for (int i = 0; i < writer.stringCount; i++) {
+        memcpy(buffer.bytes + offset, writer.strings[i]->characters, writer.strings[i]->length);
+        offset += writer.strings[i]->length + 1;
+    }
+
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.size = (uint32_t)buffer.count;
+    memcpy(buffer.bytes, &header, sizeof(header));
+
+    bool result = true;
+    FILE* file = fopen(path, "wb");
+    if (file == NULL || fwrite(buffer.bytes, 1, buffer.count, file) != buffer.count) {
+        perror("Could not write image");
+        result = false;
+    }
+    if (file != NULL && fclose(file) != 0) {
+        perror("Could not write image");
+        result = false;
+    }
+    reallocate(buffer.bytes, buffer.capacity, 0);
+    reallocate(writer.functions, sizeof(FunctionObject*) * writer.functionCapacity, 0);
+    reallocate(writer.strings, sizeof(String*) * writer.stringCapacity, 0);
+    freeTable(&writer.indices);
+    return result;
+}
+
+// True if count records of the given size starting at offset lie inside the image
+static bool inImage(const ImageHeader* header, uint32_t offset, uint32_t count, size_t size) {
+    return offset <= header->size && (uint64_t)count * size <= header->size - offset;
+}
+
+// Walks the code of one function, so no operand can index past its
+// constants or bytes once it runs
+static bool validCode(const uint8_t* image, const ImageFunction* record) {
+    const uint8_t* code = image + record->codeOffset;
+    const ImageConstant* constants = (const ImageConstant*)(image + record->constantsOffset);
+    uint32_t high = 0;
+    for (uint32_t offset = 0; offset < record->count;) {
+        uint8_t instruction = code[offset];
+        uint32_t length = instructionLength(instruction);
+        if (instruction > OP_EXCHANGE || record->count - offset < length) {
+            return false;
+        }
+        if (instruction == OP_WIDE) {
+            // The prefix only applies to an instruction with a constant
+            if (offset + length == record->count || instructionLength(code[offset + length]) == 1 || \
+                code[offset + length] == OP_WIDE) {
+                return false;
+            }
+            high = code[offset + 1] << 8;
+            offset += length;
+            continue;
+        }
+        if (length > 1) {
+            uint32_t index = high | code[offset + 1];
+            // Names, labels and callees are looked up as strings
+            if (index >= record->constantCount || \
+                (instruction != OP_PUSH && constants[index].type != OBJ_VALUE)) {
+                return false;
+            }
+        }
+        // Jumps are relative to the offset of their constant index
+        if (length > 2 && (uint32_t)(code[offset + 2] << 8 | code[offset + 3]) != offset + 1) {
+            return false;
+        }
+        high = 0;
+        offset += length;
+    }
+    return true;
+}
+
+// Checks the sections and every index of one function before it is used
+static bool validFunction(const uint8_t* image, const ImageHeader* header, const ImageFunction* record) {
+    if (!inImage(header, record->codeOffset, record->count, sizeof(uint8_t)) || \
+        !inImage(header, record->linesOffset, record->lineCount, sizeof(LineDelta)) || \
+        !inImage(header, record->constantsOffset, record->constantCount, sizeof(ImageConstant)) || \
+        !inImage(header, record->labelsOffset, record->labelCount, sizeof(ImageLabel)) || \
+        (record->name >= 0 && (uint32_t)record->name >= header->stringCount)) {
+        return false;
+    }
+    const ImageConstant* constants = (const ImageConstant*)(image + record->constantsOffset);
+    for (uint32_t i = 0; i < record->constantCount; i++) {
+        if ((constants[i].type != NUM_VALUE && constants[i].type != OBJ_VALUE) || \
+            (constants[i].type == OBJ_VALUE && (uint32_t)constants[i].value >= header->stringCount)) {
+            return false;
+        }
+    }
+    const ImageLabel* labels = (const ImageLabel*)(image + record->labelsOffset);
+    for (uint32_t i = 0; i < record->labelCount; i++) {
+        if ((uint32_t)labels[i].key >= header->stringCount || (labels[i].type == OBJ_VALUE && \
+            (uint32_t)labels[i].value >= header->functionCount) || (labels[i].type == NUM_VALUE && \
+            (uint32_t)labels[i].value > record->count) || \
+            (labels[i].type != NUM_VALUE && labels[i].type != OBJ_VALUE)) {
+            return false;
+        }
+    }
+    return validCode(image, record);
+}
+
+static bool validStrings(const uint8_t* image, const ImageHeader* header) {
+    const ImageString* records = (const ImageString*)(image + header->stringsOffset);
+    for (uint32_t i = 0; i < header->stringCount; i++) {
+        if (!inImage(header, header->charactersOffset, records[i].offset, 1) || \
+            !inImage(header, header->charactersOffset + records[i].offset, records[i].length + 1, 1)) {
+            return false;
+        }
+    }
+    const uint32_t* data = (const uint32_t*)(image + header->dataOffset);
+    for (uint32_t line = 0; line < header->dataCount; line++) {
+        uint32_t position = (uint32_t)((const uint8_t*)data - image);
+        if (!inImage(header, position, 1, sizeof(uint32_t)) || data[0] >= header->size || \
+            !inImage(header, position, data[0] + 1, sizeof(uint32_t))) {
+            return false;
+        }
+        uint32_t count = *data++;
+        for (uint32_t i = 0; i < count; i++) {
+            if (*data++ >= header->stringCount) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool validImage(const uint8_t* image, size_t size) {
+    const ImageHeader* header = (const ImageHeader*)image;
+    if (size < sizeof(ImageHeader) || memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0) {
+        printf("Error - Not an ABM image.\n");
+        return false;
+    }
+    if (header->version != IMAGE_VERSION) {
+        printf("Error - Image version %u, expected %u.\n", header->version, IMAGE_VERSION);
+        return false;
+    }
+    if (header->size != size || header->functionCount == 0 || \
+        !inImage(header, header->stringsOffset, header->stringCount, sizeof(ImageString)) || \
+        !inImage(header, header->functionsOffset, header->functionCount, sizeof(ImageFunction)) || \
+        !inImage(header, header->dataOffset, header->dataCount, sizeof(uint32_t))) {
+        printf("Error - Image is truncated.\n");
+        return false;
+    }
+    const ImageFunction* functions = (const ImageFunction*)(image + header->functionsOffset);
+    for (uint32_t i = 0; i < header->functionCount; i++) {
+        if (!validFunction(image, header, &functions[i])) {
+            printf("Error - Image is corrupted.\n");
+            return false;
+        }
+    }
+    if (!validStrings(image, header)) {
+        printf("Error - Image is corrupted.\n");
+        return false;
+    }
+    return true;
+}
+
+static void sendDataSegment(int socket_fd, const uint8_t* image, const ImageHeader* header, String** strings) {
+    const uint32_t* data = (const uint32_t*)(image + header->dataOffset);
+    uint32_t names = 0;
+    for (uint32_t line = 0, position = 0; line < header->dataCount; line++) {
+        for (uint32_t i = 1; i <= data[position]; i++) {
+            String* name = strings[data[position + i]];
+            const char* bracket = memchr(name->characters, '[', name->length);
+            names += bracket == NULL ? 1 : atoi(bracket + 1);
+        }
+        position += data[position] + 1;
+    }
+    if (socket_fd >= 0 && names > 0) {
+        reserveData(socket_fd, (int)names);
+    }
+    for (uint32_t line = 0; line < header->dataCount; line++) {
+        uint32_t count = *data++;
+        // Same messages as the compiler
+        DataLine dataLine;
+        initDataLine(&dataLine, socket_fd);
+        for (uint32_t i = 0; i < count; i++) {
+            String* name = strings[*data++];
+            // Names come from the scanner when the image is written, the
+            // compiler already rejected those too long
+            appendDataName(&dataLine, name->characters, name->length);
+        }
+        endDataLine(&dataLine);
+    }
+}
+
+FunctionObject* loadImage(int socket_fd, VM* vm, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Could not open image");
+        return NULL;
+    }
+    struct stat status;
+    if (fstat(fd, &status) < 0 || status.st_size == 0) {
+        perror("Could not read image");
+        close(fd);
+        return NULL;
+    }
+    uint8_t* image = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        perror("Could not map image");
+        return NULL;
+    }
+    const ImageHeader* header = (const ImageHeader*)image;
+    if (!validImage(image, status.st_size)) {
+        munmap(image, status.st_size);
+        return NULL;
+    }
+    vm->image = image;
+    vm->imageSize = status.st_size;
+
+    const ImageString* records = (const ImageString*)(image + header->stringsOffset);
+    String** strings = (String**)reallocate(NULL, 0, sizeof(String*) * header->stringCount);
+    for (uint32_t i = 0; i < header->stringCount; i++) {
+        strings[i] = referenceString(&vm->strings, &vm->heap, \
+            (char*)image + header->charactersOffset + records[i].offset, \
+            records[i].length, records[i].hash);
+    }
+
+    const ImageFunction* functionRecords = (const ImageFunction*)(image + header->functionsOffset);
+    FunctionObject** functions = (FunctionObject**)reallocate(NULL, 0, \
+        sizeof(FunctionObject*) * header->functionCount);
+    for (uint32_t i = 0; i < header->functionCount; i++) {
+        functions[i] = newFunction(vm);
+    }
+    for (uint32_t i = 0; i < header->functionCount; i++) {
+        const ImageFunction* record = &functionRecords[i];
+        FunctionObject* function = functions[i];
+        function->name = record->name < 0 ? NULL : strings[record->name];
+        // Borrowed from the mapping, capacity 0 keeps freeSequence() off them
+        function->sequence.code = image + record->codeOffset;
+        function->sequence.lines = (LineDelta*)(image + record->linesOffset);
+        function->sequence.lineCount = record->lineCount;
+        function->sequence.lineCapacity = 0;
+        function->sequence.count = record->count;
+        function->sequence.capacity = 0;
+
+        const ImageConstant* constants = (const ImageConstant*)(image + record->constantsOffset);
+        for (uint32_t j = 0; j < record->constantCount; j++) {
+            Value value = constants[j].type == OBJ_VALUE ? \
+                objectValue((Object*)strings[constants[j].value]) : \
+                numberValue(constants[j].value);
+            writeValueArray(&function->sequence.constants, value);
+        }
+
+        const ImageLabel* labels = (const ImageLabel*)(image + record->labelsOffset);
+        for (uint32_t j = 0; j < record->labelCount; j++) {
+            Value value = labels[j].type == OBJ_VALUE ? \
+                objectValue((Object*)functions[labels[j].value]) : \
+                numberValue(labels[j].value);
+            tableSetValue(&function->labels, strings[labels[j].key], value);
+        }
+    }
+    sendDataSegment(socket_fd, image, header, strings);
+
+    FunctionObject* main = functions[0];
+    resolveCalls(main);
+    reallocate(strings, sizeof(String*) * header->stringCount, 0);
+    reallocate(functions, sizeof(FunctionObject*) * header->functionCount, 0);
+    return main;
+}
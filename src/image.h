@@ -0,0 +1,131 @@
+#ifndef image_h
+#define image_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "object.h"
+#include "vm.h"
+
+#define IMAGE_MAGIC "ABMC"
+#define IMAGE_VERSION 4
+
+/**
+ * struct ImageHeader - Start of a precompiled .abmc image. All offsets
+ * are in bytes from the start of the file, all sections are 4 byte aligned.
+ * @a: magic -> char[4] : always IMAGE_MAGIC
+ * @b: version -> uint32_t : IMAGE_VERSION of the writer
+ * @c: size -> uint32_t : size of the whole image
+ * @d: stringCount, stringsOffset -> uint32_t : ImageString records
+ * @e: charactersOffset -> uint32_t : NUL terminated characters of all strings
+ * @f: functionCount, functionsOffset -> uint32_t : ImageFunction records,
+ * the first one is main
+ * @g: dataCount, dataOffset -> uint32_t : .int lines of the data segment, each
+ * is a count followed by that many string indices, arrays are "name[size]"
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t stringCount;
+    uint32_t stringsOffset;
+    uint32_t charactersOffset;
+    uint32_t functionCount;
+    uint32_t functionsOffset;
+    uint32_t dataCount;
+    uint32_t dataOffset;
+} ImageHeader;
+
+/**
+ * struct ImageString - An interned string, referenced everywhere by index
+ * @a: offset -> uint32_t : position of the characters in the characters section
+ * @b: length -> uint32_t : number of characters
+ * @c: hash -> uint32_t : hash of the characters, so loading does not rehash
+ */
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+} ImageString;
+
+/**
+ * struct ImageConstant - A constant of a sequence
+ * @a: type -> int32_t : NUM_VALUE or OBJ_VALUE
+ * @b: value -> int32_t : the number, or the index of the string
+ */
+typedef struct {
+    int32_t type;
+    int32_t value;
+} ImageConstant;
+
+/**
+ * struct ImageLabel - An entry of the labels table of a function
+ * @a: key -> int32_t : index of the label name
+ * @b: type -> int32_t : NUM_VALUE for a jump target, OBJ_VALUE for a function
+ * @c: value -> int32_t : offset of the label, or index of the function
+ */
+typedef struct {
+    int32_t key;
+    int32_t type;
+    int32_t value;
+} ImageLabel;
+
+/**
+ * struct ImageFunction - A compiled FunctionObject
+ * @a: name -> int32_t : index of the name, -1 for main
+ * @b: count -> uint32_t : number of bytes of code
+ * @c: codeOffset -> uint32_t : the code, used in place once mapped
+ * @d: lineCount, linesOffset -> uint32_t : LineDelta records, used in place
+ * @e: constantCount, constantsOffset -> uint32_t : ImageConstant records
+ * @f: labelCount, labelsOffset -> uint32_t : ImageLabel records
+ */
+typedef struct {
+    int32_t name;
+    uint32_t count;
+    uint32_t codeOffset;
+    uint32_t lineCount;
+    uint32_t linesOffset;
+    uint32_t constantCount;
+    uint32_t constantsOffset;
+    uint32_t labelCount;
+    uint32_t labelsOffset;
+} ImageFunction;
+
+/**
+ * @brief Returns true if the file at the given path starts with IMAGE_MAGIC.
+ *
+ * @param path
+ * @return true
+ * @return false
+ */
+bool isImage(const char* path);
+
+/**
+ * @brief Writes the compiled main function, every function reachable
+ * through its labels, and the data segment declared in source to an
+ * image at the given path. Returns false if the file could not be written.
+ *
+ * @param path
+ * @param vm
+ * @param function
+ * @param source
+ * @return true
+ * @return false
+ */
+bool writeImage(const char* path, VM* vm, FunctionObject* function, const char* source);
+
+/**
+ * @brief Maps the image at the given path and rebuilds its functions.
+ * Code and lines are used in place, strings are interned in vm->strings
+ * with their characters left in the mapping, which stays mapped until
+ * freeVM(). The data segment is sent to the bus, as compile() does.
+ * Returns main, or NULL if the image is invalid.
+ *
+ * @param socket_fd
+ * @param vm
+ * @param path
+ * @return FunctionObject*
+ */
+FunctionObject* loadImage(int socket_fd, VM* vm, const char* path);
+
+#endif
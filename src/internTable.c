@@ -0,0 +1,144 @@
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internTable.h"
+#include "memmng.h"
+#include "object.h"
+
+// Frozen slot of an array that is being replaced, never a real String*
+#define INTERN_MOVED ((String*)1)
+
+void initInternTable(InternTable* table) {
+    table->array = NULL;
+    table->count = 0;
+    table->resizing = false;
+}
+
+void freeInternTable(InternTable* table) {
+    InternArray* array = table->array;
+    while (array != NULL) {
+        InternArray* retired = array->retired;
+        reallocate(array, sizeof(InternArray) + sizeof(String*) * array->capacity, 0);
+        array = retired;
+    }
+    initInternTable(table);
+}
+
+static bool isEqual(String* key, const char* characters, int length, uint32_t hash) {
+    return key->hash == hash && key->length == length && \
+        memcmp(key->characters, characters, length) == 0;
+}
+
+String* findString(InternTable* table, const char* characters, int length, uint32_t hash) {
+    InternArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+    if (array == NULL) {
+        return NULL;
+    }
+    uint32_t mask = array->capacity - 1;
+    for (int i = 0; i < array->capacity; i++) {
+        String* key = __atomic_load_n(&array->keys[(hash + i) & mask], __ATOMIC_ACQUIRE);
+        // A string added during a resize is only in the new array, the
+        // lookup happened before it was added
+        if (key == NULL || key == INTERN_MOVED) {
+            return NULL;
+        }
+        if (isEqual(key, characters, length, hash)) {
+            return key;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Replaces full with an array of at least twice its capacity that
+ * holds count strings, unless another thread is already doing it, in which
+ * case waits for its new array.
+ *
+ * @param table
+ * @param full
+ * @param count
+ */
+static void growInternTable(InternTable* table, InternArray* full, int count) {
+    if (__atomic_exchange_n(&table->resizing, true, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&table->array, __ATOMIC_ACQUIRE) == full) {
+            sched_yield();
+        }
+        return;
+    }
+    if (__atomic_load_n(&table->array, __ATOMIC_ACQUIRE) != full) {
+        // Grown by the previous resizer
+        __atomic_store_n(&table->resizing, false, __ATOMIC_RELEASE);
+        return;
+    }
+
+    int capacity = full == NULL ? INTERN_TABLE_MIN_CAPACITY : full->capacity * 2;
+    while (capacity * INTERN_TABLE_LOAD_FACTOR < count) {
+        capacity *= 2;
+    }
+    InternArray* array = (InternArray*)reallocate(NULL, 0, sizeof(InternArray) + sizeof(String*) * capacity);
+    if (array == NULL) {
+        perror("Could not grow string table");
+        exit(-1);
+    }
+    array->capacity = capacity;
+    array->retired = full;
+    memset(array->keys, 0, sizeof(String*) * capacity);
+
+    for (int i = 0; full != NULL && i < full->capacity; i++) {
+        String* key = NULL;
+        // Freezing the slot fails if it holds a string, which is then copied
+        if (__atomic_compare_exchange_n(&full->keys[i], &key, INTERN_MOVED, false, \
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        uint32_t index = key->hash & (capacity - 1);
+        while (array->keys[index] != NULL) {
+            index = (index + 1) & (capacity - 1);
+        }
+        array->keys[index] = key;
+    }
+
+    __atomic_store_n(&table->array, array, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->resizing, false, __ATOMIC_RELEASE);
+}
+
+String* internString(InternTable* table, String* string) {
+    for (;;) {
+        InternArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+        if (array == NULL || \
+            __atomic_load_n(&table->count, __ATOMIC_RELAXED) + 1 > array->capacity * INTERN_TABLE_LOAD_FACTOR) {
+            growInternTable(table, array, __atomic_load_n(&table->count, __ATOMIC_RELAXED) + 1);
+            continue;
+        }
+        uint32_t mask = array->capacity - 1;
+        for (int i = 0; i < array->capacity; i++) {
+            String** slot = &array->keys[(string->hash + i) & mask];
+            String* key = NULL;
+            if (__atomic_compare_exchange_n(slot, &key, string, false, \
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_add_fetch(&table->count, 1, __ATOMIC_RELAXED);
+                return string;
+            }
+            if (key == INTERN_MOVED) {
+                break;
+            }
+            if (isEqual(key, string->characters, string->length, string->hash)) {
+                return key;
+            }
+        }
+        // Frozen by a resize, retry in the new array once it is published
+        growInternTable(table, array, __atomic_load_n(&table->count, __ATOMIC_RELAXED) + 1);
+    }
+}
+
+void reserveInternTable(InternTable* table, int count) {
+    for (;;) {
+        InternArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+        if (array != NULL && count <= array->capacity * INTERN_TABLE_LOAD_FACTOR) {
+            return;
+        }
+        growInternTable(table, array, count);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef internTable_h
+#define internTable_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "value.h"
+
+#define INTERN_TABLE_MIN_CAPACITY 64
+#define INTERN_TABLE_LOAD_FACTOR 0.5
+
+/**
+ * struct InternArray - Slots of an InternTable
+ * @a: capacity -> int : number of slots, a power of 2
+ * @b: retired -> InternArray* : the array this one replaced
+ * @c: keys -> String*[] : interned strings by hash, NULL if unused, or
+ * INTERN_MOVED once the slot was frozen by a resize
+ */
+typedef struct InternArray {
+    int capacity;
+    struct InternArray* retired;
+    String* keys[];
+} InternArray;
+
+/**
+ * struct InternTable - Set of interned strings shared by the threads of a
+ * process, e.g. the interpreter and the snoop thread of a core
+ * @a: array -> InternArray* : the current slots
+ * @b: count -> int : number of interned strings
+ * @c: resizing -> bool : set while a thread grows the table
+ *
+ * Description: Lookups take no lock and finish within one pass over the
+ * slots. Strings are added by compare and swap on a NULL slot, so threads
+ * interning the same characters at once agree on one String*. Growing is
+ * done by a single thread: every unused slot of the full array is frozen
+ * with INTERN_MOVED, the strings are copied to a new array, which is then
+ * published. Threads adding to a frozen slot wait for the new array. The
+ * old arrays are kept until freeInternTable(), as readers may still be
+ * walking them.
+ */
+typedef struct {
+    InternArray* array;
+    int count;
+    bool resizing;
+} InternTable;
+
+/**
+ * @brief Initializes an empty table, its slots are allocated on demand.
+ *
+ * @param table
+ */
+void initInternTable(InternTable* table);
+
+/**
+ * @brief Frees the slots of the table, including the retired arrays. No
+ * thread may use the table anymore, the strings themselves belong to a Heap.
+ *
+ * @param table
+ */
+void freeInternTable(InternTable* table);
+
+/**
+ * @brief Returns the interned string with the given characters, or NULL
+ * if there is none. Safe from any thread, never waits.
+ *
+ * @param table
+ * @param characters
+ * @param length
+ * @param hash
+ * @return String*
+ */
+String* findString(InternTable* table, const char* characters, int length, uint32_t hash);
+
+/**
+ * @brief Interns string, unless another thread interned the same characters
+ * first. Returns the String* that is in the table.
+ *
+ * @param table
+ * @param string
+ * @return String*
+ */
+String* internString(InternTable* table, String* string);
+
+/**
+ * @brief Grows the table once so that count strings fit without growing
+ * it again. Does nothing if they already fit.
+ *
+ * @param table
+ * @param count
+ */
+void reserveInternTable(InternTable* table, int count);
+
+#endif
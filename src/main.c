@@ -9,18 +9,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "compiler.h"
+#include "image.h"
 #include "scanner.h"
 #include "socket.h"
+#include "trace.h"
 #include "vm.h"
 
-NameList functionNames;
-
 typedef struct {
     int socket_fd;
     VM* vm;
     char* argv;
+    int status;     // Exit status of the program, set by run()
 } ThreadData;
 
+static pthread_t snoopingThread;
+static int snoopSocket = -1;
+static bool snoopRunning = false;
+
 static char* readFile(const char* filePath) {
     // printf("readFile\n");
     FILE* file = fopen(filePath, "rb");
@@ -51,18 +57,47 @@ static char* readFile(const char* filePath) {
     return source;
 }
 
-static void runFile(int socket_fd, VM* vm, const char* filePath) {
-    char* source = readFile(filePath);
-    getFunctionNames(&functionNames, source);
-    InterpretResult result = interpret(socket_fd, vm, source);
-    free(source);
+// Returns the exit status, main() exits once the trace is closed
+static int runFile(int socket_fd, VM* vm, const char* filePath) {
+    InterpretResult result;
+    if (isImage(filePath)) {
+        // Precompiled, no compilation needed
+        FunctionObject* function = loadImage(socket_fd, vm, filePath);
+        if (function == NULL) {
+            return 1;
+        }
+        result = interpretFunction(socket_fd, vm, function);
+    } else {
+        char* source = readFile(filePath);
+        result = interpret(socket_fd, vm, source);
+        free(source);
+    }
     if (result == INTERPRET_COMPILE_ERROR) {
-        exit(1);
+        return 1;
     }
     if (result == INTERPRET_RUNTIME_ERROR) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compiles the program at filePath into an image at imagePath,
+ * without connecting to the bus.
+ * 
+ * @param filePath 
+ * @param imagePath 
+ */
+static void compileFile(const char* filePath, const char* imagePath) {
+    char* source = readFile(filePath);
+    VM vm;
+    initVM(&vm);
+    FunctionObject* function = compile(-1, &vm, source);
+    if (function == NULL || !writeImage(imagePath, &vm, function, source)) {
         exit(1);
     }
-    
+    free(source);
+    freeVM(&vm);
 }
 
 void* snoop(void* arg) {
@@ -83,11 +118,14 @@ void* snoop(void* arg) {
                 }
                 name[j] = '\0';
                 address = atoi(name);
+                // The bus only invalidates the address a variable is stored at,
+                // which is the address of its line
                 for (i = 0; i < 3; i++) {
                     // pthread_mutex_lock(&data->vm->cache.lineLock[i]);
-                    if (data->vm->cache.entries[i].address == address || \
-                        data->vm->cache.addressData[i][2] == address) {
+                    if (data->vm->cache.entries[i].address == address) {
                         // pthread_mutex_lock(&data->vm->cache.lineLock[i]);
+                        traceRecord(TRACE_SNOOP_INVALIDATE, 0, (uint32_t)address, \
+                            data->vm->cache.states[i], INVALID, TRACE_BY_ADDRESS);
                         data->vm->cache.states[i] = INVALID;
                         // pthread_mutex_unlock(&data->vm->cache.lineLock[i]);
                         break;
@@ -100,11 +138,14 @@ void* snoop(void* arg) {
                     name[j++] = buffer[i++];
                 }
                 name[j] = '\0';
-                key = copyString(&data->vm->strings, data->vm->objects, name, j);
-                for (i = 0; i < 3; i++) {
+                // A name that was never interned is not cached either
+                key = lookupString(&data->vm->strings, name, j);
+                for (i = 0; key != NULL && i < 3; i++) {
                     // pthread_mutex_lock(&data->vm->cache.lineLock[i]);
                     if (data->vm->cache.entries[i].key == key) {
                         // pthread_mutex_lock(&data->vm->cache.lineLock[i]);
+                        traceRecord(TRACE_SNOOP_INVALIDATE, 0, key->hash, \
+                            data->vm->cache.states[i], INVALID, 0);
                         data->vm->cache.states[i] = INVALID;
                         // pthread_mutex_unlock(&data->vm->cache.lineLock[i]);
                         break;
@@ -112,6 +153,26 @@ void* snoop(void* arg) {
                     // pthread_mutex_unlock(&data->vm->cache.lineLock[i]);
                 } 
             }
+        } else if (memcmp(buffer, "3a", 2) == 0) {      // If write back by address, for bulk reads
+            address = atoi(buffer + 3);
+            memset(buffer, '\0', sizeof(buffer));
+            // The line may have been replaced since the bus saw it modified
+            strcpy(buffer, "nfd");
+            for (i = 0; i < 3; i++) {
+                if (data->vm->cache.entries[i].address == address && \
+                    data->vm->cache.states[i] == MODIFIED) {
+                    sprintf(buffer, "%d", asNumber(data->vm->cache.entries[i].value));
+                    __atomic_add_fetch(&data->vm->cycles.transfers, 1, __ATOMIC_RELAXED);
+                    traceRecord(TRACE_SNOOP_WRITE_BACK, 0, (uint32_t)address, \
+                        data->vm->cache.states[i], SHARED, TRACE_BY_ADDRESS);
+                    data->vm->cache.states[i] = SHARED;
+                    break;
+                }
+            }
+            if (write(data->socket_fd, buffer, 1024) <= 0) {
+                perror("Could not write to core");
+                exit(-1);
+            }
         } else if (memcmp(buffer, "3", 1) == 0) {       // If write back
             i = 2, j = 0;
             while (buffer[i] != '\0') {
@@ -120,19 +181,22 @@ void* snoop(void* arg) {
                 j++;
             }
             name[j] = '\0';
-            key = copyString(&data->vm->strings, data->vm->objects, name, j);
-            for (i = 0; i < 3; i++) {
+            key = lookupString(&data->vm->strings, name, j);
+            for (i = 0; key != NULL && i < 3; i++) {
                 // pthread_mutex_lock(&data->vm->cache.lineLock[i]);
                 if (data->vm->cache.entries[i].key == key) {
                     Value value = data->vm->cache.entries[i].value;
                     // pthread_mutex_unlock(&data->vm->cache.lineLock[i]);
                     memset(buffer, '\0', sizeof(buffer));
-                    sprintf(buffer, "%d", value.as.number);
+                    sprintf(buffer, "%d", asNumber(value));
                     if (write(data->socket_fd, buffer, 1024) <= 0) {
                         perror("Could not write to core");
                         exit(-1);
                     }
+                    __atomic_add_fetch(&data->vm->cycles.transfers, 1, __ATOMIC_RELAXED);
                     // pthread_mutex_lock(&data->vm->cache.lineLock[i]);
+                    traceRecord(TRACE_SNOOP_WRITE_BACK, 0, key->hash, \
+                        data->vm->cache.states[i], SHARED, 0);
                     data->vm->cache.states[i] = SHARED;
                     // pthread_mutex_unlock(&data->vm->cache.lineLock[i]);
                     break;
@@ -154,16 +218,76 @@ void* snoop(void* arg) {
         // data->vm->snoopRun = 0;
         // pthread_mutex_unlock(&data->vm->snoopLock);
     }
+    // Stopped by stopSnoop(), no other thread flushes this ring meanwhile
+    flushTrace();
+    return NULL;
+}
+
+/**
+ * @brief Stops the snoop thread and waits for it, so that its trace ring
+ * is flushed before closeTrace(). Its socket is shut down for reading,
+ * which ends the read it waits in. Does nothing if it is not running, or
+ * if called by the snoop thread itself, e.g. when it exits on an error.
+ * 
+ */
+static void stopSnoop() {
+    if (!snoopRunning || pthread_equal(pthread_self(), snoopingThread)) {
+        return;
+    }
+    snoopRunning = false;
+    shutdown(snoopSocket, SHUT_RD);
+    pthread_join(snoopingThread, NULL);
 }
 
 void* run(void* arg) {
     ThreadData* data = (ThreadData*)arg;
-    runFile(data->socket_fd, data->vm, data->argv);
+    data->status = runFile(data->socket_fd, data->vm, data->argv);
     pthread_exit(NULL);
 }
 
 int main(int argc, char* argv[]) {
-    initNameList(&functionNames);
+    const char* path = NULL;
+    const char* imagePath = NULL;
+    bool profile = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            if (!openTrace(argv[++i])) {
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--cycles") == 0) {
+            timingEnabled = true;
+        } else if (strcmp(argv[i], "--cost") == 0 && i + 1 < argc) {
+            if (!parseCostModel(argv[++i])) {
+                printf("Invalid cost model %s\n", argv[i]);
+                exit(1);
+            }
+            timingEnabled = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            constantStats = true;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            optimizeCode = true;
+        } else if (strcmp(argv[i], "--inline") == 0 && i + 1 < argc) {
+            inlineThreshold = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc) {
+            imagePath = argv[++i];
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+
+    if (imagePath != NULL) {
+        if (path == NULL) {
+            printf("Usage: abm --compile image.abmc path\n");
+            exit(1);
+        }
+        compileFile(path, imagePath);
+        return 0;
+    }
 
     // puts("in main");
 
@@ -226,31 +350,42 @@ int main(int argc, char* argv[]) {
     // puts("Connected to bus");
     // Running the program
     VM vm;
+    int status = 0;
     initVM(&vm);
     // puts("After initVM");
-    if (argc == 2) {
-        pthread_t mainThread, snoopingThread;
+    if (path != NULL) {
+        if (profile) {
+            vm.profiler = newProfiler(path);
+        }
+        pthread_t mainThread;
         
         // pthread_mutex_init(&vmcacheLock);
-        char* argvv = malloc(sizeof(char)*strlen(argv[1]));
-        strcpy(argvv, argv[1]);
+        char* argvv = malloc(sizeof(char) * (strlen(path) + 1));
+        strcpy(argvv, path);
         // puts("Copied string");
 
         ThreadData data1 = (ThreadData){.socket_fd = socket_fd, .vm = &vm, .argv = argvv};
         ThreadData data2 = (ThreadData){.socket_fd = snoop_socket_fd, .vm = &vm, .argv = argvv};
 
-        pthread_create(&mainThread, NULL, run, &data1);
-        // puts("Running core");
+        // Registered after openTrace(), so an exit() on an error stops the
+        // snoop thread before closeTrace() flushes its ring
+        atexit(stopSnoop);
+        snoopSocket = snoop_socket_fd;
         pthread_create(&snoopingThread, NULL, snoop, &data2);
+        snoopRunning = true;
         // puts("Running snoop");
+        pthread_create(&mainThread, NULL, run, &data1);
+        // puts("Running core");
 
         pthread_join(mainThread, NULL);
-        pthread_detach(snoopingThread);
+        stopSnoop();
+        status = data1.status;
         free(argvv);
     } else {
-        printf("Usage: abm [path]\n");
+        printf("Usage: abm [--trace file] [--cycles] [--cost name=cycles,...] [--profile] [--stats] [-O] [--inline size] [--compile image.abmc] [path]\n");
     }
+    closeTrace();
     freeVM(&vm);
     close(socket_fd);
-    return 0;
+    return status;
 }
\ No newline at end of file
@@ -14,26 +14,57 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
     return newPointer;
 }
 
+void initHeap(Heap* heap) {
+    heap->blocks = NULL;
+    heap->objects = NULL;
+}
+
+void* heapAllocate(Heap* heap, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    ArenaBlock* block = heap->blocks;
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (ArenaBlock*)reallocate(NULL, 0, sizeof(ArenaBlock) + capacity);
+        if (block == NULL) {
+            perror("Could not allocate objects");
+            exit(-1);
+        }
+        block->used = 0;
+        block->capacity = capacity;
+        block->next = heap->blocks;
+        heap->blocks = block;
+    }
+    void* pointer = block->bytes + block->used;
+    block->used += size;
+    return pointer;
+}
+
 static void freeObject(Object* obj) {
     switch (obj->type) {
         case FUNCTION_OBJECT:
             FunctionObject* function = (FunctionObject*)obj;
             freeSequence(&function->sequence);
-            reallocate(obj, sizeof(FunctionObject), 0);
+            freeTable(&function->labels);
+            reallocate(function->targets, sizeof(FunctionObject*) * function->targetCount, 0);
             break;
         case STRING_OBJECT:
-            String* string = (String*)obj;
-            reallocate(string->characters, sizeof(char) * (string->length + 1), 0);
-            reallocate(obj, sizeof(String), 0);
+            // The characters are in the arena, or in a mapped image
             break;
     }
 }
 
-void freeObjects(Object* objects) {
-    Object* obj = objects;
+void freeHeap(Heap* heap) {
+    Object* obj = heap->objects;
     while (obj != NULL) {
         Object* next = obj->next;
         freeObject(obj);
         obj = next;
     }
+    ArenaBlock* block = heap->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        reallocate(block, sizeof(ArenaBlock) + block->capacity, 0);
+        block = next;
+    }
+    initHeap(heap);
 }
\ No newline at end of file
@@ -6,6 +6,10 @@
 #include "object.h"
 #include "vm.h"
 
+// Objects are bumped out of blocks of this size, larger ones get their own
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 8
+
 /**
  * @brief Using the C standard realloc() function, reallocate the given
  * array to the specified new size. If new size is 0, then free the
@@ -19,12 +23,30 @@
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
 
 /**
- * @brief Frees all Object objects in vm. Traverses through the linked
- * list of objects and depending on the type, frees and resets all
- * members of the object.
+ * @brief Initializes an empty heap, its first block is allocated on demand.
+ * 
+ * @param heap
+ */
+void initHeap(Heap* heap);
+
+/**
+ * @brief Bumps size bytes, aligned for any object, out of the newest block
+ * of heap, starting a new block when it is full. The memory is only
+ * released by freeHeap().
+ * 
+ * @param heap
+ * @param size
+ * @return void*
+ */
+void* heapAllocate(Heap* heap, size_t size);
+
+/**
+ * @brief Frees all objects of heap. Traverses through the linked list of
+ * objects to free what each one owns outside of the arena, e.g. the code
+ * of a function, then releases the arena blocks at once.
  * 
- * @param objects
+ * @param heap
  */
-void freeObjects(Object* objects);
+void freeHeap(Heap* heap);
 
 #endif
\ No newline at end of file
@@ -3,12 +3,15 @@
 #include <sys/socket.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <ctype.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "memoryBus.h"
 #include "socket.h"
+#include "trace.h"
+#include "vector.h"
 
 Bus bus;
 Memory memory;
@@ -32,71 +35,223 @@ void freeBus() {
 
 void initMemory(Memory* memory) {
     initTable(&memory->globals);
-    initTable(&memory->strings);
+    initInternTable(&memory->strings);
     memory->count = 0;
-    memory->capacity = 0;
-    memory->altAddresses = NULL;
-    memory->upperBounds = NULL;
-    memory->lowerBounds = NULL;
-    memory->values = NULL;
-    memory->objects = NULL;
-    memory->state = reallocate(memory->state, 0, 2 * sizeof(State*));
+    memory->chunks = NULL;
+    memory->chunkCount = 0;
+    memory->segments = NULL;
+    memory->segmentCount = 0;
+    memory->segmentCapacity = 0;
+    memory->views = NULL;
+    memory->viewCount = 0;
+    memory->viewCapacity = 0;
+    initHeap(&memory->heap);
 }
 
 void freeMemory(Memory* memory) {
     freeTable(&memory->globals);
-    freeTable(&memory->strings);
-    freeObjects(memory->objects);
-    reallocate(memory->values, sizeof(Value) * memory->capacity, 0);
-    reallocate(memory->altAddresses, sizeof(int) * memory->capacity, 0);
-    reallocate(memory->upperBounds, sizeof(int) * memory->capacity, 0);
-    reallocate(memory->lowerBounds, sizeof(int) * memory->capacity, 0);
-    reallocate(memory->state[0], sizeof(State) * memory->capacity, 0);
-    reallocate(memory->state[1], sizeof(State) * memory->capacity, 0);
-    reallocate(memory->state, sizeof(State) * 2, 0);
+    freeInternTable(&memory->strings);
+    freeHeap(&memory->heap);
+    for (int i = 0; i < memory->chunkCount; i++) {
+        reallocate(memory->chunks[i], sizeof(MemoryChunk), 0);
+    }
+    reallocate(memory->chunks, sizeof(MemoryChunk*) * memory->chunkCount, 0);
+    reallocate(memory->segments, sizeof(Segment) * memory->segmentCapacity, 0);
+    reallocate(memory->views, sizeof(View) * memory->viewCapacity, 0);
+    initMemory(memory);
+}
+
+static int32_t* valueAt(Memory* memory, int address) {
+    return &memory->chunks[address / MEMORY_CHUNK]->values[address % MEMORY_CHUNK];
+}
+
+static int* aliasAt(Memory* memory, int address) {
+    return &memory->chunks[address / MEMORY_CHUNK]->aliases[address % MEMORY_CHUNK];
+}
+
+static String** keyAt(Memory* memory, int address) {
+    return &memory->chunks[address / MEMORY_CHUNK]->keys[address % MEMORY_CHUNK];
+}
+
+/**
+ * @brief Returns the state of the address in the cache of a core.
+ * 
+ * @param memory 
+ * @param core 0 for core 1, 1 for core 2
+ * @param address 
+ * @return State 
+ */
+static State getState(Memory* memory, int core, int address) {
+    uint8_t states = memory->chunks[address / MEMORY_CHUNK]->states[address % MEMORY_CHUNK];
+    return (State)((states >> (4 * core)) & 0xF);
+}
+
+static void setState(Memory* memory, int core, int address, State state) {
+    uint8_t* states = &memory->chunks[address / MEMORY_CHUNK]->states[address % MEMORY_CHUNK];
+    *states = (uint8_t)((*states & ~(0xF << (4 * core))) | (state << (4 * core)));
+}
+
+/**
+ * @brief Adds count chunks after the last one, every address of them is
+ * INVALID in both cores. Only the array of chunk pointers is reallocated.
+ * 
+ * @param memory 
+ * @param count 
+ */
+static void addChunks(Memory* memory, int count) {
+    memory->chunks = (MemoryChunk**)reallocate(memory->chunks, sizeof(MemoryChunk*) * \
+        memory->chunkCount, sizeof(MemoryChunk*) * (memory->chunkCount + count));
+    if (memory->chunks == NULL) {
+        perror("Could not grow memory");
+        exit(-1);
+    }
+    for (int i = 0; i < count; i++) {
+        MemoryChunk* chunk = (MemoryChunk*)reallocate(NULL, 0, sizeof(MemoryChunk));
+        if (chunk == NULL) {
+            perror("Could not grow memory");
+            exit(-1);
+        }
+        memset(chunk->states, 0, sizeof(chunk->states));
+        memory->chunks[memory->chunkCount++] = chunk;
+    }
+}
+
+void reserveMemory(Memory* memory, int count) {
+    int chunkCount = (memory->count + count + MEMORY_CHUNK - 1) / MEMORY_CHUNK;
+    if (chunkCount > memory->chunkCount) {
+        addChunks(memory, chunkCount - memory->chunkCount);
+    }
+    tableReserve(&memory->globals, memory->globals.count + count);
+    reserveInternTable(&memory->strings, memory->strings.count + count);
+}
+
+void setBounds(Memory* memory, int lower, int upper) {
+    Segment* segments = memory->segments;
+    // Segments from first to last - 1 overlap the new one
+    int first = 0;
+    while (first < memory->segmentCount && segments[first].end < lower) {
+        first++;
+    }
+    int last = first;
+    while (last < memory->segmentCount && segments[last].start <= upper) {
+        last++;
+    }
+    // Their addresses outside of the new segment keep their bounds
+    bool hasBefore = first < last && segments[first].start < lower;
+    bool hasAfter = first < last && segments[last - 1].end > upper;
+    Segment before = hasBefore ? segments[first] : (Segment){0};
+    Segment after = hasAfter ? segments[last - 1] : (Segment){0};
+
+    int count = memory->segmentCount - (last - first) + 1 + hasBefore + hasAfter;
+    if (count > memory->segmentCapacity) {
+        int capacity = memory->segmentCapacity < 8 ? 8 : memory->segmentCapacity * 2;
+        capacity = capacity < count ? count : capacity;
+        segments = (Segment*)reallocate(segments, sizeof(Segment) * memory->segmentCapacity, \
+            sizeof(Segment) * capacity);
+        memory->segments = segments;
+        memory->segmentCapacity = capacity;
+    }
+    int index = first;
+    memmove(&segments[first + hasBefore + 1 + hasAfter], &segments[last], \
+        sizeof(Segment) * (memory->segmentCount - last));
+    if (hasBefore) {
+        before.end = lower - 1;
+        segments[index++] = before;
+    }
+    segments[index++] = (Segment){lower, upper, lower, upper};
+    if (hasAfter) {
+        after.start = upper + 1;
+        segments[index++] = after;
+    }
+    memory->segmentCount = count;
+}
+
+void getBounds(Memory* memory, int address, int* lower, int* upper) {
+    // Last segment starting at or before the address
+    int low = 0, high = memory->segmentCount - 1, found = -1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (memory->segments[middle].start <= address) {
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    if (found != -1 && memory->segments[found].end >= address) {
+        *lower = memory->segments[found].lower;
+        *upper = memory->segments[found].upper;
+    } else {
+        *lower = address;
+        *upper = address;
+    }
+}
+
+int canonicalAddress(Memory* memory, int address) {
+    int low = 0, high = memory->viewCount - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (memory->views[middle].alias == address) {
+            return memory->views[middle].canonical;
+        } else if (memory->views[middle].alias < address) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return address;
 }
 
 int setGlobal(Memory* memory, String* key, int firstAddress) {
     int address = memory->count;
     tableSetAddress(&memory->globals, key, &address);
-    // Reallocate arrays to match size of globals
-    if (memory->globals.capacity != memory->capacity) {
-        memory->altAddresses = (int*)reallocate(memory->altAddresses, sizeof(int) * \
-            memory->capacity, sizeof(int) * memory->globals.capacity);
-        memory->upperBounds = (int*)reallocate(memory->upperBounds, sizeof(int) * \
-            memory->capacity, sizeof(int) * memory->globals.capacity);
-        memory->lowerBounds = (int*)reallocate(memory->lowerBounds, sizeof(int) * \
-            memory->capacity, sizeof(int) * memory->globals.capacity);
-        memory->values = (Value*)reallocate(memory->values, sizeof(Value) * \
-            memory->capacity, sizeof(Value) * memory->globals.capacity);
-        for (int i = 0; i < 2; i++) {
-            memory->state[i] = (State*)reallocate(memory->state[i], sizeof(State) * \
-                memory->capacity, sizeof(State) * memory->globals.capacity);
-        }
-        memory->capacity = memory->globals.capacity;
+    if (memory->count == memory->chunkCount * MEMORY_CHUNK) {
+        addChunks(memory, 1);
     }
-    // If is not new entry set address to altAddresses array.
+    *aliasAt(memory, memory->count) = -1;
+    *keyAt(memory, memory->count) = key;
+    // If is not new entry, the new address is a view of the stored one
     if (firstAddress != -1) {
-        memory->altAddresses[address] = memory->count;
-        memory->altAddresses[memory->count] = address;
-        memory->values[memory->count] = memory->values[address];
+        *aliasAt(memory, address) = memory->count;
+        if (memory->viewCount == memory->viewCapacity) {
+            int capacity = memory->viewCapacity < 8 ? 8 : memory->viewCapacity * 2;
+            memory->views = (View*)reallocate(memory->views, sizeof(View) * memory->viewCapacity, \
+                sizeof(View) * capacity);
+            memory->viewCapacity = capacity;
+        }
+        memory->views[memory->viewCount++] = (View){memory->count, address};
     } else {
-        memory->altAddresses[address] = -1;
-        memory->values[memory->count] = (Value){NUM_VALUE, {.number = 0}};
+        *valueAt(memory, memory->count) = 0;
     }
     // printf("memory->count = %d --- address = %d ---- alt \
-    // address = %d\n", memory->count, address, bus.memory->altAddresses[address]);
+    // address = %d\n", memory->count, address, *aliasAt(bus.memory, address));
     memory->count++;
     return memory->count - 1;
 }
 
+int addArray(Memory* memory, String* key, int size) {
+    setGlobal(memory, key, -1);
+    char name[1024];
+    for (int i = 1; i < size; i++) {
+        if (memory->count == memory->chunkCount * MEMORY_CHUNK) {
+            addChunks(memory, 1);
+        }
+        int length = snprintf(name, sizeof(name), "%.*s[%d]", key->length, key->characters, i);
+        *keyAt(memory, memory->count) = copyString(&memory->strings, &memory->heap, name, length);
+        *aliasAt(memory, memory->count) = -1;
+        *valueAt(memory, memory->count) = 0;
+        memory->count++;
+    }
+    return memory->count - 1;
+}
+
 
 
 void invalidate(int socket_fd, Value id) {
     char buffer[1024] = "0 ";
     int i = 0;
-    if (id.type == OBJ_VALUE) {     // Invalidate by name
-        String* name = (String*)id.as.obj;
+    if (isObject(id)) {     // Invalidate by name
+        String* name = (String*)asObject(id);
         for (i = 0; i < name->length && i < 1021; i++) {
             buffer[i + 2] = name->characters[i];
         }
@@ -106,7 +261,7 @@ void invalidate(int socket_fd, Value id) {
         buffer[2] = ' ';
         char temp[64];
         memset(temp, '\0', sizeof(temp));
-        sprintf(temp, "%d", id.as.number);
+        sprintf(temp, "%d", asNumber(id));
         for (i = 0; temp[i] != '\0'; i++) {
             buffer[i + 3] = temp[i];
         }
@@ -121,10 +276,439 @@ void invalidate(int socket_fd, Value id) {
 }
 
 
+/**
+ * @brief Reads exactly size bytes from a core. Returns false once the core
+ * disconnected.
+ * 
+ * @param socket_fd 
+ * @param bytes 
+ * @param size 
+ * @return true 
+ * @return false 
+ */
+static bool readBytes(int socket_fd, void* bytes, size_t size) {
+    // TCP may split what a core wrote at once, e.g. while it streams its
+    // data segment or the values of a bulk write
+    for (size_t done = 0; done < size;) {
+        ssize_t valread = read(socket_fd, (char*)bytes + done, size - done);
+        if (valread <= 0) {
+            return false;
+        }
+        done += valread;
+    }
+    return true;
+}
+
+// Messages are fixed size
+static bool readMessage(int socket_fd, char* buffer) {
+    return readBytes(socket_fd, buffer, 1024);
+}
+
+/**
+ * @brief Gets the value of an address MODIFIED in the cache of a core
+ * back to memory, the core keeps it as SHARED.
+ * 
+ * @param core 0 for core 1, 1 for core 2
+ * @param address 
+ */
+static void fetchModified(int core, int address) {
+    if (!bus.cores[core].inUse || getState(bus.memory, core, address) != MODIFIED) {
+        return;
+    }
+    char buffer[1024] = {0};
+    snprintf(buffer, sizeof(buffer), "3a %d", address);
+    if (write(bus.cores[core].snoopSocket, buffer, 1024) <= 0) {
+        perror("Could not write to core");
+        exit(-1);
+    }
+    if (!readMessage(bus.cores[core].snoopSocket, buffer)) {
+        perror("Could not read from core");
+        exit(-1);
+    }
+    // Not found if the core replaced the line meanwhile
+    if (memcmp(buffer, "nfd", 3) != 0) {
+        *valueAt(bus.memory, address) = atoi(buffer);
+    }
+    traceRecord(TRACE_SNOOP_WRITE_BACK, core + 1, (uint32_t)address, MODIFIED, SHARED, TRACE_BY_ADDRESS);
+    setState(bus.memory, core, address, SHARED);
+}
+
+/**
+ * @brief Returns address if the count addresses from it on are all stored
+ * in one block, -1 otherwise.
+ * 
+ * @param address 
+ * @param count 
+ * @return int 
+ */
+static int checkRange(int address, int count) {
+    int lower, upper;
+    if (address < 0 || count < 1 || count > bus.memory->count - address) {
+        return -1;
+    }
+    getBounds(bus.memory, address, &lower, &upper);
+    return address + count - 1 <= upper ? address : -1;
+}
+
+/**
+ * @brief Returns the first address of the range of a bulk transfer
+ * "<type> <name> <count>" or "<type>a <address> <count>", and sets count.
+ * Returns -1 unless all count addresses are stored in one block.
+ * 
+ * @param buffer 
+ * @param count 
+ * @return int 
+ */
+static int findRange(const char* buffer, int* count) {
+    int address = -1;
+    char name[1024];
+    Value value;
+    *count = 0;
+    if (buffer[1] == 'a') {
+        sscanf(buffer + 3, "%d %d", &address, count);
+    } else if (sscanf(buffer + 2, "%1023s %d", name, count) == 2) {
+        String* key = copyString(&bus.memory->strings, &bus.memory->heap, name, (int)strlen(name));
+        address = tableGetValue(&bus.memory->globals, key, &value);
+    }
+    return checkRange(address, *count);
+}
+
+/**
+ * @brief Returns how many of the count addresses from address on are
+ * stored one after the other in a chunk, and sets stored to where the
+ * first one is stored. An alias is a span of its own.
+ * 
+ * @param memory 
+ * @param address 
+ * @param count 
+ * @param stored 
+ * @return int 
+ */
+static int spanAt(Memory* memory, int address, int count, int* stored) {
+    // First view at or after address
+    int low = 0, high = memory->viewCount;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (memory->views[middle].alias < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < memory->viewCount && memory->views[low].alias == address) {
+        *stored = memory->views[low].canonical;
+        return 1;
+    }
+    *stored = address;
+    int length = MEMORY_CHUNK - address % MEMORY_CHUNK;
+    if (low < memory->viewCount && memory->views[low].alias - address < length) {
+        length = memory->views[low].alias - address;
+    }
+    return length < count ? length : count;
+}
+
+/**
+ * @brief Copies the values of count addresses to values, after getting
+ * those modified in either cache back to memory. The states are otherwise
+ * unchanged as the values do not go to a cache.
+ * 
+ * @param address 
+ * @param count 
+ * @param values 
+ */
+static void gatherRange(int address, int count, int32_t* values) {
+    for (int done = 0; done < count;) {
+        int stored;
+        int length = spanAt(bus.memory, address + done, count - done, &stored);
+        for (int i = stored; i < stored + length; i++) {
+            fetchModified(0, i);
+            fetchModified(1, i);
+        }
+        memcpy(values + done, valueAt(bus.memory, stored), sizeof(int32_t) * length);
+        done += length;
+    }
+}
+
+/**
+ * @brief Copies values to count addresses and invalidates every cached
+ * copy of them. The copies of the core that wrote them are added to
+ * written instead, it invalidates them once it has the reply, so no stale
+ * copy is read in between.
+ * 
+ * @param core 
+ * @param address 
+ * @param count 
+ * @param values 
+ * @param written 
+ */
+static void scatterRange(CoreData* core, int address, int count, const int32_t* values, Written* written) {
+    for (int done = 0; done < count;) {
+        int stored;
+        int length = spanAt(bus.memory, address + done, count - done, &stored);
+        memcpy(valueAt(bus.memory, stored), values + done, sizeof(int32_t) * length);
+        for (int i = stored; i < stored + length; i++) {
+            if (getState(bus.memory, core->coreID - 1, i) != INVALID && written->count != -1) {
+                if (written->count == WRITTEN_CAPACITY) {
+                    written->count = -1;
+                } else {
+                    written->addresses[written->count++] = i;
+                }
+            }
+            for (int other = 0; other < 2; other++) {
+                if (other != core->coreID - 1 && bus.cores[other].inUse && \
+                    getState(bus.memory, other, i) != INVALID) {
+                    invalidate(bus.cores[other].snoopSocket, numberValue(i));
+                    traceRecord(TRACE_SNOOP_INVALIDATE, other + 1, (uint32_t)i, \
+                        getState(bus.memory, other, i), INVALID, TRACE_BY_ADDRESS);
+                }
+                setState(bus.memory, other, i, INVALID);
+            }
+        }
+        done += length;
+    }
+}
+
+/**
+ * @brief Appends the count of written and its addresses to a reply.
+ * 
+ * @param buffer 
+ * @param written 
+ */
+static void appendWritten(char* buffer, const Written* written) {
+    int length = (int)strlen(buffer);
+    length += sprintf(buffer + length, " %d", written->count);
+    for (int i = 0; i < written->count; i++) {
+        length += sprintf(buffer + length, " %d", written->addresses[i]);
+    }
+}
+
+/**
+ * @brief Handles a bulk read: replies "nfd", or the count of values
+ * followed by the values as int32_t.
+ * 
+ * @param core 
+ * @param buffer 
+ */
+static void readRange(CoreData* core, char* buffer) {
+    int count;
+    int address = findRange(buffer, &count);
+    memset(buffer, '\0', 1024);
+    if (address == -1) {
+        traceRecord(TRACE_BULK_READ, core->coreID, 0, INVALID, INVALID, TRACE_NOT_FOUND);
+        strcpy(buffer, "nfd");
+        if (write(core->socket, buffer, 1024) <= 0) {
+            perror("Could not write to core");
+            exit(-1);
+        }
+        return;
+    }
+    traceRecord(TRACE_BULK_READ, core->coreID, (uint32_t)address, INVALID, INVALID, TRACE_BY_ADDRESS);
+    int32_t* values = (int32_t*)reallocate(NULL, 0, sizeof(int32_t) * count);
+    gatherRange(address, count, values);
+    sprintf(buffer, "%d", count);
+    if (write(core->socket, buffer, 1024) <= 0 || \
+        write(core->socket, values, sizeof(int32_t) * count) <= 0) {
+        perror("Could not write to core");
+        exit(-1);
+    }
+    reallocate(values, sizeof(int32_t) * count, 0);
+}
+
+/**
+ * @brief Handles a bulk write, whose values follow the message as int32_t,
+ * and replies "ok", the first address and the copies of the core that
+ * were written, or "nfd" if nothing was written.
+ * 
+ * @param core 
+ * @param buffer 
+ */
+static void writeRange(CoreData* core, char* buffer) {
+    int count;
+    int address = findRange(buffer, &count);
+    // The values follow even if the range is not valid
+    int sent = count > 0 ? count : 0;
+    int32_t* values = (int32_t*)reallocate(NULL, 0, sizeof(int32_t) * sent);
+    if (!readBytes(core->socket, values, sizeof(int32_t) * sent)) {
+        perror("Could not read from core");
+        exit(-1);
+    }
+    memset(buffer, '\0', 1024);
+    if (address == -1) {
+        traceRecord(TRACE_BULK_WRITE, core->coreID, 0, INVALID, INVALID, TRACE_NOT_FOUND);
+        reallocate(values, sizeof(int32_t) * sent, 0);
+        strcpy(buffer, "nfd");
+        if (write(core->socket, buffer, 1024) <= 0) {
+            perror("Could not write to core");
+            exit(-1);
+        }
+        return;
+    }
+    traceRecord(TRACE_BULK_WRITE, core->coreID, (uint32_t)address, INVALID, INVALID, TRACE_BY_ADDRESS);
+    Written written = {0};
+    scatterRange(core, address, count, values, &written);
+    reallocate(values, sizeof(int32_t) * count, 0);
+    sprintf(buffer, "ok %d", address);
+    appendWritten(buffer, &written);
+    if (write(core->socket, buffer, 1024) <= 0) {
+        perror("Could not write to core");
+        exit(-1);
+    }
+}
+
+/**
+ * @brief Returns the first address of a range of count addresses given by
+ * an operand of a vector instruction, a name or an address, which are told
+ * apart by the first character. Returns -1 unless they are all stored in
+ * one block.
+ * 
+ * @param operand 
+ * @param count 
+ * @return int 
+ */
+static int findOperand(const char* operand, int count) {
+    Value value;
+    if (isdigit((unsigned char)operand[0])) {
+        return checkRange(atoi(operand), count);
+    }
+    String* key = copyString(&bus.memory->strings, &bus.memory->heap, operand, (int)strlen(operand));
+    return checkRange(tableGetValue(&bus.memory->globals, key, &value), count);
+}
+
+/**
+ * @brief Handles a vector instruction "6 <kind> <count> <operands>":
+ * "add", "sub" and "mul" of the ranges a and b into destination, "fill"
+ * of destination with a value, "copy" of source to destination, or "sum"
+ * of source. The sources are read whole before destination is written, so
+ * the ranges may overlap. Replies "ok" and the sum, or the first address
+ * of destination followed by the copies of the core that were written, or
+ * "nfd" if a range is not within one block.
+ * 
+ * @param core 
+ * @param buffer 
+ */
+static void vectorOp(CoreData* core, char* buffer) {
+    char kind[16] = {0}, operands[3][1024];
+    int addresses[3], count = 0;
+    int read = sscanf(buffer + 2, "%15s %d %1023s %1023s %1023s", kind, &count, \
+        operands[0], operands[1], operands[2]);
+    bool isSum = strcmp(kind, "sum") == 0, isFill = strcmp(kind, "fill") == 0;
+    bool isCopy = strcmp(kind, "copy") == 0;
+    bool isArithmetic = strcmp(kind, "add") == 0 || strcmp(kind, "sub") == 0 || strcmp(kind, "mul") == 0;
+    int operandCount = isSum ? 1 : (isFill || isCopy) ? 2 : 3;
+    bool found = (isSum || isFill || isCopy || isArithmetic) && read == operandCount + 2;
+    // The second operand of fill is the value
+    for (int i = 0; found && i < (isFill ? 1 : operandCount); i++) {
+        addresses[i] = findOperand(operands[i], count);
+        found = addresses[i] != -1;
+    }
+    memset(buffer, '\0', 1024);
+    if (!found) {
+        traceRecord(TRACE_VECTOR, core->coreID, 0, INVALID, INVALID, TRACE_NOT_FOUND);
+        strcpy(buffer, "nfd");
+        if (write(core->socket, buffer, 1024) <= 0) {
+            perror("Could not write to core");
+            exit(-1);
+        }
+        return;
+    }
+    traceRecord(TRACE_VECTOR, core->coreID, (uint32_t)addresses[0], INVALID, INVALID, TRACE_BY_ADDRESS);
+
+    int32_t* values = (int32_t*)reallocate(NULL, 0, sizeof(int32_t) * count);
+    int result = addresses[0];
+    if (isSum) {
+        gatherRange(addresses[0], count, values);
+        result = vectorSum(values, count);
+    } else if (isFill) {
+        vectorFill(values, atoi(operands[1]), count);
+    } else if (isCopy) {
+        gatherRange(addresses[1], count, values);
+    } else {
+        int32_t* others = (int32_t*)reallocate(NULL, 0, sizeof(int32_t) * count);
+        gatherRange(addresses[1], count, values);
+        gatherRange(addresses[2], count, others);
+        if (kind[0] == 'a') {
+            vectorAdd(values, values, others, count);
+        } else if (kind[0] == 's') {
+            vectorSubtract(values, values, others, count);
+        } else {
+            vectorMultiply(values, values, others, count);
+        }
+        reallocate(others, sizeof(int32_t) * count, 0);
+    }
+    Written written = {0};
+    if (!isSum) {
+        scatterRange(core, addresses[0], count, values, &written);
+    }
+    reallocate(values, sizeof(int32_t) * count, 0);
+    sprintf(buffer, "ok %d", result);
+    if (!isSum) {
+        appendWritten(buffer, &written);
+    }
+    if (write(core->socket, buffer, 1024) <= 0) {
+        perror("Could not write to core");
+        exit(-1);
+    }
+}
+
+/**
+ * @brief Handles an atomic instruction "7 <kind> <target> <arguments>" on
+ * one variable, a name or an address: "add" of a delta, "cas" of an
+ * expected value and a new one, or "xchg" with a new value. The value is
+ * read and written while the bus is held, so no other request comes in
+ * between. Replies "ok", the address, the value before and the copies of
+ * the core that were written, or "nfd".
+ * 
+ * @param core 
+ * @param buffer 
+ */
+static void atomicOp(CoreData* core, char* buffer) {
+    char kind[16] = {0}, target[1024];
+    int arguments[2] = {0, 0}, address = -1;
+    int read = sscanf(buffer + 2, "%15s %1023s %d %d", kind, target, &arguments[0], &arguments[1]);
+    bool isAdd = strcmp(kind, "add") == 0, isCompare = strcmp(kind, "cas") == 0;
+    bool isExchange = strcmp(kind, "xchg") == 0;
+    if (((isAdd || isExchange) && read == 3) || (isCompare && read == 4)) {
+        address = findOperand(target, 1);
+    }
+    memset(buffer, '\0', 1024);
+    if (address == -1) {
+        traceRecord(TRACE_ATOMIC, core->coreID, 0, INVALID, INVALID, TRACE_NOT_FOUND);
+        strcpy(buffer, "nfd");
+        if (write(core->socket, buffer, 1024) <= 0) {
+            perror("Could not write to core");
+            exit(-1);
+        }
+        return;
+    }
+    traceRecord(TRACE_ATOMIC, core->coreID, (uint32_t)address, INVALID, INVALID, TRACE_BY_ADDRESS);
+
+    int32_t previous, value;
+    gatherRange(address, 1, &previous);
+    if (isAdd) {
+        value = (int32_t)((uint32_t)previous + (uint32_t)arguments[0]);
+    } else if (isCompare) {
+        value = previous == arguments[0] ? arguments[1] : previous;
+    } else {
+        value = arguments[0];
+    }
+    // A failed compare writes nothing, so the cached copies stay valid
+    Written written = {0};
+    if (!isCompare || previous == arguments[0]) {
+        scatterRange(core, address, 1, &value, &written);
+    }
+    sprintf(buffer, "ok %d %d", address, previous);
+    appendWritten(buffer, &written);
+    if (write(core->socket, buffer, 1024) <= 0) {
+        perror("Could not write to core");
+        exit(-1);
+    }
+}
+
 /**
  * @brief Handles all requests coming in from a core
  * Requests could be: 0-Invalidate, 1-Bus_Read, 2-Bus_Read_X, 3-Write_Back,
- * add-Add to memory
+ * 4-Bulk_Read, 5-Bulk_Write, 6-Vector, 7-Atomic, rsv-Reserve memory for the names that follow, add-Add to memory,
+ * adc-Add to memory, continued by the next message
  * 
  * @param arg 
  * @return void* 
@@ -133,15 +717,20 @@ void* handleCore(void* arg) {
     CoreData* core = (CoreData*)arg;
     core->inUse = true;
     char buffer[1024], tempBuffer[1024];
-    int valread, i, j, dataCount, lastAddress, address, prevAddress = -1;
+    int i, j, dataCount, lastAddress, address, lower, upper, prevAddress = -1;
+    bool continued = false;
     char name[1024] = {0};
     String *key, *prevKey;
     Value value;
 
     // printf("Handling core %d\n", core->coreID);
-    while ((valread = read(core->socket, buffer, 1024)) > 0) {
+    while (readMessage(core->socket, buffer)) {
         // printf("Core %d sent: %s\n", core->coreID, buffer);
-        pthread_mutex_lock(&bus.lock);
+        // The lock is kept from an "adc" message until the end of its block,
+        // so the other core cannot add its names in between
+        if (!continued) {
+            pthread_mutex_lock(&bus.lock);
+        }
         // puts("Bus acquired lock");
         // printf("Core %d sent: %s\n", core->coreID, buffer);
 
@@ -154,46 +743,65 @@ void* handleCore(void* arg) {
 
         // for (int i = 0; i < memory.count; i++) {
         //     printf("memory->count = %d --- address = %d ---- alt address = %d ---- state1: %d ---- state2: %d\n", \
-        //             i, 0 , bus.memory->altAddresses[i], bus.memory->state[0][i], bus.memory->state[1][i]);
+        //             i, 0 , *aliasAt(bus.memory, i), getState(bus.memory, 0, i), getState(bus.memory, 1, i));
         // }
-        i = 0, j = 0, dataCount = 0;
-        // If adding from data segment
-        if (memcmp(buffer, "add", 3) == 0) {
+        i = 0, j = 0;
+        // The names of an "adc" message and the next one form a single block
+        if (!continued) {
+            dataCount = 0;
+        }
+        continued = memcmp(buffer, "adc", 3) == 0;
+        if (memcmp(buffer, "rsv", 3) == 0) {
+            reserveMemory(bus.memory, atoi(buffer + 4));
+        } else if (continued || memcmp(buffer, "add", 3) == 0) {    // If adding from data segment
             // printf("Core %d adds\n", core->coreID);
             i = 4;
             // To read variable names
             while (buffer[i] != '\0') {
                 // Do for each variable name read
                 if (buffer[i] == ' ') {
-                    key = copyString(&bus.memory->strings, bus.memory->objects, name, j);
+                    // An array is sent as name[size]
+                    char* bracket = memchr(name, '[', j);
+                    int size = bracket == NULL ? 1 : atoi(bracket + 1);
+                    key = copyString(&bus.memory->strings, &bus.memory->heap, name, \
+                        bracket == NULL ? j : (int)(bracket - name));
                     address = tableGetValue(&bus.memory->globals, key, &value);
                     // If new entry
                     if (address == -1) {
+                        getBounds(bus.memory, prevAddress, &lower, &upper);
                         // If previous entry was defined in another program, we need to modify the data count and bounds if two sequential programs use interlapping data segments
                         if (prevAddress != -1 && prevAddress != memory.count - 1 && \
-                                memory.upperBounds[prevAddress] == prevAddress) {
+                                upper == prevAddress) {
                             // puts("IIIIIIIIIIIIIIIIIIIIIIIII");
                             setGlobal(bus.memory, prevKey, prevAddress);
                             if(bus.cores[2 - core->coreID].inUse) {
-                                invalidate(bus.cores[2 - core->coreID].snoopSocket, (Value){OBJ_VALUE, {.number = prevAddress}});
+                                invalidate(bus.cores[2 - core->coreID].snoopSocket, numberValue(prevAddress));
                             }
                             dataCount++;
                             // So that we don't keep adding the previous key on each iteration
                             prevAddress = -1;   
                         } else if (prevAddress != -1 && prevAddress == memory.count - 1 && \
-                                    memory.upperBounds[prevAddress] == prevAddress) {
+                                    upper == prevAddress) {
                             // puts("HHHHHHHHHHHHHHHHHHHHHHHHH");
                             if(bus.cores[2 - core->coreID].inUse) {
-                                invalidate(bus.cores[2 - core->coreID].snoopSocket, (Value){OBJ_VALUE, {.number = prevAddress}});
+                                invalidate(bus.cores[2 - core->coreID].snoopSocket, numberValue(prevAddress));
                             }
                             dataCount += prevAddress + 1;
                             // So that we don't keep adding the previous key on each iteration
                             prevAddress = -1;
                         }
-                        lastAddress = setGlobal(bus.memory, key, -1);
-                        dataCount++;
+                        if (bracket == NULL) {
+                            lastAddress = setGlobal(bus.memory, key, -1);
+                        } else {
+                            lastAddress = addArray(bus.memory, key, size);
+                        }
+                        dataCount += size;
+                    } else if (bracket != NULL) {   // Array already defined
+                        // Used where it is stored, its elements are never aliases
+                        prevAddress = -1;
                     } else {                // Entry already defined
-                        if (address < memory.upperBounds[address] && prevAddress == -1 && dataCount > 0) {
+                        getBounds(bus.memory, address, &lower, &upper);
+                        if (address < upper && prevAddress == -1 && dataCount > 0) {
                             // puts("EEEEEEEEEEEEEEEEEEEEEEEEEE");
                             lastAddress = setGlobal(bus.memory, key, address);
                             dataCount++;
@@ -208,14 +816,13 @@ void* handleCore(void* arg) {
                 i++;
             }
 
-            for(int i = lastAddress - (dataCount - 1); i <= lastAddress; i++) {
-                bus.memory->upperBounds[i] = lastAddress;
-                bus.memory->lowerBounds[i] = lastAddress - (dataCount - 1);
+            if (dataCount > 0 && !continued) {
+                setBounds(bus.memory, lastAddress - (dataCount - 1), lastAddress);
             }
             
             // for (int i = 0; i < memory.count; i++) {
             //     printf("memory->count = %d --- address = %d ---- alt address = %d\n", 
-            //             i, 0 , bus.memory->altAddresses[i]);
+            //             i, 0 , *aliasAt(bus.memory, i));
             // }
             // printf("Core %d added\n", core->coreID);
     
@@ -232,11 +839,8 @@ void* handleCore(void* arg) {
                 }
                 // sprintf(temp, "%d", address);
                 address = atoi(temp);
-                key = tableGetKey(&bus.memory->globals, address);
-                if (key == NULL) {
-                    address = bus.memory->altAddresses[address];
-                    key = tableGetKey(&bus.memory->globals, address);
-                }
+                address = canonicalAddress(bus.memory, address);
+                key = *keyAt(bus.memory, address);
             } else {                                    // if by name
                 i = 2, j = 0;
                 while (buffer[i] != '\0') {
@@ -245,14 +849,18 @@ void* handleCore(void* arg) {
                     j++;
                 }
                 name[j] = '\0';
-                key = copyString(&bus.memory->strings, bus.memory->objects, name, j);
+                key = copyString(&bus.memory->strings, &bus.memory->heap, name, j);
                 address = tableGetValue(&bus.memory->globals, key, &value);
             }
-            bus.memory->state[core->coreID - 1][address] = MODIFIED;
+            traceRecord(TRACE_INVALIDATE, core->coreID, (uint32_t)address, \
+                getState(bus.memory, core->coreID - 1, address), MODIFIED, TRACE_BY_ADDRESS);
+            setState(bus.memory, core->coreID - 1, address, MODIFIED);
             memset(buffer, '\0', sizeof(buffer));
             if (bus.cores[2 - core->coreID].inUse) {
-                invalidate(bus.cores[2 - core->coreID].snoopSocket, (Value){OBJ_VALUE, {.obj = (Object*)key}});
-                bus.memory->state[2 - core->coreID][address] = INVALID;
+                invalidate(bus.cores[2 - core->coreID].snoopSocket, objectValue((Object*)key));
+                traceRecord(TRACE_SNOOP_INVALIDATE, 3 - core->coreID, (uint32_t)address, \
+                    getState(bus.memory, 2 - core->coreID, address), INVALID, TRACE_BY_ADDRESS);
+                setState(bus.memory, 2 - core->coreID, address, INVALID);
             }
             // printf("Core %d invalidate ends\n", core->coreID);
         } else if (memcmp(buffer, "1", 1) == 0) {
@@ -269,11 +877,8 @@ void* handleCore(void* arg) {
                 }
                 // sprintf(address, "%d", temp);
                 address = atoi(temp);
-                key = tableGetKey(&bus.memory->globals, address);
-                if (key == NULL) {
-                    address = bus.memory->altAddresses[address];
-                    key = tableGetKey(&bus.memory->globals, address);
-                }
+                address = canonicalAddress(bus.memory, address);
+                key = *keyAt(bus.memory, address);
                 // puts("Got key");
                 memset(buffer, '\0', sizeof(buffer));
                 for (int i = 0; i < key->length; i++) {
@@ -293,7 +898,7 @@ void* handleCore(void* arg) {
                     j++; 
                 }
                 name[j] = '\0';
-                key = copyString(&bus.memory->strings, bus.memory->objects, name, j);
+                key = copyString(&bus.memory->strings, &bus.memory->heap, name, j);
                 address = tableGetValue(&bus.memory->globals, key, &value);
             }
             // puts("Got key/address");
@@ -302,6 +907,7 @@ void* handleCore(void* arg) {
             // If not defined in memory
             if (address == -1) {
                 // puts("Not found");
+                traceRecord(TRACE_BUS_READ, core->coreID, 0, INVALID, INVALID, TRACE_NOT_FOUND);
                 if (write(core->socket, "nfd", 4) <= 0) {
                     perror("Could not write to core");
                     exit(-1);
@@ -310,11 +916,18 @@ void* handleCore(void* arg) {
                 // puts("Found");
                 // Set state to shared on processor
                 // If INVALID set to shared because PrRd was received, else no change
-                if (bus.memory->state[core->coreID - 1][address] == INVALID) {
-                    bus.memory->state[core->coreID - 1][address] = SHARED;
+                traceRecord(TRACE_BUS_READ, core->coreID, (uint32_t)address, \
+                    getState(bus.memory, core->coreID - 1, address), \
+                    getState(bus.memory, core->coreID - 1, address) == INVALID ? SHARED : \
+                    getState(bus.memory, core->coreID - 1, address), TRACE_BY_ADDRESS);
+                if (getState(bus.memory, core->coreID - 1, address) == INVALID) {
+                    setState(bus.memory, core->coreID - 1, address, SHARED);
                 }
                 // If other processor is in modified state and running, write back and change to shared
-                if (bus.cores[2 - core->coreID].inUse && bus.memory->state[2 - core->coreID][address] == MODIFIED) {
+                bool suppliesData;
+                State otherState = snoopTransition(getState(bus.memory, 2 - core->coreID, address), \
+                    BUS_READ, &suppliesData);
+                if (bus.cores[2 - core->coreID].inUse && suppliesData) {
                     memset(tempBuffer, '\0', sizeof(tempBuffer));
                     tempBuffer[0] = '3', tempBuffer[1] = ' ';
                     for (i = 0; i < key->length && i < 1021; i++) {
@@ -333,8 +946,10 @@ void* handleCore(void* arg) {
                         exit(-1);
                     }
                     // printf("Read %s from core\n", tempBuffer);
-                    bus.memory->values[address] = (Value){NUM_VALUE, {.number = atoi(tempBuffer)}};
-                    bus.memory->state[2 - core->coreID][address] = SHARED;
+                    *valueAt(bus.memory, address) = atoi(tempBuffer);
+                    traceRecord(TRACE_SNOOP_WRITE_BACK, 3 - core->coreID, (uint32_t)address, \
+                        MODIFIED, otherState, TRACE_BY_ADDRESS);
+                    setState(bus.memory, 2 - core->coreID, address, otherState);
                 }
                 char temp[64]; 
                 // Add address to temp
@@ -347,16 +962,17 @@ void* handleCore(void* arg) {
                 buffer[j++] = ' ';
                 // Add value to temp
                 memset(temp, '\0', sizeof(temp));
-                value = bus.memory->values[address];
-                sprintf(temp, "%d", value.as.number);
+                value = numberValue(*valueAt(bus.memory, address));
+                sprintf(temp, "%d", asNumber(value));
                 i = 0;
                 while (temp[i] != '\0') {
                     buffer[j++] = temp[i++];
                 }
                 buffer[j++] = ' ';
+                getBounds(bus.memory, address, &lower, &upper);
                 // Add upper bound to buffer
                 memset(temp, '\0', sizeof(temp));
-                sprintf(temp, "%d", bus.memory->upperBounds[address]);
+                sprintf(temp, "%d", upper);
                 i = 0;
                 while (temp[i] != '\0') {
                     buffer[j++] = temp[i++];
@@ -364,7 +980,7 @@ void* handleCore(void* arg) {
                 buffer[j++] = ' ';
                 // Add lower bound to buffer
                 memset(temp, '\0', sizeof(temp));
-                sprintf(temp, "%d", bus.memory->lowerBounds[address]);
+                sprintf(temp, "%d", lower);
                 i = 0;
                 while (temp[i] != '\0') {
                     buffer[j++] = temp[i++];
@@ -372,17 +988,18 @@ void* handleCore(void* arg) {
                 buffer[j++] = ' ';
                 // Add alternative address to buffer
                 memset(temp, '\0', sizeof(temp));
-                sprintf(temp, "%d", bus.memory->altAddresses[address]);
+                sprintf(temp, "%d", *aliasAt(bus.memory, address));
                 i = 0;
                 while (temp[i] != '\0') {
                     buffer[j++] = temp[i++];
                 }
                 // If another address exists for this location
-                if (bus.memory->altAddresses[address] != -1) {
+                if (*aliasAt(bus.memory, address) != -1) {
                     buffer[j++] = ' ';
+                    getBounds(bus.memory, *aliasAt(bus.memory, address), &lower, &upper);
                     // Add upper bound of the other address
                     memset(temp, '\0', sizeof(temp));
-                    sprintf(temp, "%d", bus.memory->upperBounds[bus.memory->altAddresses[address]]);
+                    sprintf(temp, "%d", upper);
                     i = 0;
                     while (temp[i] != '\0') {
                         buffer[j++] = temp[i++];
@@ -390,7 +1007,7 @@ void* handleCore(void* arg) {
                     buffer[j++] = ' ';
                     // Add lower bound of the other address
                     memset(temp, '\0', sizeof(temp));
-                    sprintf(temp, "%d", bus.memory->lowerBounds[bus.memory->altAddresses[address]]);
+                    sprintf(temp, "%d", lower);
                     i = 0;
                     while (temp[i] != '\0') {
                         buffer[j++] = temp[i++];
@@ -398,6 +1015,7 @@ void* handleCore(void* arg) {
                 }
                 // puts("Sent back");
                 buffer[j] = '\0';
+                buffer[REPLY_SUPPLIED] = bus.cores[2 - core->coreID].inUse && suppliesData;
                 if (write(core->socket, buffer, 1024) <= 0) {
                     perror("Could not write to core");
                     exit(-1);
@@ -418,11 +1036,8 @@ void* handleCore(void* arg) {
                 }
                 // sprintf(address, "%d", temp);
                 address = atoi(temp);
-                key = tableGetKey(&bus.memory->globals, address);
-                if (key == NULL) {
-                    address = bus.memory->altAddresses[address];
-                    key = tableGetKey(&bus.memory->globals, address);
-                }
+                address = canonicalAddress(bus.memory, address);
+                key = *keyAt(bus.memory, address);
                 memset(buffer, '\0', sizeof(buffer));
                 for (int i = 0; i < key->length; i++) {
                     buffer[i] = key->characters[i];
@@ -440,26 +1055,32 @@ void* handleCore(void* arg) {
                     j++; 
                 }
                 name[j] = '\0';
-                key = copyString(&bus.memory->strings, bus.memory->objects, name, j);
+                key = copyString(&bus.memory->strings, &bus.memory->heap, name, j);
                 address = tableGetValue(&bus.memory->globals, key, &value);
             }
             // Clean buffer
             memset(buffer, '\0', sizeof(buffer));
             // If not defined in memory
             if (address == -1) {
+                traceRecord(TRACE_BUS_READ_X, core->coreID, 0, INVALID, INVALID, TRACE_NOT_FOUND);
                 if (write(core->socket, "nfd", 4) <= 0) {
                     perror("Could not write to core");
                     exit(-1);
                 }
             } else {       // If variable was found
                 // Set state to modified on processor if not already
-                if (bus.memory->state[core->coreID - 1][address] != MODIFIED) {
-                    bus.memory->state[core->coreID - 1][address] = MODIFIED;
+                traceRecord(TRACE_BUS_READ_X, core->coreID, (uint32_t)address, \
+                    getState(bus.memory, core->coreID - 1, address), MODIFIED, TRACE_BY_ADDRESS);
+                if (getState(bus.memory, core->coreID - 1, address) != MODIFIED) {
+                    setState(bus.memory, core->coreID - 1, address, MODIFIED);
                 }
                 // If other processor line is not invalid
-                if (bus.cores[2 - core->coreID].inUse && bus.memory->state[2 - core->coreID][address] != INVALID) {
+                bool suppliesData;
+                State otherState = snoopTransition(getState(bus.memory, 2 - core->coreID, address), \
+                    BUS_READ_X, &suppliesData);
+                if (bus.cores[2 - core->coreID].inUse && getState(bus.memory, 2 - core->coreID, address) != INVALID) {
                     memset(tempBuffer, '\0', sizeof(tempBuffer));
-                    if (bus.memory->state[2 - core->coreID][address] == MODIFIED) {  // Write-back for modified 
+                    if (suppliesData) {  // Write-back for modified 
                         tempBuffer[0] = '3', tempBuffer[1] = ' ';
                         for (i = 0; i < key->length && i < 1021; i++) {
                             tempBuffer[i + 2] = key->characters[i];
@@ -478,7 +1099,9 @@ void* handleCore(void* arg) {
                             exit(-1);
                         }
                         // printf("Read %s from core\n", tempBuffer);
-                        bus.memory->values[address] = (Value){NUM_VALUE, {.number = atoi(tempBuffer)}};
+                        *valueAt(bus.memory, address) = atoi(tempBuffer);
+                        traceRecord(TRACE_SNOOP_WRITE_BACK, 3 - core->coreID, (uint32_t)address, \
+                            MODIFIED, SHARED, TRACE_BY_ADDRESS);
                     } 
                     // Invalidate for shared -- always send for BusReadX
                     memset(tempBuffer, '\0', sizeof(tempBuffer));
@@ -492,7 +1115,9 @@ void* handleCore(void* arg) {
                         exit(-1);
                     }
                     // puts(tempBuffer);
-                    bus.memory->state[2 - core->coreID][address] = INVALID;
+                    traceRecord(TRACE_SNOOP_INVALIDATE, 3 - core->coreID, (uint32_t)address, \
+                        getState(bus.memory, 2 - core->coreID, address), otherState, TRACE_BY_ADDRESS);
+                    setState(bus.memory, 2 - core->coreID, address, otherState);
                 }
                 char temp[64]; 
                 // Add address to temp
@@ -505,16 +1130,17 @@ void* handleCore(void* arg) {
                 buffer[j++] = ' ';
                 // Add value to temp
                 memset(temp, '\0', sizeof(temp));
-                value = bus.memory->values[address];
-                sprintf(temp, "%d", value.as.number);
+                value = numberValue(*valueAt(bus.memory, address));
+                sprintf(temp, "%d", asNumber(value));
                 i = 0;
                 while (temp[i] != '\0') {
                     buffer[j++] = temp[i++];
                 }
                 buffer[j++] = ' ';
+                getBounds(bus.memory, address, &lower, &upper);
                 // Add upper bound to buffer
                 memset(temp, '\0', sizeof(temp));
-                sprintf(temp, "%d", bus.memory->upperBounds[address]);
+                sprintf(temp, "%d", upper);
                 i = 0;
                 while (temp[i] != '\0') {
                     buffer[j++] = temp[i++];
@@ -522,7 +1148,7 @@ void* handleCore(void* arg) {
                 buffer[j++] = ' ';
                 // Add lower bound to buffer
                 memset(temp, '\0', sizeof(temp));
-                sprintf(temp, "%d", bus.memory->lowerBounds[address]);
+                sprintf(temp, "%d", lower);
                 i = 0;
                 while (temp[i] != '\0') {
                     buffer[j++] = temp[i++];
@@ -530,17 +1156,18 @@ void* handleCore(void* arg) {
                 buffer[j++] = ' ';
                 // Add alternative address to buffer
                 memset(temp, '\0', sizeof(temp));
-                sprintf(temp, "%d", bus.memory->altAddresses[address]);
+                sprintf(temp, "%d", *aliasAt(bus.memory, address));
                 i = 0;
                 while (temp[i] != '\0') {
                     buffer[j++] = temp[i++];
                 }
                 // If another address exists for this location
-                if (bus.memory->altAddresses[address] != -1) {
+                if (*aliasAt(bus.memory, address) != -1) {
                     buffer[j++] = ' ';
+                    getBounds(bus.memory, *aliasAt(bus.memory, address), &lower, &upper);
                     // Add upper bound of the other address
                     memset(temp, '\0', sizeof(temp));
-                    sprintf(temp, "%d", bus.memory->upperBounds[bus.memory->altAddresses[address]]);
+                    sprintf(temp, "%d", upper);
                     i = 0;
                     while (temp[i] != '\0') {
                         buffer[j++] = temp[i++];
@@ -548,13 +1175,14 @@ void* handleCore(void* arg) {
                     buffer[j++] = ' ';
                     // Add lower bound of the other address
                     memset(temp, '\0', sizeof(temp));
-                    sprintf(temp, "%d", bus.memory->lowerBounds[bus.memory->altAddresses[address]]);
+                    sprintf(temp, "%d", lower);
                     i = 0;
                     while (temp[i] != '\0') {
                         buffer[j++] = temp[i++];
                     }
                 }
                 buffer[j] = '\0';
+                buffer[REPLY_SUPPLIED] = bus.cores[2 - core->coreID].inUse && suppliesData;
                 if (write(core->socket, buffer, 1024) <= 0) {
                     perror("Could not write to core");
                     exit(-1);
@@ -562,6 +1190,14 @@ void* handleCore(void* arg) {
                 // puts(buffer);
                 // printf("Core %d read X end\n", core->coreID);
             }
+        } else if (memcmp(buffer, "4", 1) == 0) {
+            readRange(core, buffer);
+        } else if (memcmp(buffer, "5", 1) == 0) {
+            writeRange(core, buffer);
+        } else if (memcmp(buffer, "6", 1) == 0) {
+            vectorOp(core, buffer);
+        } else if (memcmp(buffer, "7", 1) == 0) {
+            atomicOp(core, buffer);
         } else if (memcmp(buffer, "3", 1) == 0) {
             // printf("Core %d writes back\n", core->coreID);
             i = 2, j = 0;
@@ -577,18 +1213,16 @@ void* handleCore(void* arg) {
             }
             temp[j] = '\0';
             int val = atoi(temp);
-            bus.memory->values[address] = (Value){NUM_VALUE, {.number = val}};
+            address = canonicalAddress(bus.memory, address);
+            traceRecord(TRACE_WRITE_BACK, core->coreID, (uint32_t)address, \
+                getState(bus.memory, core->coreID - 1, address), INVALID, TRACE_BY_ADDRESS);
+            *valueAt(bus.memory, address) = val;
             // Invalidate for both processors
-            if (bus.cores[2 - core->coreID].inUse && bus.memory->state[2-core->coreID] != INVALID) {
-                invalidate(bus.cores[2 - core->coreID].snoopSocket, (Value){NUM_VALUE, {.number = address}});
-            }
-            bus.memory->state[core->coreID - 1][address] = INVALID;
-            bus.memory->state[2 - core->coreID][address] = INVALID;
-            if (bus.memory->altAddresses[address] != -1) {
-                bus.memory->values[bus.memory->altAddresses[address]] = (Value){NUM_VALUE, {.number = val}};
-                bus.memory->state[core->coreID - 1][bus.memory->altAddresses[address]] = INVALID;
-                bus.memory->state[2 - core->coreID][bus.memory->altAddresses[address]] = INVALID;
+            if (bus.cores[2 - core->coreID].inUse) {
+                invalidate(bus.cores[2 - core->coreID].snoopSocket, numberValue(address));
             }
+            setState(bus.memory, core->coreID - 1, address, INVALID);
+            setState(bus.memory, 2 - core->coreID, address, INVALID);
             // printf("Core %d write back ends\n", core->coreID);
         } else if(memcmp(buffer, "ret", 3) == 0) {
             // printf("Bus released lock %d\n", core->coreID);
@@ -599,7 +1233,9 @@ void* handleCore(void* arg) {
             exit(-1);
         }
         // printf("Bus released lock %d\n", core->coreID);
-        pthread_mutex_unlock(&bus.lock);
+        if (!continued) {
+            pthread_mutex_unlock(&bus.lock);
+        }
         
         // pthread_mutex_lock(&bus.lock[2 - core->coreID]);
         // bus.running[2 - core->coreID] = 1;
@@ -607,6 +1243,10 @@ void* handleCore(void* arg) {
         // pthread_mutex_unlock(&bus.lock[2 - core->coreID]);
     }
     // pthread_mutex_unlock(&bus.lock[0]);
+    if (continued) {    // Disconnected in the middle of a block
+        pthread_mutex_unlock(&bus.lock);
+    }
+    flushTrace();
     core->inUse = false;
     close(core->socket);
     // pthread_exit(NULL);
@@ -615,7 +1255,15 @@ void* handleCore(void* arg) {
     return NULL;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--trace") == 0) {
+        if (!openTrace(argv[2])) {
+            exit(1);
+        }
+    } else if (argc != 1) {
+        printf("Usage: bus [--trace file]\n");
+        exit(1);
+    }
     initBus();
     
     // Setting up the socket to listen for cores
@@ -625,6 +1273,13 @@ int main() {
         exit(-1);
     }
     
+    // So that a restarted bus can bind while old connections are in TIME_WAIT
+    int reuse = 1;
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+        perror("Socket option error");
+        exit(-1);
+    }
+
     struct sockaddr_in saddr;
     // To clear contents of saddr
     memset(&saddr, 0, sizeof(saddr));
@@ -2,34 +2,86 @@
 #define memoryBus_h
 
 #include <pthread.h>
+#include <stdint.h>
 
 #include "memmng.h"
 #include "symbolTable.h"
 #include "vm.h"
 
+// Number of addresses stored in each chunk of the memory
+#define MEMORY_CHUNK 1024
+
+/**
+ * struct Segment - Bounds of the addresses of a block of entries
+ * @a: start, end -> int : first and last address the bounds apply to
+ * @b: lower, upper -> int : beginning and end address of the block
+ *
+ * Description: A block added later may cover some addresses of an
+ * earlier one, whose other addresses keep their bounds. So start and
+ * end are the addresses left to the block, between lower and upper.
+ */
+typedef struct {
+    int start;
+    int end;
+    int lower;
+    int upper;
+} Segment;
+
+/**
+ * struct View - Address of a variable in a later block that reuses it
+ * @a: alias -> int : the address in the later block
+ * @b: canonical -> int : the address the variable is stored at
+ */
+typedef struct {
+    int alias;
+    int canonical;
+} View;
+
+/**
+ * struct MemoryChunk - Stores MEMORY_CHUNK consecutive addresses
+ * @a: values -> int32_t[] : stores the number stored in each address
+ * @b: aliases -> int[] : latest alias of the variable stored in each
+ * address, -1 if none
+ * @c: keys -> String*[] : name of the variable at each address, "name[i]"
+ * for the elements of an array after the first one
+ * @d: states -> uint8_t[] : state of each address in core 1 in the low
+ * 4 bits, and in core 2 in the high 4 bits
+ */
+typedef struct {
+    int32_t values[MEMORY_CHUNK];
+    int aliases[MEMORY_CHUNK];
+    String* keys[MEMORY_CHUNK];
+    uint8_t states[MEMORY_CHUNK];
+} MemoryChunk;
+
 /**
  * struct Memory - Stores data belonging to the memory
- * @a: capacity -> int : stores the current memory capacity
- * @b: count -> int : stores the number of variables in memory
- * @c: altAddresses -> int* : stores an alternative address of an entry
- * @d: upperBounds -> int* : stores the end address of the block of entries
- * @e: lowerBounds -> int* : stores the beginning address of the block of entries
- * @f: values -> Value* : stores the Value stored in the address (index)
- * @g: globals -> Table : stores memory's variable
- * @h: strings -> Table : used for String interning
- * @i: objects -> Object* : stores linked list of all objects used in memory
+ * @a: count -> int : stores the number of variables in memory
+ * @b: chunks, chunkCount -> MemoryChunk**, int : storage of the addresses,
+ * a chunk is added whenever count reaches the end of the last one
+ * @c: segments, segmentCount, segmentCapacity -> Segment*, int, int :
+ * bounds of the blocks of entries, sorted by address and not overlapping
+ * @d: views, viewCount, viewCapacity -> View*, int, int : the alias
+ * addresses, sorted as they are added in increasing order. The value and
+ * states of an alias are those of its canonical address
+ * @e: globals -> Table : stores memory's variable, only the first element
+ * of an array has an entry
+ * @f: strings -> InternTable : used for String interning
+ * @g: heap -> Heap : owner of all strings used in memory
  */
 typedef struct {
-    int capacity;
     int count;
-    int* altAddresses;
-    int* upperBounds;
-    int* lowerBounds;
-    State** state;
-    Value* values;
+    MemoryChunk** chunks;
+    int chunkCount;
+    Segment* segments;
+    int segmentCount;
+    int segmentCapacity;
+    View* views;
+    int viewCount;
+    int viewCapacity;
     Table globals;
-    Table strings;
-    Object* objects;
+    InternTable strings;
+    Heap heap;
 } Memory;
 
 /**
@@ -55,6 +107,23 @@ typedef struct {
     pthread_mutex_t lock;
 } Bus;
 
+// Most addresses a reply to a write can list
+#define WRITTEN_CAPACITY 64
+
+/**
+ * struct Written - Addresses changed by a bulk write, a vector or an atomic
+ * instruction that the core which sent it holds a copy of, listed at the
+ * end of the reply for the core to invalidate them
+ * @a: count -> int : number of addresses, -1 if there were more than
+ * WRITTEN_CAPACITY, for which the core invalidates its whole cache
+ * @b: addresses -> int[] : addresses the changed values are stored at,
+ * which are those of the cache lines even if they were written by alias
+ */
+typedef struct {
+    int count;
+    int addresses[WRITTEN_CAPACITY];
+} Written;
+
 /**
  * @brief Initializes Bus members
  * 
@@ -82,9 +151,18 @@ void initMemory(Memory* memory);
 void freeMemory(Memory* memory);
 
 /**
- * @brief Adds a new entry to memory, modifying its alternative address
- * if the entry was stored somewhere else also. Returns the new address
- * of the stored entry.
+ * @brief Sizes the chunks, globals and strings of memory at once for count
+ * more entries, so adding them does not grow anything.
+ * 
+ * @param memory 
+ * @param count 
+ */
+void reserveMemory(Memory* memory, int count);
+
+/**
+ * @brief Adds a new entry to memory. If the entry is already stored at
+ * firstAddress, the new address is an alias of it, and nothing is stored
+ * there. Returns the new address of the entry.
  * 
  * @param memory 
  * @param key 
@@ -93,4 +171,46 @@ void freeMemory(Memory* memory);
  */
 int setGlobal(Memory* memory, String* key, int firstAddress);
 
+/**
+ * @brief Adds an array of size elements to memory, all of them 0. The
+ * first element is the entry of key. Returns the address of the last one.
+ * 
+ * @param memory 
+ * @param key 
+ * @param size 
+ * @return int 
+ */
+int addArray(Memory* memory, String* key, int size);
+
+/**
+ * @brief Sets the bounds of the addresses from lower to upper to that
+ * block, over the bounds of any earlier block.
+ * 
+ * @param memory 
+ * @param lower 
+ * @param upper 
+ */
+void setBounds(Memory* memory, int lower, int upper);
+
+/**
+ * @brief Gets the bounds of the block the given address belongs to. An
+ * address outside of every block is a block of its own.
+ * 
+ * @param memory 
+ * @param address 
+ * @param lower 
+ * @param upper 
+ */
+void getBounds(Memory* memory, int address, int* lower, int* upper);
+
+/**
+ * @brief Returns the address the variable at the given address is stored
+ * at, which is the address itself unless it is an alias.
+ * 
+ * @param memory 
+ * @param address 
+ * @return int 
+ */
+int canonicalAddress(Memory* memory, int address);
+
 #endif
\ No newline at end of file
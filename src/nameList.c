@@ -1,5 +1,4 @@
 #include <stddef.h>
-#include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -7,37 +6,56 @@
 #include "nameList.h"
 #include "memmng.h"
 
+#define NAME_LIST_LOAD_FACTOR 0.75
+
 void initNameList(NameList* list) {
     list->capacity = 0;
     list->count = 0;
+    list->names = NULL;
 }
 
-int getNameIndex(NameList* list, const char* name, int length) {
-    for (int i = 0; i < list->count; i++) {
-        if(list->length[i] == length &&
-            memcmp(list->names[i], name, length) == 0) {
-            return i;
-        }
+void freeNameList(NameList* list) {
+    reallocate(list->names, sizeof(String*) * list->capacity, 0);
+    initNameList(list);
+}
+
+static String** findSlot(String** names, int capacity, String* name) {
+    uint32_t index = name->hash & (capacity - 1);
+    while (names[index] != NULL && names[index] != name) {
+        index = (index + 1) & (capacity - 1);
     }
-    return -1;
+    return &names[index];
 }
 
-bool isInNameList(NameList* list, const char* name, int length) {
-    return getNameIndex(list, name, length) != -1;
+bool isInNameList(NameList* list, String* name) {
+    if (list->count == 0) {
+        return false;
+    }
+    return *findSlot(list->names, list->capacity, name) != NULL;
 }
 
-void addName(NameList* list, const char* name, int length) {
-    if (isInNameList(list, name, length)) {
-        return;
+static void adjustCapacity(NameList* list, int capacity) {
+    String** names = (String**)reallocate(NULL, 0, sizeof(String*) * capacity);
+    for (int i = 0; i < capacity; i++) {
+        names[i] = NULL;
+    }
+    for (int i = 0; i < list->capacity; i++) {
+        if (list->names[i] != NULL) {
+            *findSlot(names, capacity, list->names[i]) = list->names[i];
+        }
     }
-    strncpy(list->names[list->count], name, length);
-    list->length[list->count] = length;
-    list->count++;
+    reallocate(list->names, sizeof(String*) * list->capacity, 0);
+    list->names = names;
+    list->capacity = capacity;
 }
 
-void removeName(NameList* list, const char* name, int length) {
-    int index = getNameIndex(list, name, length);
-    if (index != -1) {
-        list->names[index][0] = '\0';
+void addName(NameList* list, String* name) {
+    if (list->count + 1 > list->capacity * NAME_LIST_LOAD_FACTOR) {
+        adjustCapacity(list, list->capacity < 8 ? 8 : list->capacity * 2);
+    }
+    String** slot = findSlot(list->names, list->capacity, name);
+    if (*slot == NULL) {
+        *slot = name;
+        list->count++;
     }
 }
\ No newline at end of file
@@ -1,18 +1,23 @@
 #ifndef nameList_h
 #define nameList_h
 
+#include <stdbool.h>
+
+#include "object.h"
+
 /**
- * struct NameList
- * @a: capacity -> int : stores capacity of list
+ * struct NameList - Open addressing hash set of interned names
+ * @a: capacity -> int : number of slots, 0 or a power of 2
  * @b: count -> int : stores number of elements
- * @c: length -> int[256] : stores length of every string in names
- * @d: names -> char[256][256] : array of strings (names)
+ * @c: names -> String** : the slots, NULL when empty
+ * 
+ * Description: Names are interned in the strings table of the VM, so
+ * they are compared by pointer and hashed with their stored hash.
  */
 typedef struct {
     int capacity;
     int count;
-    int length[256];
-    char names[256][256];
+    String** names;
 } NameList;
 
 /**
@@ -23,42 +28,29 @@ typedef struct {
 void initNameList(NameList* list);
 
 /**
- * @brief Adds a string to the name list if not currently stored
+ * @brief Frees the slots of the list and initializes it again
  * 
  * @param list 
- * @param name 
- * @param length 
  */
-void addName(NameList* list, const char* name, int length);
+void freeNameList(NameList* list);
 
 /**
- * @brief Removes the given name from the list if present
+ * @brief Adds a name to the list if not currently stored, growing
+ * the list as needed
  * 
  * @param list 
  * @param name 
- * @param length 
  */
-void removeName(NameList* list, const char* name, int length);
+void addName(NameList* list, String* name);
 
 /**
- * @brief Checks if the name of the given length is in given list
+ * @brief Checks if the given name is in given list
  * 
  * @param list 
  * @param name 
- * @param length 
  * @return true 
  * @return false 
  */
-bool isInNameList(NameList* list, const char* name, int length);
-
-/**
- * @brief Get the index of name if stored in list, else -1
- * 
- * @param list 
- * @param name 
- * @param length 
- * @return int 
- */
-int getNameIndex(NameList* list, const char* name, int length);
+bool isInNameList(NameList* list, String* name);
 
 #endif
\ No newline at end of file
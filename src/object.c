@@ -6,31 +6,71 @@
 #include "symbolTable.h"
 #include "vm.h"
 
-static Object* allocateObject(Object* objects, size_t size, ObjectType type) {
-    Object* obj = (Object*)reallocate(NULL, 0, size);
+static Object* allocateObject(Heap* heap, size_t size, ObjectType type) {
+    Object* obj = (Object*)heapAllocate(heap, size);
     obj->type = type;
-    obj->next = objects;
-    objects = obj;
+    obj->next = heap->objects;
+    heap->objects = obj;
     return obj;
 }
 
-static String* allocateString(Table* table, Object* objects, char* characters, int length, uint32_t hash) {
-    String* string = (String*)allocateObject(objects, sizeof(String), STRING_OBJECT);
+static String* allocateString(InternTable* table, Heap* heap, char* characters, int length, uint32_t hash) {
+    String* string = (String*)allocateObject(heap, sizeof(String), STRING_OBJECT);
     string->characters = characters;
     string->length = length;
     string->hash = hash;
-    tableSetValue(table, string, (Value){NUM_VALUE, {.number = 0}});
-    return string;
+    // Another thread may have interned the same characters in the meantime
+    return internString(table, string);
 }
 
 FunctionObject* newFunction(VM* vm) {
-    FunctionObject* function = (FunctionObject*)allocateObject(vm->objects, sizeof(FunctionObject), FUNCTION_OBJECT);
+    FunctionObject* function = (FunctionObject*)allocateObject(&vm->heap, sizeof(FunctionObject), FUNCTION_OBJECT);
     function->name = NULL;
     initSequence(&function->sequence);
     initTable(&function->labels);
+    function->targets = NULL;
+    function->targetCount = 0;
     return function;
 }
 
+static void resolveTargets(FunctionObject* main, FunctionObject* function) {
+    Sequence* sequence = &function->sequence;
+    function->targets = (FunctionObject**)reallocate(function->targets, \
+        sizeof(FunctionObject*) * function->targetCount, sizeof(FunctionObject*) * sequence->constants.count);
+    function->targetCount = sequence->constants.count;
+    for (int i = 0; i < function->targetCount; i++) {
+        function->targets[i] = NULL;
+    }
+    int high = 0;
+    for (int offset = 0; offset < sequence->count; offset += instructionLength(sequence->code[offset])) {
+        uint8_t instruction = sequence->code[offset];
+        if (instruction == OP_WIDE) {
+            high = sequence->code[offset + 1] << 8;
+            continue;
+        }
+        if (instruction == OP_CALL || instruction == OP_TAIL_CALL) {
+            int index = high | sequence->code[offset + 1];
+            Value callee;
+            if (tableGetValue(&main->labels, (String*)asObject(sequence->constants.values[index]), &callee) != -1 && \
+                isObjectType(callee, FUNCTION_OBJECT)) {
+                function->targets[index] = (FunctionObject*)asObject(callee);
+            }
+        }
+        high = 0;
+    }
+    // Functions are stored in the labels of the function that declared them
+    for (int i = 0; i < function->labels.capacity; i++) {
+        Entry* entry = &function->labels.entries[i];
+        if (entry->key != NULL && isObjectType(entry->value, FUNCTION_OBJECT)) {
+            resolveTargets(main, (FunctionObject*)asObject(entry->value));
+        }
+    }
+}
+
+void resolveCalls(FunctionObject* main) {
+    resolveTargets(main, main);
+}
+
 /**
  * @brief FNV-1a hashing algorithm, to get a hash value for a passed string.
  * 
@@ -47,14 +87,26 @@ static uint32_t hashString(const char* key, int length) {
     return hash;
 }
 
-String* copyString(Table* table, Object* objects, const char* characters, int length) {
+String* copyString(InternTable* table, Heap* heap, const char* characters, int length) {
     uint32_t hash = hashString(characters, length);
     String* interned = findString(table, characters, length, hash);
     if (interned != NULL) {
         return interned;
     }
-    char* newCharacters = (char*)reallocate(NULL, 0, sizeof(char) * (length + 1));
+    char* newCharacters = (char*)heapAllocate(heap, sizeof(char) * (length + 1));
     memcpy(newCharacters, characters, length);
     newCharacters[length] = '\0';
-    return allocateString(table, objects, newCharacters, length, hash);
+    return allocateString(table, heap, newCharacters, length, hash);
+}
+
+String* lookupString(InternTable* table, const char* characters, int length) {
+    return findString(table, characters, length, hashString(characters, length));
+}
+
+String* referenceString(InternTable* table, Heap* heap, char* characters, int length, uint32_t hash) {
+    String* interned = findString(table, characters, length, hash);
+    if (interned != NULL) {
+        return interned;
+    }
+    return allocateString(table, heap, characters, length, hash);
 }
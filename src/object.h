@@ -2,7 +2,9 @@
 #define object_h
 
 #include <stdbool.h>
+#include <stddef.h>
 
+#include "internTable.h"
 #include "sequence.h"
 #include "symbolTable.h"
 #include "value.h"
@@ -17,7 +19,7 @@ typedef enum {
 /**
  * struct Object - Linked list of objects
  * @a: type -> ObjectType : either FUNCTION_OBJECT or STRING_OBJECT
- * @b: next -> Object* : pointer to the next Object (linked list)
+ * @b: next -> Object* : pointer to the next Object of its Heap (linked list)
  * 
  * Description: The Object struct stores pointers to String structs
  * and FunctionObject structs. An Object pointer can be safely 
@@ -30,6 +32,31 @@ typedef struct Object {
     struct Object* next;
 } Object;
 
+/**
+ * struct ArenaBlock - A block of memory objects are bumped out of
+ * @a: next -> ArenaBlock* : the block filled before this one
+ * @b: used -> size_t : number of bytes handed out
+ * @c: capacity -> size_t : number of bytes in bytes
+ * @d: bytes -> uint8_t[] : the memory itself, allocated with the block
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    uint8_t bytes[];
+} ArenaBlock;
+
+/**
+ * struct Heap - Owner of all objects of a VM, or of the bus memory
+ * @a: blocks -> ArenaBlock* : arena the objects and their characters are
+ * allocated from, newest block first, released together by freeHeap()
+ * @b: objects -> Object* : linked list of every object allocated, newest first
+ */
+typedef struct {
+    ArenaBlock* blocks;
+    Object* objects;
+} Heap;
+
 /**
  * struct String - Representation of a string object
  * @a: obj -> Object : the Object pointing to the String
@@ -49,16 +76,22 @@ typedef struct String {
  * @a: obj -> Object : the Object pointing to the function
  * @b: sequence -> Sequence : the sequence of bytes contained in the function
  * @c: name -> String* : the name of the function
+ * @d: labels -> Table : jump labels, and the functions declared inside
+ * @e: targets -> FunctionObject** : function called through each constant,
+ * NULL if the constant does not name one, set by resolveCalls()
+ * @f: targetCount -> int : size of targets
  */
-typedef struct {
+typedef struct FunctionObject {
     Object obj;
     Sequence sequence;
     String* name;
     Table labels;
+    struct FunctionObject** targets;
+    int targetCount;
 } FunctionObject;
 
 /**
- * @brief Allocates space for a new FunctionObject* and initializes
+ * @brief Allocates a new FunctionObject* in the heap of vm and initializes
  * its members to default values. Returns the new FunctionObject*.
  * 
  * @param vm
@@ -66,21 +99,57 @@ typedef struct {
  */
 FunctionObject* newFunction(VM* vm);
 
+/**
+ * @brief Sets the targets of main and of every function declared in it
+ * to the functions their calls go to. Calls are resolved by name in the
+ * labels of main, so the VM does not look them up on every call.
+ * 
+ * @param main
+ */
+void resolveCalls(FunctionObject* main);
+
 /**
  * @brief Creates a new String* object by copying the given array
- * of characters, under the assumption that it may be needed by the
- * caller.
+ * of characters into heap, under the assumption that it may be needed
+ * by the caller. Returns the interned String* if there already is one.
+ * Several threads may intern in the same table, each with its own heap.
  * 
  * @param table
- * @param objects
+ * @param heap
  * @param characters 
  * @param length 
  * @return String* 
  */
-String* copyString(Table* table, Object* objects, const char* characters, int length);
+String* copyString(InternTable* table, Heap* heap, const char* characters, int length);
+
+/**
+ * @brief Returns the interned String* with the given characters, or NULL
+ * if they were never interned. Allocates nothing, so it is safe from a
+ * thread that does not own the heap of the table, e.g. the snoop thread.
+ * 
+ * @param table 
+ * @param characters 
+ * @param length 
+ * @return String* 
+ */
+String* lookupString(InternTable* table, const char* characters, int length);
+
+/**
+ * @brief Interns a string whose characters are owned elsewhere, e.g. by a
+ * mapped image, without copying or rehashing them. The String* itself
+ * is allocated in heap, its characters are left where they are.
+ * 
+ * @param table 
+ * @param heap
+ * @param characters NUL terminated
+ * @param length 
+ * @param hash 
+ * @return String* 
+ */
+String* referenceString(InternTable* table, Heap* heap, char* characters, int length, uint32_t hash);
 
 static inline bool isObjectType(Value value, ObjectType type) {
-    return value.type == OBJ_VALUE && value.as.obj->type == type;
+    return isObject(value) && asObject(value)->type == type;
 }
 
 #endif
\ No newline at end of file
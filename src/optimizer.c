@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "memmng.h"
+#include "optimizer.h"
+
+/**
+ * Decodes the code of function into instructions, with the jump targets
+ * and labels as instruction indices. Returns the number of instructions,
+ * or -1 if a jump or label cannot be resolved.
+ */
+static int decode(FunctionObject* function, Instruction** instructions, LabelTarget** labels, int* labelCount) {
+    Sequence* sequence = &function->sequence;
+    *instructions = (Instruction*)reallocate(NULL, 0, sizeof(Instruction) * (sequence->count + 1));
+    // Index of the instruction starting at each offset, -1 inside instructions
+    int* indices = (int*)reallocate(NULL, 0, sizeof(int) * (sequence->count + 1));
+    for (int i = 0; i <= sequence->count; i++) {
+        indices[i] = -1;
+    }
+    LineCursor cursor = {0, 0, 0};
+    int count = 0;
+    for (int offset = 0; offset < sequence->count;) {
+        int start = offset, high = 0;
+        if (sequence->code[offset] == OP_WIDE) {
+            high = sequence->code[offset + 1] << 8;
+            offset += 2;
+        }
+        Instruction* instruction = &(*instructions)[count];
+        instruction->opcode = sequence->code[offset];
+        instruction->constant = numberValue(0);
+        if (instructionLength(instruction->opcode) > 1) {
+            instruction->constant = sequence->constants.values[high | sequence->code[offset + 1]];
+        }
+        instruction->line = advanceLine(sequence, &cursor, start);
+        instruction->target = -1;
+        instruction->leader = false;
+        instruction->removed = false;
+        indices[start] = count++;
+        offset += instructionLength(instruction->opcode);
+    }
+    indices[sequence->count] = count;
+
+    bool resolved = true;
+    for (int i = 0; i < count && resolved; i++) {
+        Instruction* instruction = &(*instructions)[i];
+        if (instruction->opcode == OP_JUMP || instruction->opcode == OP_JUMP_IF_FALSE || \
+            instruction->opcode == OP_JUMP_IF_TRUE) {
+            Value label;
+            if (tableGetValue(&function->labels, (String*)asObject(instruction->constant), &label) != -2 || \
+                !isNumber(label) || asNumber(label) < 0 || asNumber(label) > sequence->count || \
+                indices[asNumber(label)] == -1) {
+                resolved = false;
+            } else {
+                instruction->target = indices[asNumber(label)];
+            }
+        }
+    }
+
+    *labelCount = 0;
+    *labels = (LabelTarget*)reallocate(NULL, 0, sizeof(LabelTarget) * function->labels.capacity);
+    for (int i = 0; i < function->labels.capacity && resolved; i++) {
+        Entry* entry = &function->labels.entries[i];
+        // Labels of functions stay as they are
+        if (entry->key == NULL || !isNumber(entry->value)) {
+            continue;
+        }
+        if (asNumber(entry->value) < 0 || asNumber(entry->value) > sequence->count || \
+            indices[asNumber(entry->value)] == -1) {
+            resolved = false;
+        } else {
+            (*labels)[(*labelCount)++] = (LabelTarget){entry->key, indices[asNumber(entry->value)]};
+        }
+    }
+    reallocate(indices, sizeof(int) * (sequence->count + 1), 0);
+    return resolved ? count : -1;
+}
+
+static bool endsBlock(uint8_t opcode) {
+    return opcode == OP_JUMP || opcode == OP_HALT || opcode == OP_RETURN;
+}
+
+static void markLeaders(Instruction* instructions, int count) {
+    for (int i = 0; i < count; i++) {
+        instructions[i].leader = i == 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (instructions[i].target != -1 && instructions[i].target < count) {
+            instructions[instructions[i].target].leader = true;
+        }
+        if (instructions[i].target != -1 || endsBlock(instructions[i].opcode)) {
+            if (i + 1 < count) {
+                instructions[i + 1].leader = true;
+            }
+        }
+    }
+}
+
+// Marks the instructions no path from the first one reaches as removed
+static bool removeUnreachable(Instruction* instructions, int count) {
+    bool* reached = (bool*)reallocate(NULL, 0, sizeof(bool) * count);
+    int* pending = (int*)reallocate(NULL, 0, sizeof(int) * count);
+    memset(reached, 0, sizeof(bool) * count);
+    int pendingCount = 0;
+    if (count > 0) {
+        reached[0] = true;
+        pending[pendingCount++] = 0;
+    }
+    while (pendingCount > 0) {
+        int i = pending[--pendingCount];
+        int next[2] = {-1, -1};
+        if (!endsBlock(instructions[i].opcode)) {
+            next[0] = i + 1;
+        }
+        next[1] = instructions[i].target;
+        for (int j = 0; j < 2; j++) {
+            if (next[j] >= 0 && next[j] < count && !reached[next[j]]) {
+                reached[next[j]] = true;
+                pending[pendingCount++] = next[j];
+            }
+        }
+    }
+    bool changed = false;
+    for (int i = 0; i < count; i++) {
+        if (!reached[i]) {
+            instructions[i].removed = true;
+            changed = true;
+        }
+    }
+    reallocate(reached, sizeof(bool) * count, 0);
+    reallocate(pending, sizeof(int) * count, 0);
+    return changed;
+}
+
+/**
+ * Computes the result of a binary OpCode on two constants the way the VM
+ * does. Returns false if it is not foldable, like a division by zero.
+ */
+static bool foldBinary(uint8_t opcode, int a, int b, int* result) {
+    switch (opcode) {
+        // Wrap around like the VM does on the usual targets
+        case OP_ADD: *result = (int)((unsigned)a + (unsigned)b); return true;
+        case OP_SUBTRACT: *result = (int)((unsigned)a - (unsigned)b); return true;
+        case OP_MULTIPLY: *result = (int)((unsigned)a * (unsigned)b); return true;
+        case OP_DIVIDE:
+        case OP_REMAINDER:
+            if (b == 0 || (a == INT32_MIN && b == -1)) {
+                return false;
+            }
+            *result = opcode == OP_DIVIDE ? a / b : a % b;
+            return true;
+        case OP_AND: *result = a && b; return true;
+        case OP_OR: *result = a || b; return true;
+        case OP_EQUAL: *result = a == b; return true;
+        case OP_NOT_EQUAL: *result = a != b; return true;
+        case OP_LESS: *result = a < b; return true;
+        case OP_LESS_EQUAL: *result = a <= b; return true;
+        case OP_GREATER: *result = a > b; return true;
+        case OP_GREATER_EQUAL: *result = a >= b; return true;
+        default: return false;
+    }
+}
+
+static bool isPushedNumber(Instruction* instruction) {
+    return instruction->opcode == OP_PUSH && isNumber(instruction->constant);
+}
+
+// Peephole rewrites that never look past the start of a basic block
+static bool foldBlocks(Instruction* instructions, int count, OptimizerStats* stats) {
+    bool changed = false;
+    for (int i = 0; i < count; i++) {
+        Instruction* first = &instructions[i];
+        Instruction* second = i + 1 < count && !instructions[i + 1].leader ? &instructions[i + 1] : NULL;
+        Instruction* third = second != NULL && i + 2 < count && !instructions[i + 2].leader ? \
+            &instructions[i + 2] : NULL;
+        int result;
+        if (third != NULL && isPushedNumber(first) && isPushedNumber(second) && \
+            foldBinary(third->opcode, asNumber(first->constant), asNumber(second->constant), &result)) {
+            first->constant = numberValue(result);
+            second->removed = third->removed = true;
+            stats->folded++;
+            i += 2;
+        } else if (second != NULL && isPushedNumber(first) && second->opcode == OP_NOT) {
+            first->constant = numberValue(!asNumber(first->constant));
+            second->removed = true;
+            stats->folded++;
+            i++;
+        } else if (second != NULL && isPushedNumber(first) && \
+            (second->opcode == OP_JUMP_IF_FALSE || second->opcode == OP_JUMP_IF_TRUE)) {
+            bool taken = (asNumber(first->constant) == 0) == (second->opcode == OP_JUMP_IF_FALSE);
+            if (taken) {
+                bool leader = first->leader;
+                *first = *second;
+                first->opcode = OP_JUMP;
+                first->leader = leader;
+            } else {
+                first->removed = true;
+            }
+            second->removed = true;
+            stats->folded++;
+            i++;
+        } else if (second != NULL && (first->opcode == OP_PUSH || first->opcode == OP_COPY) && \
+            second->opcode == OP_POP) {
+            first->removed = second->removed = true;
+            i++;
+        } else if (first->opcode == OP_JUMP && first->target == i + 1) {
+            first->removed = true;
+        } else {
+            continue;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+// Drops removed instructions, moving jumps and labels to the next kept one
+static int compact(Instruction* instructions, int count, LabelTarget* labels, int labelCount) {
+    int* kept = (int*)reallocate(NULL, 0, sizeof(int) * (count + 1));
+    int next = 0;
+    for (int i = 0; i < count; i++) {
+        kept[i] = next;
+        if (!instructions[i].removed) {
+            next++;
+        }
+    }
+    kept[count] = next;
+    next = 0;
+    for (int i = 0; i < count; i++) {
+        if (!instructions[i].removed) {
+            instructions[next] = instructions[i];
+            if (instructions[next].target != -1) {
+                instructions[next].target = kept[instructions[next].target];
+            }
+            next++;
+        }
+    }
+    for (int i = 0; i < labelCount; i++) {
+        labels[i].target = kept[labels[i].target];
+    }
+    reallocate(kept, sizeof(int) * (count + 1), 0);
+    return next;
+}
+
+// Returns false, leaving function as it is, if its constants do not fit
+static bool encode(FunctionObject* function, Instruction* instructions, int count, \
+    LabelTarget* labels, int labelCount) {
+    Sequence sequence;
+    ConstantPool pool;
+    initSequence(&sequence);
+    initConstantPool(&pool);
+    int* offsets = (int*)reallocate(NULL, 0, sizeof(int) * (count + 1));
+    bool fits = true;
+    for (int i = 0; i < count && fits; i++) {
+        offsets[i] = sequence.count;
+        fits = writeInstruction(&sequence, &pool, instructions[i].opcode, instructions[i].constant, \
+            instructions[i].line);
+    }
+    offsets[count] = sequence.count;
+    for (int i = 0; i < labelCount && fits; i++) {
+        tableSetValue(&function->labels, labels[i].name, \
+            numberValue(offsets[labels[i].target]));
+    }
+    reallocate(offsets, sizeof(int) * (count + 1), 0);
+    freeConstantPool(&pool);
+    if (!fits) {
+        freeSequence(&sequence);
+        return false;
+    }
+    freeSequence(&function->sequence);
+    function->sequence = sequence;
+    return true;
+}
+
+void optimizeFunction(FunctionObject* function, OptimizerStats* stats) {
+    Instruction* instructions;
+    LabelTarget* labels;
+    int labelCount;
+    int capacity = function->sequence.count + 1, labelCapacity = function->labels.capacity;
+    int count = decode(function, &instructions, &labels, &labelCount);
+    if (count >= 0) {
+        stats->instructions += count;
+        int original = count;
+        bool changed = true;
+        while (changed) {
+            markLeaders(instructions, count);
+            changed = removeUnreachable(instructions, count);
+            changed = foldBlocks(instructions, count, stats) || changed;
+            count = compact(instructions, count, labels, labelCount);
+        }
+        stats->removed += original - count;
+        encode(function, instructions, count, labels, labelCount);
+    }
+    reallocate(instructions, sizeof(Instruction) * capacity, 0);
+    reallocate(labels, sizeof(LabelTarget) * labelCapacity, 0);
+}
+
+static bool isJump(uint8_t opcode) {
+    return opcode == OP_JUMP || opcode == OP_JUMP_IF_FALSE || opcode == OP_JUMP_IF_TRUE;
+}
+
+static bool isCall(uint8_t opcode) {
+    return opcode == OP_CALL || opcode == OP_TAIL_CALL;
+}
+
+// Whether the opcode goes to memory through a target, which may be a pointer local of the frame
+static bool isTargeted(uint8_t opcode) {
+    return opcode >= OP_LOAD && opcode <= OP_EXCHANGE;
+}
+
+// Returns the function a call instruction goes to, resolved like OP_CALL does
+static int findCallee(DecodedFunction* functions, int count, Instruction* call) {
+    Value callee;
+    if (tableGetValue(&functions[0].function->labels, (String*)asObject(call->constant), &callee) != -2 || \
+        !isObject(callee)) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if ((Object*)functions[i].function == asObject(callee)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Whether the function is a leaf of straight-line code ending in its only return
+static bool isInlinable(DecodedFunction* callee, int threshold) {
+    if (!callee->resolved || callee->function->name == NULL || callee->count < 1 || callee->count - 1 > threshold || \
+        callee->instructions[callee->count - 1].opcode != OP_RETURN) {
+        return false;
+    }
+    for (int i = 0; i < callee->count - 1; i++) {
+        uint8_t opcode = callee->instructions[i].opcode;
+        if (isJump(opcode) || isCall(opcode) || opcode == OP_RETURN || opcode == OP_BEGIN || \
+            opcode == OP_END || opcode == OP_HALT || opcode == OP_ASSIGN_ADDRESS || isTargeted(opcode)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Parts of an inlined call, each naming the locals of its own frame
+typedef enum {
+    PART_ARGUMENTS,     // begin to call: lvalue names the callee
+    PART_BODY,          // the callee: both name the callee
+    PART_RESULTS,       // call to end: rvalue names the callee
+} InlinePart;
+
+static bool namesCallee(InlinePart part, uint8_t opcode, String* name, NameList* globals) {
+    if (isInNameList(globals, name)) {
+        return false;
+    }
+    return part == PART_BODY || (part == PART_ARGUMENTS && opcode == OP_LVALUE) || \
+        (part == PART_RESULTS && opcode == OP_RVALUE);
+}
+
+// An entry of the stack while checking an inlined call
+typedef struct {
+    String* name;       // NULL for a value, otherwise pushed by lvalue
+    InlinePart part;    // part that pushed the name
+} StackEntry;
+
+/**
+ * Interprets the stack effects of the instructions of one part of an
+ * inlined call. Returns false if the renamed locals would behave
+ * differently: a local of the callee read before it is assigned, a name
+ * used as an address, or a name assigned in another part than the one
+ * that pushed it, since each part assigns in a different frame.
+ */
+static bool checkPart(Instruction* instructions, int count, InlinePart part, StackEntry* stack, int* depth, \
+    NameList* globals, NameList* assigned) {
+    StackEntry value = {NULL, part};
+    for (int i = 0; i < count; i++) {
+        Instruction* instruction = &instructions[i];
+        StackEntry a = *depth > 0 ? stack[*depth - 1] : value;
+        StackEntry b = *depth > 1 ? stack[*depth - 2] : value;
+        switch (instruction->opcode) {
+            case OP_LVALUE:
+                stack[(*depth)++] = (StackEntry){(String*)asObject(instruction->constant), part};
+                break;
+            case OP_RVALUE: {
+                String* name = (String*)asObject(instruction->constant);
+                // A new frame starts with every local at 0, the frame of the caller does not
+                if (namesCallee(part, OP_RVALUE, name, globals) && !isInNameList(assigned, name)) {
+                    return false;
+                }
+                stack[(*depth)++] = value;
+                break;
+            }
+            case OP_PUSH:
+                stack[(*depth)++] = value;
+                break;
+            case OP_POP:
+                *depth -= *depth > 0;
+                break;
+            case OP_ASSIGN:
+                if (a.name != NULL || *depth < 2 || b.name == NULL || b.part != part) {
+                    return false;
+                }
+                if (namesCallee(part, OP_LVALUE, b.name, globals)) {
+                    addName(assigned, b.name);
+                }
+                *depth -= 2;
+                break;
+            case OP_PRINT:
+            case OP_SHOW:
+                break;
+            case OP_COPY:
+            case OP_NOT:
+                if (a.name != NULL) {
+                    return false;
+                }
+                *depth -= *depth > 0;
+                stack[(*depth)++] = value;
+                if (instruction->opcode == OP_COPY) {
+                    stack[(*depth)++] = value;
+                }
+                break;
+            default:
+                // Binary operators, which take a name as an address
+                if (a.name != NULL || b.name != NULL) {
+                    return false;
+                }
+                *depth -= *depth > 1 ? 2 : *depth;
+                stack[(*depth)++] = value;
+                break;
+        }
+    }
+    return true;
+}
+
+// Returns "function.name", the name of a local of function once inlined
+static Value renameLocal(VM* vm, FunctionObject* function, Value name) {
+    String* local = (String*)asObject(name);
+    int length = function->name->length + 1 + local->length;
+    char* characters = (char*)reallocate(NULL, 0, length);
+    memcpy(characters, function->name->characters, function->name->length);
+    characters[function->name->length] = '.';
+    memcpy(characters + function->name->length + 1, local->characters, local->length);
+    String* renamed = copyString(&vm->strings, &vm->heap, characters, length);
+    reallocate(characters, length, 0);
+    return objectValue((Object*)renamed);
+}
+
+/**
+ * Finds the call site whose call instruction is at index call in caller.
+ * Sets begin and end to the indices of its begin and end, and returns
+ * false unless the site only holds straight-line code outside of any
+ * other call.
+ */
+static bool findSite(DecodedFunction* caller, int call, int* begin, int* end) {
+    Instruction* instructions = caller->instructions;
+    *begin = *end = -1;
+    for (int i = call - 1; i >= 0 && *begin == -1; i--) {
+        if (instructions[i].opcode == OP_BEGIN) {
+            *begin = i;
+        } else if (isCall(instructions[i].opcode) || instructions[i].opcode == OP_END) {
+            return false;
+        }
+    }
+    for (int i = call + 1; i < caller->count && *end == -1; i++) {
+        if (instructions[i].opcode == OP_END) {
+            *end = i;
+        } else if (instructions[i].opcode == OP_BEGIN || isCall(instructions[i].opcode)) {
+            return false;
+        }
+    }
+    if (*begin == -1 || *end == -1) {
+        return false;
+    }
+    // Inside the results of another call, lvalue and rvalue swap frames
+    for (int i = *begin - 1; i >= 0; i--) {
+        if (isCall(instructions[i].opcode)) {
+            return false;
+        } else if (instructions[i].opcode == OP_END) {
+            break;
+        }
+    }
+    for (int i = *begin; i <= *end; i++) {
+        uint8_t opcode = instructions[i].opcode;
+        if ((i > *begin && instructions[i].leader) || isJump(opcode) || opcode == OP_RETURN || \
+            opcode == OP_HALT || opcode == OP_ASSIGN_ADDRESS || isTargeted(opcode)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Replaces the site from begin to end of caller by the body of callee
+static void inlineSite(VM* vm, DecodedFunction* caller, DecodedFunction* callee, int begin, int call, int end, \
+    NameList* globals) {
+    int bodyCount = callee->count - 1;
+    int count = caller->count - 3 + bodyCount;
+    Instruction* instructions = (Instruction*)reallocate(NULL, 0, sizeof(Instruction) * (count + 1));
+    // New index of each instruction of the caller, or of the next kept one
+    int* moved = (int*)reallocate(NULL, 0, sizeof(int) * (caller->count + 1));
+    int next = 0;
+    for (int i = 0; i <= caller->count; i++) {
+        moved[i] = next;
+        if (i == caller->count || i == begin || i == end) {
+            continue;
+        }
+        if (i == call) {
+            for (int j = 0; j < bodyCount; j++) {
+                Instruction* instruction = &instructions[next++];
+                *instruction = callee->instructions[j];
+                if ((instruction->opcode == OP_LVALUE || instruction->opcode == OP_RVALUE) && \
+                    namesCallee(PART_BODY, instruction->opcode, (String*)asObject(instruction->constant), globals)) {
+                    instruction->constant = renameLocal(vm, callee->function, instruction->constant);
+                }
+            }
+            continue;
+        }
+        Instruction* instruction = &instructions[next++];
+        *instruction = caller->instructions[i];
+        InlinePart part = i < call ? PART_ARGUMENTS : PART_RESULTS;
+        if (i > begin && i < end && (instruction->opcode == OP_LVALUE || instruction->opcode == OP_RVALUE) && \
+            namesCallee(part, instruction->opcode, (String*)asObject(instruction->constant), globals)) {
+            instruction->constant = renameLocal(vm, callee->function, instruction->constant);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (instructions[i].target != -1) {
+            instructions[i].target = moved[instructions[i].target];
+        }
+    }
+    for (int i = 0; i < caller->labelCount; i++) {
+        caller->labels[i].target = moved[caller->labels[i].target];
+    }
+    reallocate(moved, sizeof(int) * (caller->count + 1), 0);
+    reallocate(caller->instructions, sizeof(Instruction) * caller->capacity, 0);
+    caller->instructions = instructions;
+    caller->count = count;
+    caller->capacity = count + 1;
+    caller->inlined++;
+    markLeaders(caller->instructions, caller->count);
+}
+
+// Inlines the first eligible call of caller, returns false if there is none
+static bool inlineFirstCall(VM* vm, DecodedFunction* functions, int count, int index, NameList* globals, \
+    int threshold) {
+    DecodedFunction* caller = &functions[index];
+    for (int call = 0; call < caller->count; call++) {
+        if (caller->instructions[call].opcode != OP_CALL) {
+            continue;
+        }
+        int callee = findCallee(functions, count, &caller->instructions[call]);
+        int begin, end;
+        if (callee == -1 || callee == index || !isInlinable(&functions[callee], threshold) || \
+            !findSite(caller, call, &begin, &end)) {
+            continue;
+        }
+        DecodedFunction* body = &functions[callee];
+        StackEntry* stack = (StackEntry*)reallocate(NULL, 0, sizeof(StackEntry) * (end - begin + body->count));
+        int depth = 0;
+        NameList assigned;
+        initNameList(&assigned);
+        bool safe = checkPart(&caller->instructions[begin + 1], call - begin - 1, PART_ARGUMENTS, stack, &depth, \
+            globals, &assigned) && \
+            checkPart(body->instructions, body->count - 1, PART_BODY, stack, &depth, globals, &assigned) && \
+            checkPart(&caller->instructions[call + 1], end - call - 1, PART_RESULTS, stack, &depth, \
+            globals, &assigned);
+        freeNameList(&assigned);
+        reallocate(stack, sizeof(StackEntry) * (end - begin + body->count), 0);
+        if (safe) {
+            inlineSite(vm, caller, body, begin, call, end, globals);
+            return true;
+        }
+    }
+    return false;
+}
+
+void inlineCalls(VM* vm, FunctionObject** functions, int count, NameList* globals, int threshold, InlineStats* stats) {
+    DecodedFunction* decoded = (DecodedFunction*)reallocate(NULL, 0, sizeof(DecodedFunction) * count);
+    for (int i = 0; i < count; i++) {
+        DecodedFunction* function = &decoded[i];
+        function->function = functions[i];
+        function->capacity = functions[i]->sequence.count + 1;
+        function->labelCapacity = functions[i]->labels.capacity;
+        function->count = decode(functions[i], &function->instructions, &function->labels, &function->labelCount);
+        function->resolved = function->count >= 0;
+        function->inlined = 0;
+        if (!function->resolved) {
+            function->count = 0;
+        }
+        function->original = function->count;
+        markLeaders(function->instructions, function->count);
+        stats->before += function->count;
+    }
+    // Inlining into a function can make it a leaf that can be inlined in turn
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < count; i++) {
+            while (decoded[i].resolved && inlineFirstCall(vm, decoded, count, i, globals, threshold)) {
+                stats->calls++;
+                changed = true;
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        DecodedFunction* function = &decoded[i];
+        if (function->inlined > 0 && !encode(function->function, function->instructions, function->count, \
+            function->labels, function->labelCount)) {
+            stats->calls -= function->inlined;
+            function->count = function->original;
+        }
+        stats->after += function->count;
+        reallocate(function->instructions, sizeof(Instruction) * function->capacity, 0);
+        reallocate(function->labels, sizeof(LabelTarget) * function->labelCapacity, 0);
+    }
+    reallocate(decoded, sizeof(DecodedFunction) * count, 0);
+}
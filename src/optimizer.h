@@ -0,0 +1,120 @@
+#ifndef optimizer_h
+#define optimizer_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nameList.h"
+#include "object.h"
+#include "vm.h"
+
+/**
+ * struct Instruction - A decoded instruction of a function being optimized
+ * @a: opcode -> uint8_t : the OpCode, OP_WIDE prefixes are folded into it
+ * @b: constant -> Value : the operand, if the OpCode takes one
+ * @c: line -> int : line the instruction was compiled from
+ * @d: target -> int : index of the instruction a jump goes to, -1 otherwise
+ * @e: leader -> bool : whether the instruction starts a basic block
+ * @f: removed -> bool : whether the instruction is dropped at the next compaction
+ */
+typedef struct {
+    uint8_t opcode;
+    Value constant;
+    int line;
+    int target;
+    bool leader;
+    bool removed;
+} Instruction;
+
+/**
+ * struct LabelTarget - A jump label of a function being optimized
+ * @a: name -> String* : the label
+ * @b: target -> int : index of the instruction the label is at
+ */
+typedef struct {
+    String* name;
+    int target;
+} LabelTarget;
+
+/**
+ * struct OptimizerStats - Totals reported by -O
+ * @a: instructions -> int : instructions before optimizing
+ * @b: removed -> int : instructions removed
+ * @c: folded -> int : constant expressions and branches folded
+ */
+typedef struct {
+    int instructions;
+    int removed;
+    int folded;
+} OptimizerStats;
+
+/**
+ * struct DecodedFunction - A function decoded for inlining
+ * @a: function -> FunctionObject* : the function
+ * @b: instructions -> Instruction* : its instructions
+ * @c: count, capacity -> int : size of instructions
+ * @d: labels -> LabelTarget* : its jump labels
+ * @e: labelCount, labelCapacity -> int : size of labels
+ * @f: original -> int : number of instructions before inlining
+ * @g: resolved -> bool : whether all jumps and labels could be decoded
+ * @h: inlined -> int : calls inlined into it
+ */
+typedef struct {
+    FunctionObject* function;
+    Instruction* instructions;
+    int count;
+    int capacity;
+    LabelTarget* labels;
+    int labelCount;
+    int labelCapacity;
+    int original;
+    bool resolved;
+    int inlined;
+} DecodedFunction;
+
+/**
+ * struct InlineStats - Totals reported by -O when inlining
+ * @a: calls -> int : call sites replaced by the body of the callee
+ * @b: before, after -> int : instructions of all functions before and after
+ */
+typedef struct {
+    int calls;
+    int before;
+    int after;
+} InlineStats;
+
+/**
+ * @brief Splits the function into basic blocks at its jump targets and
+ * after every goto, halt and return, then until nothing changes: removes
+ * blocks unreachable from the start, folds arithmetic and comparisons of
+ * pushed constants and branches on them, and drops push/pop and copy/pop
+ * pairs and jumps to the next instruction. The code, constants, lines and
+ * jump labels of the function are rewritten. A function with a jump to a
+ * label it does not define is left as is.
+ *
+ * @param function
+ * @param stats totals to add to
+ */
+void optimizeFunction(FunctionObject* function, OptimizerStats* stats);
+
+/**
+ * @brief Replaces begin ... call f ... end sites by the body of f, until
+ * no site is left, when f is a leaf without jumps of at most threshold
+ * instructions besides its final return. The locals of f are renamed to
+ * "f.name" in the frame of the caller, following the begin/end
+ * convention: between begin and call lvalue names the locals of f, and
+ * between call and end rvalue does. Names declared in the data segment
+ * stay global. A site is skipped if a local of f could be read before it
+ * is assigned, since the caller's frame keeps them between calls, or if
+ * :& or address arithmetic uses them.
+ *
+ * @param vm interns the renamed locals
+ * @param functions all compiled functions, main first
+ * @param count
+ * @param globals names of the data segment
+ * @param threshold
+ * @param stats totals to add to
+ */
+void inlineCalls(VM* vm, FunctionObject** functions, int count, NameList* globals, int threshold, InlineStats* stats);
+
+#endif
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memmng.h"
+#include "profiler.h"
+
+#define REPORT_LINES 20
+
+static const char* opcodeNames[] = {
+    [OP_LVALUE] = "lvalue",
+    [OP_RVALUE] = "rvalue",
+    [OP_PUSH] = "push",
+    [OP_POP] = "pop",
+    [OP_ADD] = "+",
+    [OP_SUBTRACT] = "-",
+    [OP_MULTIPLY] = "*",
+    [OP_DIVIDE] = "/",
+    [OP_REMAINDER] = "div",
+    [OP_EQUAL] = "=",
+    [OP_NOT_EQUAL] = "<>",
+    [OP_GREATER] = ">",
+    [OP_LESS] = "<",
+    [OP_LESS_EQUAL] = "<=",
+    [OP_GREATER_EQUAL] = ">=",
+    [OP_AND] = "&",
+    [OP_OR] = "|",
+    [OP_NOT] = "!",
+    [OP_PRINT] = "print",
+    [OP_SHOW] = "show",
+    [OP_COPY] = "copy",
+    [OP_ASSIGN] = ":=",
+    [OP_ASSIGN_ADDRESS] = ":&",
+    [OP_JUMP] = "goto",
+    [OP_JUMP_IF_FALSE] = "gofalse",
+    [OP_JUMP_IF_TRUE] = "gotrue",
+    [OP_CALL] = "call",
+    [OP_RETURN] = "return",
+    [OP_BEGIN] = "begin",
+    [OP_END] = "end",
+    [OP_HALT] = "halt",
+    [OP_WIDE] = "wide",
+    [OP_TAIL_CALL] = "tailcall",
+    [OP_LOAD] = "load",
+    [OP_STORE] = "store",
+    [OP_VECTOR_ADD] = "vadd",
+    [OP_VECTOR_SUBTRACT] = "vsub",
+    [OP_VECTOR_MULTIPLY] = "vmul",
+    [OP_VECTOR_FILL] = "vfill",
+    [OP_VECTOR_COPY] = "vcopy",
+    [OP_VECTOR_SUM] = "vsum",
+    [OP_FETCH_ADD] = "fadd",
+    [OP_COMPARE_SWAP] = "cas",
+    [OP_EXCHANGE] = "xchg",
+};
+
+/**
+ * struct LineProfile - Counts of one source line, built when reporting
+ * @a: line -> int : line number in the source file
+ * @b: executions -> uint64_t : instructions executed on that line
+ * @c: misses -> uint64_t : bus transactions caused by that line
+ */
+typedef struct {
+    int line;
+    uint64_t executions;
+    uint64_t misses;
+} LineProfile;
+
+// Only valid while sorting, qsort() has no context argument
+static uint64_t* sortKeys;
+
+static int compareDescending(const void* a, const void* b) {
+    uint64_t x = sortKeys[*(const int*)a], y = sortKeys[*(const int*)b];
+    if (x != y) {
+        return x < y ? 1 : -1;
+    }
+    return *(const int*)a - *(const int*)b;
+}
+
+static const char* functionName(FunctionObject* function) {
+    return function == NULL || function->name == NULL ? "main" : function->name->characters;
+}
+
+Profiler* newProfiler(const char* sourcePath) {
+    Profiler* profiler = (Profiler*)reallocate(NULL, 0, sizeof(Profiler));
+    memset(profiler, 0, sizeof(Profiler));
+    profiler->stackCapacity = 16;
+    profiler->stacks = (StackNode*)reallocate(NULL, 0, sizeof(StackNode) * profiler->stackCapacity);
+    profiler->stacks[0] = (StackNode){NULL, -1, -1, -1, 0};
+    profiler->stackCount = 1;
+    profiler->currentStack = 0;
+    size_t length = strlen(sourcePath);
+    profiler->foldedPath = (char*)reallocate(NULL, 0, length + sizeof(".folded"));
+    memcpy(profiler->foldedPath, sourcePath, length);
+    memcpy(profiler->foldedPath + length, ".folded", sizeof(".folded"));
+    return profiler;
+}
+
+void freeProfiler(Profiler* profiler) {
+    for (int i = 0; i < profiler->functionCount; i++) {
+        FunctionProfile* profile = &profiler->functions[i];
+        reallocate(profile->executions, sizeof(uint64_t) * profile->count, 0);
+        reallocate(profile->misses, sizeof(uint64_t) * profile->count, 0);
+    }
+    reallocate(profiler->functions, sizeof(FunctionProfile) * profiler->functionCapacity, 0);
+    reallocate(profiler->stacks, sizeof(StackNode) * profiler->stackCapacity, 0);
+    reallocate(profiler->foldedPath, strlen(profiler->foldedPath) + 1, 0);
+    reallocate(profiler, sizeof(Profiler), 0);
+}
+
+FunctionProfile* enterProfile(Profiler* profiler, FunctionObject* function) {
+    for (int i = 0; i < profiler->functionCount; i++) {
+        if (profiler->functions[i].function == function) {
+            profiler->current = &profiler->functions[i];
+            return profiler->current;
+        }
+    }
+    if (profiler->functionCapacity < profiler->functionCount + 1) {
+        int prevCapacity = profiler->functionCapacity;
+        profiler->functionCapacity = prevCapacity < 8 ? 8 : prevCapacity * 2;
+        profiler->functions = (FunctionProfile*)reallocate(profiler->functions, \
+            sizeof(FunctionProfile) * prevCapacity, sizeof(FunctionProfile) * profiler->functionCapacity);
+    }
+    FunctionProfile* profile = &profiler->functions[profiler->functionCount++];
+    profile->function = function;
+    profile->count = function->sequence.count;
+    profile->executions = (uint64_t*)reallocate(NULL, 0, sizeof(uint64_t) * profile->count);
+    profile->misses = (uint64_t*)reallocate(NULL, 0, sizeof(uint64_t) * profile->count);
+    memset(profile->executions, 0, sizeof(uint64_t) * profile->count);
+    memset(profile->misses, 0, sizeof(uint64_t) * profile->count);
+    // main is entered once without a call
+    profile->calls = profiler->functionCount == 1 ? 1 : 0;
+    profiler->current = profile;
+    if (profiler->functionCount == 1) {
+        profiler->stacks[0].function = function;
+    }
+    return profile;
+}
+
+void profileCall(Profiler* profiler, FunctionObject* function) {
+    enterProfile(profiler, function)->calls++;
+    StackNode* parent = &profiler->stacks[profiler->currentStack];
+    for (int child = parent->firstChild; child != -1; child = profiler->stacks[child].nextSibling) {
+        if (profiler->stacks[child].function == function) {
+            profiler->currentStack = child;
+            return;
+        }
+    }
+    if (profiler->stackCapacity < profiler->stackCount + 1) {
+        int prevCapacity = profiler->stackCapacity;
+        profiler->stackCapacity = prevCapacity * 2;
+        profiler->stacks = (StackNode*)reallocate(profiler->stacks, \
+            sizeof(StackNode) * prevCapacity, sizeof(StackNode) * profiler->stackCapacity);
+    }
+    int child = profiler->stackCount++;
+    profiler->stacks[child] = (StackNode){function, profiler->currentStack, -1, \
+        profiler->stacks[profiler->currentStack].firstChild, 0};
+    profiler->stacks[profiler->currentStack].firstChild = child;
+    profiler->currentStack = child;
+}
+
+void profileReturn(Profiler* profiler) {
+    if (profiler->stacks[profiler->currentStack].parent != -1) {
+        profiler->currentStack = profiler->stacks[profiler->currentStack].parent;
+    }
+}
+
+static void reportOpcodes(Profiler* profiler) {
+    int order[256], count = 0;
+    for (int i = 0; i < 256; i++) {
+        if (profiler->opcodes[i] > 0) {
+            order[count++] = i;
+        }
+    }
+    sortKeys = profiler->opcodes;
+    qsort(order, count, sizeof(int), compareDescending);
+    printf("\n%-10s %14s\n", "opcode", "executions");
+    for (int i = 0; i < count; i++) {
+        const char* name = order[i] < (int)(sizeof(opcodeNames) / sizeof(opcodeNames[0])) && \
+            opcodeNames[order[i]] != NULL ? opcodeNames[order[i]] : "?";
+        printf("%-10s %14llu\n", name, (unsigned long long)profiler->opcodes[order[i]]);
+    }
+}
+
+static void reportFunctions(Profiler* profiler) {
+    int count = profiler->functionCount;
+    int* order = (int*)reallocate(NULL, 0, sizeof(int) * count);
+    uint64_t* instructions = (uint64_t*)reallocate(NULL, 0, sizeof(uint64_t) * count);
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+        instructions[i] = 0;
+        for (int j = 0; j < profiler->functions[i].count; j++) {
+            instructions[i] += profiler->functions[i].executions[j];
+        }
+    }
+    sortKeys = instructions;
+    qsort(order, count, sizeof(int), compareDescending);
+    printf("\n%-20s %10s %14s\n", "function", "calls", "instructions");
+    for (int i = 0; i < count; i++) {
+        FunctionProfile* profile = &profiler->functions[order[i]];
+        printf("%-20s %10llu %14llu\n", functionName(profile->function), \
+            (unsigned long long)profile->calls, (unsigned long long)instructions[order[i]]);
+    }
+    reallocate(order, sizeof(int) * count, 0);
+    reallocate(instructions, sizeof(uint64_t) * count, 0);
+}
+
+static void reportLines(Profiler* profiler) {
+    int maxLine = 0;
+    for (int i = 0; i < profiler->functionCount; i++) {
+        Sequence* sequence = &profiler->functions[i].function->sequence;
+        LineCursor cursor = {0, 0, 0};
+        for (int j = 0; j < profiler->functions[i].count; j++) {
+            int line = advanceLine(sequence, &cursor, j);
+            if (line > maxLine) {
+                maxLine = line;
+            }
+        }
+    }
+    LineProfile* lines = (LineProfile*)reallocate(NULL, 0, sizeof(LineProfile) * (maxLine + 1));
+    memset(lines, 0, sizeof(LineProfile) * (maxLine + 1));
+    for (int i = 0; i < profiler->functionCount; i++) {
+        FunctionProfile* profile = &profiler->functions[i];
+        LineCursor cursor = {0, 0, 0};
+        for (int j = 0; j < profile->count; j++) {
+            int line = advanceLine(&profile->function->sequence, &cursor, j);
+            lines[line].line = line;
+            lines[line].executions += profile->executions[j];
+            lines[line].misses += profile->misses[j];
+        }
+    }
+    int* order = (int*)reallocate(NULL, 0, sizeof(int) * (maxLine + 1));
+    uint64_t* executions = (uint64_t*)reallocate(NULL, 0, sizeof(uint64_t) * (maxLine + 1));
+    int count = 0;
+    for (int i = 0; i <= maxLine; i++) {
+        executions[i] = lines[i].executions;
+        if (lines[i].executions > 0) {
+            order[count++] = i;
+        }
+    }
+    sortKeys = executions;
+    qsort(order, count, sizeof(int), compareDescending);
+    printf("\n%-8s %14s %10s\n", "line", "executions", "misses");
+    for (int i = 0; i < count && i < REPORT_LINES; i++) {
+        printf("%-8d %14llu %10llu\n", lines[order[i]].line, \
+            (unsigned long long)lines[order[i]].executions, (unsigned long long)lines[order[i]].misses);
+    }
+    reallocate(lines, sizeof(LineProfile) * (maxLine + 1), 0);
+    reallocate(order, sizeof(int) * (maxLine + 1), 0);
+    reallocate(executions, sizeof(uint64_t) * (maxLine + 1), 0);
+}
+
+static void writeStack(FILE* file, Profiler* profiler, int node) {
+    if (profiler->stacks[node].parent != -1) {
+        writeStack(file, profiler, profiler->stacks[node].parent);
+        fputc(';', file);
+    }
+    fputs(functionName(profiler->stacks[node].function), file);
+}
+
+static void writeFoldedStacks(Profiler* profiler) {
+    FILE* file = fopen(profiler->foldedPath, "w");
+    if (file == NULL) {
+        perror("Could not write folded stacks");
+        return;
+    }
+    for (int i = 0; i < profiler->stackCount; i++) {
+        if (profiler->stacks[i].samples == 0) {
+            continue;
+        }
+        writeStack(file, profiler, i);
+        fprintf(file, " %llu\n", (unsigned long long)profiler->stacks[i].samples);
+    }
+    fclose(file);
+    printf("\nFolded stacks written to %s\n", profiler->foldedPath);
+}
+
+void reportProfile(Profiler* profiler) {
+    reportOpcodes(profiler);
+    reportFunctions(profiler);
+    reportLines(profiler);
+    writeFoldedStacks(profiler);
+}
@@ -0,0 +1,137 @@
+#ifndef profiler_h
+#define profiler_h
+
+#include <stdint.h>
+
+#include "object.h"
+
+/**
+ * struct FunctionProfile - Execution counts of one function
+ * @a: function -> FunctionObject* : the profiled function
+ * @b: count -> int : number of bytecode offsets, equal to sequence.count
+ * @c: executions -> uint64_t* : times the instruction at each offset ran
+ * @d: misses -> uint64_t* : bus transactions caused at each offset
+ * @e: calls -> uint64_t : times the function was called
+ */
+typedef struct {
+    FunctionObject* function;
+    int count;
+    uint64_t* executions;
+    uint64_t* misses;
+    uint64_t calls;
+} FunctionProfile;
+
+/**
+ * struct StackNode - Node of the tree of call stacks seen while running
+ * @a: function -> FunctionObject* : function on top of this stack
+ * @b: parent -> int : index of the calling stack, -1 for main
+ * @c: firstChild -> int : index of the first stack called from this one
+ * @d: nextSibling -> int : index of the next stack with the same parent
+ * @e: samples -> uint64_t : instructions executed with this exact stack
+ */
+typedef struct {
+    FunctionObject* function;
+    int parent;
+    int firstChild;
+    int nextSibling;
+    uint64_t samples;
+} StackNode;
+
+/**
+ * struct Profiler - Collects the data reported by --profile
+ * @a: opcodes -> uint64_t[] : times each OpCode ran
+ * @b: functions -> FunctionProfile* : one profile per executed function
+ * @c: functionCount, functionCapacity -> int : size of functions
+ * @d: current -> FunctionProfile* : profile of the function being executed
+ * @e: offset -> int : offset of the instruction being executed
+ * @f: stacks -> StackNode* : call stack tree, stacks[0] is main
+ * @g: stackCount, stackCapacity -> int : size of stacks
+ * @h: currentStack -> int : index of the active call stack
+ * @i: foldedPath -> char* : file the folded stacks are written to
+ */
+typedef struct {
+    uint64_t opcodes[256];
+    FunctionProfile* functions;
+    int functionCount;
+    int functionCapacity;
+    FunctionProfile* current;
+    int offset;
+    StackNode* stacks;
+    int stackCount;
+    int stackCapacity;
+    int currentStack;
+    char* foldedPath;
+} Profiler;
+
+/**
+ * @brief Allocates a profiler whose folded stacks will be written next to
+ * the given source file, as <sourcePath>.folded
+ *
+ * @param sourcePath
+ * @return Profiler*
+ */
+Profiler* newProfiler(const char* sourcePath);
+
+/**
+ * @brief Frees the profiler and everything it collected
+ *
+ * @param profiler
+ */
+void freeProfiler(Profiler* profiler);
+
+/**
+ * @brief Looks up (or creates) the profile of the given function and makes
+ * it current. Only called when the executing function changes.
+ *
+ * @param profiler
+ * @param function
+ * @return FunctionProfile*
+ */
+FunctionProfile* enterProfile(Profiler* profiler, FunctionObject* function);
+
+/**
+ * @brief Records a call of the given function, descending into the
+ * matching node of the call stack tree.
+ *
+ * @param profiler
+ * @param function
+ */
+void profileCall(Profiler* profiler, FunctionObject* function);
+
+/**
+ * @brief Records a return, moving back to the calling stack.
+ *
+ * @param profiler
+ */
+void profileReturn(Profiler* profiler);
+
+/**
+ * @brief Prints the opcode, function and line reports sorted by count and
+ * writes the folded stacks file.
+ *
+ * @param profiler
+ */
+void reportProfile(Profiler* profiler);
+
+static inline void profileInstruction(Profiler* profiler, FunctionObject* function, \
+    int offset, uint8_t instruction) {
+    FunctionProfile* profile = profiler->current;
+    if (profile == NULL || profile->function != function) {
+        profile = enterProfile(profiler, function);
+    }
+    profiler->opcodes[instruction]++;
+    profiler->offset = offset;
+    if (offset < profile->count) {
+        profile->executions[offset]++;
+    }
+    profiler->stacks[profiler->currentStack].samples++;
+}
+
+static inline void profileMiss(Profiler* profiler) {
+    FunctionProfile* profile = profiler->current;
+    if (profile != NULL && profiler->offset < profile->count) {
+        profile->misses[profiler->offset]++;
+    }
+}
+
+#endif
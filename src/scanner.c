@@ -141,7 +141,7 @@ static TokenType identifierType() {
                                 scanner.isNextIdentifer = true;
                                 return TOKEN_CALL;
                             }
-                    break;
+                        return checkKeyword(2, 1, "s", TOKEN_CAS);
                     case 'o':
                         return checkKeyword(2, 2, "py", TOKEN_COPY);
                 }
@@ -151,6 +151,8 @@ static TokenType identifierType() {
             return checkKeyword(1, 2, "iv", TOKEN_DIV);
         case 'e':
             return checkKeyword(1, 2, "nd", TOKEN_END);
+        case 'f':
+            return checkKeyword(1, 3, "add", TOKEN_FADD);
         case 'g':
             if (scanner.current - scanner.start > 1 && scanner.start[1] == 'o') {
                 if (scanner.current - scanner.start > 2) {
@@ -194,6 +196,8 @@ static TokenType identifierType() {
                                 return TOKEN_LABEL;
                             }
                     break;
+                    case 'o':
+                        return checkKeyword(2, 2, "ad", TOKEN_LOAD);
                     case 'v':
                         return checkKeyword(2, 4, "alue", TOKEN_LVALUE);
                 }
@@ -222,12 +226,37 @@ static TokenType identifierType() {
             }
         break;
         case 's':
+            if (scanner.current - scanner.start == 5 && \
+                memcmp(scanner.start + 1, "tore", 4) == 0) {
+                return TOKEN_STORE;
+            }
             if (scanner.current - scanner.start == 4 && \
                 memcmp(scanner.start + 1, "how", 3) == 0) {
                 scanner.isInShow = true;
                 return TOKEN_SHOW;
             }
         break;
+        case 'v':
+            if (scanner.current - scanner.start > 1) {
+                switch (scanner.start[1]) {
+                    case 'a':
+                        return checkKeyword(2, 2, "dd", TOKEN_VADD);
+                    case 'c':
+                        return checkKeyword(2, 3, "opy", TOKEN_VCOPY);
+                    case 'f':
+                        return checkKeyword(2, 3, "ill", TOKEN_VFILL);
+                    case 'm':
+                        return checkKeyword(2, 2, "ul", TOKEN_VMUL);
+                    case 's':
+                        if (checkKeyword(2, 2, "ub", TOKEN_VSUB) == TOKEN_VSUB) {
+                            return TOKEN_VSUB;
+                        }
+                        return checkKeyword(2, 2, "um", TOKEN_VSUM);
+                }
+            }
+        break;
+        case 'x':
+            return checkKeyword(1, 3, "chg", TOKEN_XCHG);
     }
     return TOKEN_IDENTIFIER;
 }
@@ -240,9 +269,9 @@ static Token makeIdentifier() {
 }
 
 static Token makeNumber() {
-    do {
+    while (isDigit(peek())) {
         advance();
-    } while (isDigit(peek()));
+    }
 
     return makeToken(TOKEN_NUMBER);
 }
@@ -344,6 +373,10 @@ Token scanToken() {
             );
         case '=':
             return makeToken(TOKEN_EQUAL);
+        case '[':
+            return makeToken(TOKEN_LEFT_BRACKET);
+        case ']':
+            return makeToken(TOKEN_RIGHT_BRACKET);
         case ':':
             if (match('=')) {
                 return makeToken(TOKEN_ASSIGN);
@@ -355,52 +388,4 @@ Token scanToken() {
     }
     
     return errorToken("Unexpected character.");
-}
-
-void getFunctionNames(NameList* functionNames, const char* source) {
-    initScanner(source);
-    for (;;) {
-        ignoreWhitespace();
-        scanner.start = scanner.current;
-
-        if (reachedEnd()) {
-            return;
-        }
-
-        char c = advance();
-
-        if (isAlpha(c)) {
-            while(isAlpha(peek()) || isDigit(peek()) || peek() == '_') {
-                advance();
-            }
-
-            switch (c) {
-                case 'c':
-                    if (scanner.current - scanner.start == 4 && \
-                                memcmp(scanner.start + 1, "all", 3) == 0) {
-                        while (peek() == ' ') {
-                            advance();
-                        }
-                        scanner.start = scanner.current;
-                        while (isAlpha(peek()) || isDigit(peek()) || peek() == '_') {
-                            advance();
-                        }
-                        
-                        addName(functionNames, scanner.start, (int)(scanner.current - scanner.start));
-                        
-                    }
-                    break;
-                case 's':
-                    if (scanner.current - scanner.start == 4 && \
-                        memcmp(scanner.start + 1, "how", 3) == 0) {
-                        while (peek() != '\n') {
-                            advance();
-                        }
-                        advance();
-                    }
-                    break;
-            }
-        }
-
-    }
 }
\ No newline at end of file
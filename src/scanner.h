@@ -3,10 +3,6 @@
 
 #include <stdbool.h>
 
-#include "NameList.h"
-
-extern NameList functionNames;
-
 typedef enum {
     TOKEN_PLUS,
     TOKEN_MINUS,
@@ -27,6 +23,8 @@ typedef enum {
     TOKEN_LVALUE,
     TOKEN_ASSIGN,
     TOKEN_ASSIGN_ADDRESS,
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
     TOKEN_DATA,
     TOKEN_INT,
     TOKEN_TEXT,
@@ -43,6 +41,17 @@ typedef enum {
     TOKEN_END,
     TOKEN_RETURN,
     TOKEN_CALL,
+    TOKEN_LOAD,
+    TOKEN_STORE,
+    TOKEN_VADD,
+    TOKEN_VSUB,
+    TOKEN_VMUL,
+    TOKEN_VFILL,
+    TOKEN_VCOPY,
+    TOKEN_VSUM,
+    TOKEN_FADD,
+    TOKEN_CAS,
+    TOKEN_XCHG,
     TOKEN_STRING,
     TOKEN_IDENTIFIER,
     TOKEN_NUMBER,
@@ -105,13 +114,4 @@ void initScanner(const char* source);
  */
 Token scanToken();
 
-/**
- * @brief Reads the source file to identify function names by checking
- * if they stand next to the call keyword
- * 
- * @param functionNames 
- * @param source 
- */
-void getFunctionNames(NameList* functionNames, const char* source);
-
 #endif
\ No newline at end of file
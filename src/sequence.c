@@ -1,21 +1,61 @@
 #include "memmng.h"
+#include "object.h"
 #include "sequence.h"
 
+#define CONSTANT_POOL_LOAD_FACTOR 0.75
+
 void initSequence(Sequence* sequence) {
     sequence->count = 0;
     sequence->capacity = 0;
     sequence->code = NULL;
     sequence->lines = NULL;
+    sequence->lineCount = 0;
+    sequence->lineCapacity = 0;
+    sequence->lastOffset = 0;
+    sequence->lastLine = 0;
     initValueArray(&sequence->constants);
 }
 
 void freeSequence(Sequence* sequence) {
-    reallocate(sequence->code, sizeof(uint8_t) * sequence->capacity, 0);
-    reallocate(sequence->lines, sizeof(int) * sequence->capacity, 0);
+    // Code and lines of a loaded image are borrowed, with capacity 0
+    if (sequence->capacity > 0) {
+        reallocate(sequence->code, sizeof(uint8_t) * sequence->capacity, 0);
+    }
+    if (sequence->lineCapacity > 0) {
+        reallocate(sequence->lines, sizeof(LineDelta) * sequence->lineCapacity, 0);
+    }
     freeValueArray(&sequence->constants);
     initSequence(sequence);
 }
 
+static void addLineDelta(Sequence* sequence, int offset, int line) {
+    if (sequence->lineCapacity < sequence->lineCount + 1) {
+        int prevCapacity = sequence->lineCapacity;
+        sequence->lineCapacity = prevCapacity < 16 ? 16 : prevCapacity * 2;
+        sequence->lines = (LineDelta*)reallocate((void*)sequence->lines, \
+        sizeof(LineDelta) * prevCapacity, sizeof(LineDelta) * sequence->lineCapacity);
+    }
+    sequence->lines[sequence->lineCount++] = (LineDelta){(uint8_t)offset, (int8_t)line};
+}
+
+static void addLineRun(Sequence* sequence, int offset, int line) {
+    int offsetDelta = offset - sequence->lastOffset;
+    int lineDelta = line - sequence->lastLine;
+    while (offsetDelta > UINT8_MAX) {
+        addLineDelta(sequence, UINT8_MAX, 0);
+        offsetDelta -= UINT8_MAX;
+    }
+    // The line only changes once the offset of the run is reached
+    do {
+        int step = lineDelta > INT8_MAX ? INT8_MAX : lineDelta < INT8_MIN ? INT8_MIN : lineDelta;
+        addLineDelta(sequence, offsetDelta, step);
+        offsetDelta = 0;
+        lineDelta -= step;
+    } while (lineDelta != 0);
+    sequence->lastOffset = offset;
+    sequence->lastLine = line;
+}
+
 void writeSequence(Sequence* sequence, uint8_t byte, int line) {
     if (sequence->capacity < sequence->count + 1) {
         int prevCapacity = sequence->capacity;
@@ -23,16 +63,133 @@ void writeSequence(Sequence* sequence, uint8_t byte, int line) {
         sequence->code = (uint8_t*)reallocate((void*)sequence->code, \
         sizeof(uint8_t) * prevCapacity, \
         sizeof(uint8_t) * sequence->capacity);
-        sequence->lines = (int*)reallocate((void*)sequence->lines, \
-        sizeof(int) * prevCapacity, sizeof(int) * sequence->capacity);
     }
 
     sequence->code[sequence->count] = byte;
-    sequence->lines[sequence->count] = line;
+    // A new run only starts when the line changes
+    if (line != sequence->lastLine) {
+        addLineRun(sequence, sequence->count, line);
+    }
     sequence->count++;
 }
 
 int addValue(Sequence* sequence, Value value) {
     writeValueArray(&sequence->constants, value);
     return sequence->constants.count - 1;
+}
+
+int instructionLength(uint8_t instruction) {
+    switch (instruction) {
+        case OP_LVALUE:
+        case OP_RVALUE:
+        case OP_PUSH:
+        case OP_SHOW:
+        case OP_CALL:
+        case OP_WIDE:
+        case OP_TAIL_CALL:
+            return 2;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+int advanceLine(Sequence* sequence, LineCursor* cursor, int offset) {
+    while (cursor->delta < sequence->lineCount && \
+        cursor->offset + sequence->lines[cursor->delta].offset <= offset) {
+        cursor->offset += sequence->lines[cursor->delta].offset;
+        cursor->line += sequence->lines[cursor->delta].line;
+        cursor->delta++;
+    }
+    return cursor->line;
+}
+
+int getLineNumber(Sequence* sequence, int offset) {
+    LineCursor cursor = {0, 0, 0};
+    return advanceLine(sequence, &cursor, offset);
+}
+
+void initConstantPool(ConstantPool* pool) {
+    pool->count = 0;
+    pool->capacity = 0;
+    pool->slots = NULL;
+}
+
+void freeConstantPool(ConstantPool* pool) {
+    reallocate(pool->slots, sizeof(int) * pool->capacity, 0);
+    initConstantPool(pool);
+}
+
+static uint32_t hashConstant(Value value) {
+    if (isObject(value)) {
+        return ((String*)asObject(value))->hash;
+    }
+    return (uint32_t)asNumber(value) * 2654435761u;
+}
+
+static int* findConstantSlot(int* slots, int capacity, ValueArray* constants, Value value) {
+    uint32_t index = hashConstant(value) & (capacity - 1);
+    for (;;) {
+        int* slot = &slots[index];
+        if (*slot == -1) {
+            return slot;
+        }
+        Value constant = constants->values[*slot];
+        // Strings are interned, so objects are compared by pointer
+        if (valuesEqual(constant, value)) {
+            return slot;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+int addConstant(Sequence* sequence, ConstantPool* pool, Value value) {
+    ValueArray* constants = &sequence->constants;
+    if (pool->count + 1 > pool->capacity * CONSTANT_POOL_LOAD_FACTOR) {
+        int capacity = pool->capacity < 16 ? 16 : pool->capacity * 2;
+        int* slots = (int*)reallocate(NULL, 0, sizeof(int) * capacity);
+        for (int i = 0; i < capacity; i++) {
+            slots[i] = -1;
+        }
+        for (int i = 0; i < constants->count; i++) {
+            *findConstantSlot(slots, capacity, constants, constants->values[i]) = i;
+        }
+        reallocate(pool->slots, sizeof(int) * pool->capacity, 0);
+        pool->slots = slots;
+        pool->capacity = capacity;
+    }
+    int* slot = findConstantSlot(pool->slots, pool->capacity, constants, value);
+    if (*slot == -1) {
+        *slot = addValue(sequence, value);
+        pool->count++;
+    }
+    return *slot;
+}
+
+bool writeInstruction(Sequence* sequence, ConstantPool* pool, uint8_t instruction, Value constant, int line) {
+    int length = instructionLength(instruction);
+    if (length == 1) {
+        writeSequence(sequence, instruction, line);
+        return true;
+    }
+    int index = addConstant(sequence, pool, constant);
+    if (index > UINT16_MAX) {
+        return false;
+    }
+    if (index > UINT8_MAX) {
+        writeSequence(sequence, OP_WIDE, line);
+        writeSequence(sequence, (index >> 8) & 0xff, line);
+    }
+    writeSequence(sequence, instruction, line);
+    writeSequence(sequence, index & 0xff, line);
+    if (length > 2) {
+        // Jumps are relative to the offset of their constant index
+        int jumpPoint = sequence->count - 1;
+        writeSequence(sequence, (jumpPoint >> 8) & 0xff, line);
+        writeSequence(sequence, jumpPoint & 0xff, line);
+    }
+    return true;
 }
\ No newline at end of file
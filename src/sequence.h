@@ -1,6 +1,7 @@
 #ifndef sequence_h
 #define sequence_h
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "value.h"
@@ -37,22 +38,86 @@ typedef enum {
     OP_BEGIN,
     OP_END,
     OP_HALT,
+    // Prefix giving the high byte of the constant index of the next instruction
+    OP_WIDE,
+    // A call directly followed by a return, run in the frame of the caller
+    OP_TAIL_CALL,
+    // Bulk transfers of a range of global memory, from or to the stack
+    OP_LOAD,
+    OP_STORE,
+    // Element-wise operations on ranges of global memory, run by the bus
+    OP_VECTOR_ADD,
+    OP_VECTOR_SUBTRACT,
+    OP_VECTOR_MULTIPLY,
+    OP_VECTOR_FILL,
+    OP_VECTOR_COPY,
+    OP_VECTOR_SUM,
+    // Read-modify-write of one global as a single bus transaction
+    OP_FETCH_ADD,
+    OP_COMPARE_SWAP,
+    OP_EXCHANGE,
 } OpCode;
 
+/**
+ * struct LineDelta - Start of a run of bytes compiled from one line,
+ * relative to the start of the previous run. Larger steps are split over
+ * several deltas.
+ * @a: offset -> uint8_t : bytes since the start of the previous run
+ * @b: line -> int8_t : lines since the line of the previous run
+ */
+typedef struct {
+    uint8_t offset;
+    int8_t line;
+} LineDelta;
+
+/**
+ * struct ConstantPool - Hash index of the constants of a sequence, so
+ * each distinct constant is stored once
+ * @a: count -> int : number of constants indexed
+ * @b: capacity -> int : number of slots, 0 or a power of 2
+ * @c: slots -> int* : index of a constant of the sequence, -1 when empty
+ */
+typedef struct {
+    int count;
+    int capacity;
+    int* slots;
+} ConstantPool;
+
+/**
+ * struct LineCursor - Position while decoding the deltas of a sequence
+ * @a: delta -> int : index of the next delta
+ * @b: offset -> int : start of the current run
+ * @c: line -> int : line of the current run
+ */
+typedef struct {
+    int delta;
+    int offset;
+    int line;
+} LineCursor;
+
 /**
  * struct Sequence - A sequence of byte OpCodes
  * @a: count -> int : current number of bytes
  * @b: capacity -> int : maximum number of bytes
  * @c: code -> uint8_t* : array of bytes
  * @d: constants -> ValueArray : stores all constants of current sequence
- * @e: line -> int* : stores line for each byte
+ * @e: lines -> LineDelta* : stores where the line changes, decoded only for
+ * errors and reports
+ * @f: lineCount -> int : current number of deltas
+ * @g: lineCapacity -> int : maximum number of deltas
+ * @h: lastOffset, lastLine -> int : start and line of the last run, to
+ * encode the next one
  */
 typedef struct {
     int count;
     int capacity;
     uint8_t* code;
     ValueArray constants;
-    int* lines;
+    LineDelta* lines;
+    int lineCount;
+    int lineCapacity;
+    int lastOffset;
+    int lastLine;
 } Sequence;
 
 /**
@@ -91,4 +156,74 @@ void writeSequence(Sequence* sequence, uint8_t byte, int line);
  */
 int addValue(Sequence* sequence, Value value);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Returns the number of bytes of the instruction with the given
+ * opcode, operands included.
+ * 
+ * @param instruction 
+ * @return int 
+ */
+int instructionLength(uint8_t instruction);
+
+/**
+ * @brief Initializes members of the given pool to default values.
+ * 
+ * @param pool 
+ */
+void initConstantPool(ConstantPool* pool);
+
+/**
+ * @brief Frees the slots of the given pool and reinitializes it.
+ * 
+ * @param pool 
+ */
+void freeConstantPool(ConstantPool* pool);
+
+/**
+ * @brief Returns the index of value in the constants of the sequence,
+ * adding it only if no equal constant is indexed in pool yet.
+ * 
+ * @param sequence 
+ * @param pool 
+ * @param value 
+ * @return int 
+ */
+int addConstant(Sequence* sequence, ConstantPool* pool, Value value);
+
+/**
+ * @brief Writes an instruction. Its constant, if it takes one, goes
+ * through pool with an OP_WIDE prefix for indices above 255, and jumps
+ * get their jump point. Returns false if the constants are full.
+ * 
+ * @param sequence 
+ * @param pool 
+ * @param instruction 
+ * @param constant ignored for instructions without operand
+ * @param line 
+ * @return true 
+ * @return false 
+ */
+bool writeInstruction(Sequence* sequence, ConstantPool* pool, uint8_t instruction, Value constant, int line);
+
+/**
+ * @brief Decodes the line deltas of the sequence up to the given offset
+ * and returns the line of the byte there. Offsets given to one cursor may
+ * not decrease, so walking all bytes in order decodes each delta once.
+ * 
+ * @param sequence 
+ * @param cursor starts as {0, 0, 0}
+ * @param offset 
+ * @return int 
+ */
+int advanceLine(Sequence* sequence, LineCursor* cursor, int offset);
+
+/**
+ * @brief Returns the line the byte at offset was compiled from.
+ * 
+ * @param sequence 
+ * @param offset 
+ * @return int 
+ */
+int getLineNumber(Sequence* sequence, int offset);
+
+#endif
\ No newline at end of file
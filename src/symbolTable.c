@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <stdio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "memmng.h"
 #include "object.h"
@@ -9,43 +12,135 @@
 
 #define TABLE_LOAD_FACTOR 0.75
 
+// Control bytes of unused entries, used ones have the high bit clear
+#define CONTROL_EMPTY 0x80
+#define CONTROL_DELETED 0xFE
+
+// The low 7 bits of a hash go to the control byte, the rest picks the group
+#define HASH_TAG(hash) ((uint8_t)((hash) & 0x7F))
+#define HASH_GROUP(hash) ((hash) >> 7)
+
 void initTable(Table* table) {
     table->capacity = 0;
     table->count = 0;
+    table->deleted = 0;
     table->entries = NULL;
+    table->control = NULL;
 }
 
 void freeTable(Table* table) {
     reallocate(table->entries, sizeof(Entry) * table->capacity, 0);
+    reallocate(table->control, sizeof(uint8_t) * table->capacity, 0);
     initTable(table);
 }
 
-static Entry* findEntry(Entry* entries, int capacity, String* key) {
-    uint32_t index = key->hash & (capacity - 1);
-    for (;;) {
-        Entry* entry = &entries[index];
-        if (entry->key  == key || entry->key == NULL) {
-            return entry;
+/**
+ * @brief Returns a mask with bit i set if the control byte of entry i of
+ * the group is equal to the given byte.
+ *
+ * @param group
+ * @param byte
+ * @return uint32_t
+ */
+static inline uint32_t matchByte(const uint8_t* group, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i control = _mm_loadu_si128((const __m128i*)group);
+    __m128i bytes = _mm_shuffle_epi32(_mm_cvtsi32_si128(byte * 0x01010101), 0);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(control, bytes));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < TABLE_GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief Returns a mask with bit i set if entry i of the group is empty
+ * or deleted.
+ *
+ * @param group
+ * @return uint32_t
+ */
+static inline uint32_t matchUnused(const uint8_t* group) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < TABLE_GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief Returns the index of the entry of the given key, or -1 if there
+ * is none. Groups are probed at triangular offsets from the first one,
+ * which visits all of them since their number is a power of 2.
+ *
+ * @param table
+ * @param key
+ * @return int
+ */
+static int findEntry(Table* table, String* key) {
+    if (table->capacity == 0) {
+        return -1;
+    }
+    uint32_t mask = table->capacity / TABLE_GROUP_WIDTH - 1;
+    uint32_t group = HASH_GROUP(key->hash) & mask;
+    uint8_t tag = HASH_TAG(key->hash);
+    for (uint32_t step = 1;; step++) {
+        const uint8_t* control = table->control + group * TABLE_GROUP_WIDTH;
+        for (uint32_t match = matchByte(control, tag); match != 0; match &= match - 1) {
+            int index = group * TABLE_GROUP_WIDTH + __builtin_ctz(match);
+            if (table->entries[index].key == key) {
+                return index;
+            }
         }
-        index = (index + 1) % capacity;
+        if (matchByte(control, CONTROL_EMPTY) != 0) {
+            return -1;
+        }
+        group = (group + step) & mask;
     }
-} 
+}
+
+/**
+ * @brief Returns the index of the first empty or deleted entry on the
+ * probe sequence of the given hash.
+ *
+ * @param table
+ * @param hash
+ * @return int
+ */
+static int findUnused(Table* table, uint32_t hash) {
+    uint32_t mask = table->capacity / TABLE_GROUP_WIDTH - 1;
+    uint32_t group = HASH_GROUP(hash) & mask;
+    for (uint32_t step = 1;; step++) {
+        uint32_t match = matchUnused(table->control + group * TABLE_GROUP_WIDTH);
+        if (match != 0) {
+            return group * TABLE_GROUP_WIDTH + __builtin_ctz(match);
+        }
+        group = (group + step) & mask;
+    }
+}
 
 int tableGetValue(Table* table, String* key, Value* value) {
     if (table->count == 0) {
         return -1;
     }
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    int address = entry->address;
-    if (entry->key == NULL) {
-        // address == -1 if entry not set
-        return address;
+    int index = findEntry(table, key);
+    if (index == -1) {
+        // Entry not set
+        return -1;
     }
 
+    Entry* entry = &table->entries[index];
     *value = entry->value;
-    if (address >= 0) {
-        return address;
+    if (entry->address >= 0) {
+        return entry->address;
     }
     // -2 will mean that entry refers only to local variables
     return -2;
@@ -55,7 +150,7 @@ String* tableGetKey(Table* table, int address) {
     // puts("In tableGetKey");
     if (address == -1) {
         return NULL;
-    }   
+    }
     for (int i = 0; i < table->capacity; i++) {
         // printf("%d", i);
         if (table->entries[i].address == address) {
@@ -68,111 +163,134 @@ String* tableGetKey(Table* table, int address) {
 }
 
 static void adjustCapacity(Table* table, int capacity) {
-    Entry* entries = (Entry*)reallocate(NULL, 0, sizeof(Entry) * capacity);
+    Table resized;
+    resized.capacity = capacity;
+    resized.count = 0;
+    resized.deleted = 0;
+    resized.entries = (Entry*)reallocate(NULL, 0, sizeof(Entry) * capacity);
+    resized.control = (uint8_t*)reallocate(NULL, 0, sizeof(uint8_t) * capacity);
+    memset(resized.control, CONTROL_EMPTY, capacity);
     for (int i = 0; i < capacity; i++) {
-        entries[i].key = NULL;
-        entries[i].value.as.number = 0;
-        entries[i].address = -1;
+        resized.entries[i].key = NULL;
+        resized.entries[i].value = numberValue(0);
+        resized.entries[i].address = -1;
     }
 
-    table->count = 0;
+    // Deleted entries are dropped
     for (int i = 0; i < table->capacity; i++) {
-        Entry* entry = &table->entries[i];
-        if (entry->key == NULL) {
+        if (table->control[i] & CONTROL_EMPTY) {
             continue;
         }
-        Entry* destination = findEntry(entries, capacity, entry->key);
-        destination->key = entry->key;
-        destination->value = entry->value;
-        destination->address = entry->address;
-        table->count++;
+        Entry* entry = &table->entries[i];
+        int index = findUnused(&resized, entry->key->hash);
+        resized.control[index] = HASH_TAG(entry->key->hash);
+        resized.entries[index] = *entry;
+        resized.count++;
     }
 
-    reallocate(table->entries, sizeof(Entry) * table->capacity, 0);
-
-    table->entries = entries;
-    table->capacity = capacity;
+    freeTable(table);
+    *table = resized;
 }
 
-bool tableSetValue(Table* table, String* key, Value value) {
-    if (table->capacity * TABLE_LOAD_FACTOR < table->count + 1 ) {
-        int capacity = table->capacity < 16 ? 16 : table->capacity * 2;
+/**
+ * @brief Adds an entry for a key that is not in the table yet, growing the
+ * table first if more than 75% of its capacity would be in use, or only
+ * dropping the deleted entries if that makes enough room. Returns the
+ * entry, whose value is 0 and address -1.
+ *
+ * @param table
+ * @param key
+ * @return Entry*
+ */
+static Entry* addEntry(Table* table, String* key) {
+    if (table->capacity * TABLE_LOAD_FACTOR < table->count + table->deleted + 1) {
+        int capacity = table->capacity;
+        if (table->capacity * TABLE_LOAD_FACTOR < 2 * (table->count + 1)) {
+            capacity = table->capacity < TABLE_GROUP_WIDTH ? TABLE_GROUP_WIDTH : table->capacity * 2;
+        }
         adjustCapacity(table, capacity);
     }
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
-    if (isNewKey) {
-        table->count++;
+    int index = findUnused(table, key->hash);
+    if (table->control[index] == CONTROL_DELETED) {
+        table->deleted--;
     }
+    table->control[index] = HASH_TAG(key->hash);
+    table->count++;
+    Entry* entry = &table->entries[index];
     entry->key = key;
+    return entry;
+}
+
+void tableReserve(Table* table, int count) {
+    int capacity = table->capacity < TABLE_GROUP_WIDTH ? TABLE_GROUP_WIDTH : table->capacity;
+    while (capacity * TABLE_LOAD_FACTOR < count) {
+        capacity *= 2;
+    }
+    if (capacity > table->capacity) {
+        adjustCapacity(table, capacity);
+    }
+}
+
+bool tableSetValue(Table* table, String* key, Value value) {
+    int index = findEntry(table, key);
+    bool isNewKey = index == -1;
+    Entry* entry = isNewKey ? addEntry(table, key) : &table->entries[index];
     entry->value = value;
     return isNewKey;
 }
 
 bool tableSetValueAddress(Table* table, String* key, Value value, int* address) {
-    if (table->capacity * TABLE_LOAD_FACTOR < table->count + 1 ) {
-        int capacity = table->capacity < 16 ? 16 : table->capacity * 2;
-        adjustCapacity(table, capacity);
-    }
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
+    int index = findEntry(table, key);
+    bool isNewKey = index == -1;
+    Entry* entry;
     if (isNewKey) {
-        table->count++;
+        entry = addEntry(table, key);
         entry->address = *address;   // Only change address if new Entry
     } else {
+        entry = &table->entries[index];
         *address = entry->address;
     }
-    entry->key = key;
     entry->value = value;
     return isNewKey;
 }
 
 bool tableSetAddress(Table* table, String* key, int* address) {
-    if (table->capacity * TABLE_LOAD_FACTOR < table->count + 1 ) {
-        int capacity = table->capacity < 16 ? 16 : table->capacity * 2;
-        adjustCapacity(table, capacity);
-    }
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
+    int index = findEntry(table, key);
+    bool isNewKey = index == -1;
     if (isNewKey) {
-        table->count++;
-        entry->address = *address;   // Only change address if new Entry
+        addEntry(table, key)->address = *address;   // Only change address if new Entry
     } else {
-        *address = entry->address;
+        *address = table->entries[index].address;
     }
-    entry->key = key;
     return isNewKey;
 }
 
 bool tableChangeAddress(Table* table, String* key, int address) {
-    if (table->capacity * TABLE_LOAD_FACTOR < table->count + 1 ) {
-        int capacity = table->capacity < 16 ? 16 : table->capacity * 2;
-        adjustCapacity(table, capacity);
+    int index = findEntry(table, key);
+    if (index == -1) {
+        return false;
     }
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
-    if (!isNewKey) {
-        entry->address = address;
-    }
-    return !isNewKey;
+    table->entries[index].address = address;
+    return true;
 }
 
-String* findString(Table* table, const char* characters, int length, \
-                    uint32_t hash) {
-    if (table->count == 0) {
-        return NULL;
+bool tableDelete(Table* table, String* key) {
+    int index = findEntry(table, key);
+    if (index == -1) {
+        return false;
     }
-
-    uint32_t index = hash % table->capacity;
-    for (;;) {
-        Entry* entry = &table->entries[index];
-        if (entry->key == NULL) {
-            return NULL;
-        } else if (entry->key->length == length && 
-                    entry->key->hash == hash && 
-                    memcmp(entry->key->characters, characters, length) == 0) {
-            return entry->key;
-        }
-        index = (index + 1) % table->capacity;
+    // Probes already stop at a group with an empty entry, so a deleted
+    // entry only has to be told apart from an empty one in a full group
+    const uint8_t* group = table->control + index / TABLE_GROUP_WIDTH * TABLE_GROUP_WIDTH;
+    if (matchByte(group, CONTROL_EMPTY) != 0) {
+        table->control[index] = CONTROL_EMPTY;
+    } else {
+        table->control[index] = CONTROL_DELETED;
+        table->deleted++;
     }
+    table->entries[index].key = NULL;
+    table->entries[index].value = numberValue(0);
+    table->entries[index].address = -1;
+    table->count--;
+    return true;
 }
\ No newline at end of file
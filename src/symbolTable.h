@@ -19,16 +19,31 @@ typedef struct {
     int address;
 } Entry;
 
+// Number of control bytes compared at once while probing
+#define TABLE_GROUP_WIDTH 16
+
 /**
  * struct Table - Hash table that stores all variable names in program
  * @a: count -> int : number of entries
- * @b: capacity -> int : maximum number of entries
- * @c: entries -> Entry* : Array of entries
+ * @b: deleted -> int : number of deleted entries not reused yet
+ * @c: capacity -> int : maximum number of entries, a power of 2 multiple
+ * of TABLE_GROUP_WIDTH
+ * @d: entries -> Entry* : Array of entries, the key of unused ones is NULL
+ * @e: control -> uint8_t* : one byte per entry, empty, deleted, or the low
+ * 7 bits of the hash of its key
+ *
+ * Description: The entries are split in groups of TABLE_GROUP_WIDTH. The
+ * rest of the hash of a key picks the first group to probe, whose control
+ * bytes are all compared to the low bits of the hash at once, so only the
+ * keys of matching entries are compared. Probing stops at the first group
+ * with an empty entry.
  */
 typedef struct {
     int count;
+    int deleted;
     int capacity;
     Entry* entries;
+    uint8_t* control;
 } Table;
 
 /**
@@ -100,7 +115,7 @@ bool tableSetValue(Table* table, String* key, Value value);
 bool tableSetValueAddress(Table* table, String* key, Value value, int* address);
 
 /**
- * @brief hecks if table contains more entries than 75% of its capacity.
+ * @brief Checks if table contains more entries than 75% of its capacity.
  * Reallocates a new table with double the capacity if true. If the given 
  * key isn't found in the table, create new entry and assign given address.
  * If Entry exists, set address to found address. Update count as necessary. 
@@ -127,15 +142,22 @@ bool tableSetAddress(Table* table, String* key, int* address);
 bool tableChangeAddress(Table* table, String* key, int address);
 
 /**
- * @brief Check if any entry's key in the given table is equal to the given
- * string. If found, returns the String object, else returns NULL
+ * @brief Removes the entry with the given key. Returns true if there was one.
  * 
  * @param table 
- * @param characters 
- * @param length 
- * @param hash 
- * @return String* 
+ * @param key 
+ * @return true 
+ * @return false 
+ */
+bool tableDelete(Table* table, String* key);
+
+/**
+ * @brief Grows the table once so that count keys fit without growing it
+ * again. Does nothing if they already fit.
+ * 
+ * @param table 
+ * @param count 
  */
-String* findString(Table* table, const char* characters, int length, uint32_t hash);
+void tableReserve(Table* table, int count);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sequence.h"
+#include "timing.h"
+
+bool timingEnabled = false;
+
+CostModel costModel = {
+    .instruction = 1,
+    .hit = 1,
+    .arbitration = 2,
+    .memory = 50,
+    .transfer = 20,
+    .invalidation = 10,
+};
+
+const uint8_t instructionClasses[256] = {
+    [OP_LVALUE] = CLASS_MEMORY,
+    [OP_RVALUE] = CLASS_MEMORY,
+    [OP_ASSIGN] = CLASS_MEMORY,
+    [OP_ASSIGN_ADDRESS] = CLASS_MEMORY,
+    [OP_LOAD] = CLASS_MEMORY,
+    [OP_STORE] = CLASS_MEMORY,
+    [OP_VECTOR_ADD] = CLASS_MEMORY,
+    [OP_VECTOR_SUBTRACT] = CLASS_MEMORY,
+    [OP_VECTOR_MULTIPLY] = CLASS_MEMORY,
+    [OP_VECTOR_FILL] = CLASS_MEMORY,
+    [OP_VECTOR_COPY] = CLASS_MEMORY,
+    [OP_VECTOR_SUM] = CLASS_MEMORY,
+    [OP_FETCH_ADD] = CLASS_MEMORY,
+    [OP_COMPARE_SWAP] = CLASS_MEMORY,
+    [OP_EXCHANGE] = CLASS_MEMORY,
+    [OP_PUSH] = CLASS_STACK,
+    [OP_POP] = CLASS_STACK,
+    [OP_COPY] = CLASS_STACK,
+    [OP_ADD] = CLASS_ALU,
+    [OP_SUBTRACT] = CLASS_ALU,
+    [OP_MULTIPLY] = CLASS_ALU,
+    [OP_DIVIDE] = CLASS_ALU,
+    [OP_REMAINDER] = CLASS_ALU,
+    [OP_EQUAL] = CLASS_ALU,
+    [OP_NOT_EQUAL] = CLASS_ALU,
+    [OP_GREATER] = CLASS_ALU,
+    [OP_LESS] = CLASS_ALU,
+    [OP_LESS_EQUAL] = CLASS_ALU,
+    [OP_GREATER_EQUAL] = CLASS_ALU,
+    [OP_AND] = CLASS_ALU,
+    [OP_OR] = CLASS_ALU,
+    [OP_NOT] = CLASS_ALU,
+    [OP_PRINT] = CLASS_IO,
+    [OP_SHOW] = CLASS_IO,
+    [OP_JUMP] = CLASS_CONTROL,
+    [OP_JUMP_IF_FALSE] = CLASS_CONTROL,
+    [OP_JUMP_IF_TRUE] = CLASS_CONTROL,
+    [OP_HALT] = CLASS_CONTROL,
+    [OP_WIDE] = CLASS_CONTROL,
+    [OP_CALL] = CLASS_CALL,
+    [OP_TAIL_CALL] = CLASS_CALL,
+    [OP_RETURN] = CLASS_CALL,
+    [OP_BEGIN] = CLASS_CALL,
+    [OP_END] = CLASS_CALL,
+};
+
+static const char* classNames[CLASS_COUNT] = {
+    "memory", "alu", "stack", "control", "call", "io", "snoop",
+};
+
+bool parseCostModel(const char* spec) {
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", spec);
+    for (char* pair = strtok(copy, ","); pair != NULL; pair = strtok(NULL, ",")) {
+        char* equals = strchr(pair, '=');
+        if (equals == NULL) {
+            return false;
+        }
+        *equals = '\0';
+        char* end;
+        long cycles = strtol(equals + 1, &end, 10);
+        if (*end != '\0' || cycles < 0) {
+            return false;
+        }
+        if (strcmp(pair, "op") == 0) {
+            costModel.instruction = (int)cycles;
+        } else if (strcmp(pair, "hit") == 0) {
+            costModel.hit = (int)cycles;
+        } else if (strcmp(pair, "bus") == 0) {
+            costModel.arbitration = (int)cycles;
+        } else if (strcmp(pair, "mem") == 0) {
+            costModel.memory = (int)cycles;
+        } else if (strcmp(pair, "c2c") == 0) {
+            costModel.transfer = (int)cycles;
+        } else if (strcmp(pair, "inv") == 0) {
+            costModel.invalidation = (int)cycles;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void initCycleCounter(CycleCounter* counter) {
+    memset(counter, 0, sizeof(CycleCounter));
+    counter->currentClass = CLASS_CONTROL;
+}
+
+void chargeTransfers(CycleCounter* counter) {
+    uint64_t transfers = __atomic_exchange_n(&counter->transfers, 0, __ATOMIC_RELAXED);
+    uint64_t cycles = transfers * costModel.transfer;
+    counter->cycles += cycles;
+    counter->classCycles[CLASS_SNOOP] += cycles;
+    counter->classInstructions[CLASS_SNOOP] += transfers;
+}
+
+void printCycles(CycleCounter* counter) {
+    chargeTransfers(counter);
+    printf("\n%llu cycles, %llu instructions, CPI %.2f\n", \
+        (unsigned long long)counter->cycles, (unsigned long long)counter->instructions, \
+        counter->instructions > 0 ? (double)counter->cycles / counter->instructions : 0.0);
+    for (int i = 0; i < CLASS_SNOOP; i++) {
+        if (counter->classInstructions[i] == 0) {
+            continue;
+        }
+        printf("%-8s %12llu cycles %10llu instructions  CPI %.2f\n", classNames[i], \
+            (unsigned long long)counter->classCycles[i], \
+            (unsigned long long)counter->classInstructions[i], \
+            (double)counter->classCycles[i] / counter->classInstructions[i]);
+    }
+    if (counter->classInstructions[CLASS_SNOOP] > 0) {
+        printf("%-8s %12llu cycles %10llu transfers\n", classNames[CLASS_SNOOP], \
+            (unsigned long long)counter->classCycles[CLASS_SNOOP], \
+            (unsigned long long)counter->classInstructions[CLASS_SNOOP]);
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef timing_h
+#define timing_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    CLASS_MEMORY,
+    CLASS_ALU,
+    CLASS_STACK,
+    CLASS_CONTROL,
+    CLASS_CALL,
+    CLASS_IO,
+    CLASS_SNOOP,
+    CLASS_COUNT,
+} InstructionClass;
+
+/**
+ * struct CostModel - Latencies, in cycles, used to simulate time
+ * @a: instruction -> int : base cost of every executed instruction
+ * @b: hit -> int : access that is served by the cache
+ * @c: arbitration -> int : acquiring the bus, paid by every bus transaction
+ * @d: memory -> int : reading from or writing back to memory
+ * @e: transfer -> int : cache-to-cache transfer of a dirty line
+ * @f: invalidation -> int : invalidating the copies held by other cores
+ */
+typedef struct {
+    int instruction;
+    int hit;
+    int arbitration;
+    int memory;
+    int transfer;
+    int invalidation;
+} CostModel;
+
+/**
+ * struct CycleCounter - Simulated time of one core
+ * @a: cycles -> uint64_t : total number of cycles
+ * @b: instructions -> uint64_t : total number of executed instructions
+ * @c: classCycles -> uint64_t[] : cycles spent per instruction class
+ * @d: classInstructions -> uint64_t[] : instructions executed per class, and
+ * lines supplied to the other core for CLASS_SNOOP
+ * @e: currentClass -> InstructionClass : class that memory costs are charged to
+ * @f: transfers -> uint64_t : dirty lines supplied to the other core, counted
+ * by the snoop thread and charged by chargeTransfers on the next bus read
+ */
+typedef struct {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t classCycles[CLASS_COUNT];
+    uint64_t classInstructions[CLASS_COUNT];
+    InstructionClass currentClass;
+    uint64_t transfers;
+} CycleCounter;
+
+extern bool timingEnabled;
+extern CostModel costModel;
+extern const uint8_t instructionClasses[256];
+
+/**
+ * @brief Overrides entries of the cost model from a comma separated list
+ * of name=cycles pairs, e.g. "hit=1,bus=2,mem=50,c2c=20,inv=10,op=1".
+ * Returns false on unknown names or malformed numbers.
+ *
+ * @param spec
+ * @return true
+ * @return false
+ */
+bool parseCostModel(const char* spec);
+
+/**
+ * @brief Sets all members of the counter to zero
+ *
+ * @param counter
+ */
+void initCycleCounter(CycleCounter* counter);
+
+/**
+ * @brief Charges the lines supplied to the other core since the last call
+ * to CLASS_SNOOP, at the cache-to-cache transfer latency each. Called by
+ * the thread that owns the counter, the snoop thread only counts them.
+ *
+ * @param counter
+ */
+void chargeTransfers(CycleCounter* counter);
+
+/**
+ * @brief Prints the total cycles, CPI and the break down per instruction
+ * class of the given counter, after charging its pending transfers.
+ *
+ * @param counter
+ */
+void printCycles(CycleCounter* counter);
+
+static inline void chargeCycles(CycleCounter* counter, int cycles) {
+    counter->cycles += cycles;
+    counter->classCycles[counter->currentClass] += cycles;
+}
+
+static inline void countInstruction(CycleCounter* counter, uint8_t instruction) {
+    counter->currentClass = (InstructionClass)instructionClasses[instruction];
+    counter->instructions++;
+    counter->classInstructions[counter->currentClass]++;
+    chargeCycles(counter, costModel.instruction);
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memmng.h"
+#include "trace.h"
+
+#define TRACE_MAX_THREADS 64
+#define TRACE_INITIAL_RECORDS (1 << 20)
+
+bool traceEnabled = false;
+__thread TraceRing* traceRing = NULL;
+
+/**
+ * struct TraceFile - The mapped trace file shared by all threads
+ * @a: fd -> int : file descriptor of the trace file
+ * @b: mapped -> char* : start of the mapping, begins with a TraceHeader
+ * @c: size -> size_t : size of the file and of the mapping in bytes
+ * @d: rings -> TraceRing*[] : rings of all threads that recorded something
+ * @e: ringCount -> int : number of registered rings
+ * @f: lock -> pthread_mutex_t : serializes flushes and ring registration
+ */
+typedef struct {
+    int fd;
+    char* mapped;
+    size_t size;
+    TraceRing* rings[TRACE_MAX_THREADS];
+    int ringCount;
+    pthread_mutex_t lock;
+} TraceFile;
+
+static TraceFile traceFile = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static TraceHeader* header() {
+    return (TraceHeader*)traceFile.mapped;
+}
+
+static bool mapTraceFile(size_t size) {
+    if (ftruncate(traceFile.fd, size) < 0) {
+        perror("Could not resize trace file");
+        return false;
+    }
+    char* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, traceFile.fd, 0);
+    if (mapped == MAP_FAILED) {
+        perror("Could not map trace file");
+        return false;
+    }
+    if (traceFile.mapped != NULL) {
+        munmap(traceFile.mapped, traceFile.size);
+    }
+    traceFile.mapped = mapped;
+    traceFile.size = size;
+    return true;
+}
+
+bool openTrace(const char* path) {
+    static bool registered = false;
+    traceFile.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (traceFile.fd < 0) {
+        perror("Could not open trace file");
+        return false;
+    }
+    size_t size = sizeof(TraceHeader) + sizeof(TraceRecord) * TRACE_INITIAL_RECORDS;
+    if (!mapTraceFile(size)) {
+        close(traceFile.fd);
+        traceFile.fd = -1;
+        return false;
+    }
+    memcpy(header()->magic, TRACE_MAGIC, 4);
+    header()->version = TRACE_VERSION;
+    header()->recordSize = sizeof(TraceRecord);
+#if defined(__x86_64__) || defined(__i386__)
+    header()->usesTSC = 1;
+#else
+    header()->usesTSC = 0;
+#endif
+    header()->count = 0;
+    traceEnabled = true;
+    // Runs that exit on an error keep the records buffered so far
+    if (!registered) {
+        atexit(closeTrace);
+        registered = true;
+    }
+    return true;
+}
+
+TraceRing* newTraceRing() {
+    TraceRing* ring = (TraceRing*)reallocate(NULL, 0, sizeof(TraceRing));
+    ring->count = 0;
+    pthread_mutex_lock(&traceFile.lock);
+    if (traceFile.ringCount < TRACE_MAX_THREADS) {
+        traceFile.rings[traceFile.ringCount++] = ring;
+    }
+    pthread_mutex_unlock(&traceFile.lock);
+    traceRing = ring;
+    return ring;
+}
+
+// Must be called with traceFile.lock held
+static void flushRing(TraceRing* ring) {
+    if (ring->count == 0 || traceFile.mapped == NULL) {
+        ring->count = 0;
+        return;
+    }
+    size_t used = sizeof(TraceHeader) + sizeof(TraceRecord) * header()->count;
+    size_t needed = used + sizeof(TraceRecord) * ring->count;
+    if (needed > traceFile.size) {
+        size_t size = traceFile.size;
+        while (size < needed) {
+            size *= 2;
+        }
+        if (!mapTraceFile(size)) {
+            traceEnabled = false;
+            ring->count = 0;
+            return;
+        }
+    }
+    memcpy(traceFile.mapped + used, ring->records, sizeof(TraceRecord) * ring->count);
+    header()->count += ring->count;
+    ring->count = 0;
+}
+
+void flushTrace() {
+    if (traceRing == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&traceFile.lock);
+    flushRing(traceRing);
+    pthread_mutex_unlock(&traceFile.lock);
+}
+
+void closeTrace() {
+    if (traceFile.fd < 0) {
+        return;
+    }
+    traceEnabled = false;
+    pthread_mutex_lock(&traceFile.lock);
+    for (int i = 0; i < traceFile.ringCount; i++) {
+        flushRing(traceFile.rings[i]);
+    }
+    size_t used = sizeof(TraceHeader) + sizeof(TraceRecord) * header()->count;
+    msync(traceFile.mapped, used, MS_SYNC);
+    munmap(traceFile.mapped, traceFile.size);
+    if (ftruncate(traceFile.fd, used) < 0) {
+        perror("Could not trim trace file");
+    }
+    close(traceFile.fd);
+    traceFile.fd = -1;
+    traceFile.mapped = NULL;
+    traceFile.size = 0;
+    pthread_mutex_unlock(&traceFile.lock);
+}
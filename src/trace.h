@@ -0,0 +1,161 @@
+#ifndef trace_h
+#define trace_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define TRACE_MAGIC "ABMT"
+#define TRACE_VERSION 1
+#define TRACE_RING_CAPACITY 4096
+
+// Bits stored in TraceRecord.detail for memory and bus events
+#define TRACE_BY_ADDRESS 0x01
+#define TRACE_HIT 0x02
+#define TRACE_NOT_FOUND 0x04
+
+typedef enum {
+    TRACE_PROCESSOR_READ,
+    TRACE_PROCESSOR_WRITE,
+    TRACE_BUS_READ,
+    TRACE_BUS_READ_X,
+    TRACE_INVALIDATE,
+    TRACE_WRITE_BACK,
+    TRACE_SNOOP_INVALIDATE,
+    TRACE_SNOOP_WRITE_BACK,
+    TRACE_INSTRUCTION,
+    TRACE_BULK_READ,
+    TRACE_BULK_WRITE,
+    TRACE_VECTOR,
+    TRACE_ATOMIC,
+} TraceEvent;
+
+/**
+ * struct TraceRecord - One fixed-size (16 byte) entry of a trace file
+ * @a: timestamp -> uint64_t : TSC value (or monotonic ns if no TSC is available)
+ * @b: id -> uint32_t : address, hash of the symbol name, or bytecode offset
+ * for TRACE_INSTRUCTION. The first variable of the range for bulk transfers,
+ * and of the destination, or the source of a sum, for TRACE_VECTOR
+ * @c: core -> uint8_t : core ID as known to the bus, 0 inside abm.exe
+ * @d: event -> uint8_t : a TraceEvent
+ * @e: transition -> uint8_t : previous State in the high nibble, next State
+ * in the low nibble
+ * @f: detail -> uint8_t : the OpCode for TRACE_INSTRUCTION, TRACE_* flag
+ * bits for everything else
+ */
+typedef struct {
+    uint64_t timestamp;
+    uint32_t id;
+    uint8_t core;
+    uint8_t event;
+    uint8_t transition;
+    uint8_t detail;
+} TraceRecord;
+
+/**
+ * struct TraceHeader - Stored at the beginning of every trace file
+ * @a: magic -> char[4] : always TRACE_MAGIC
+ * @b: version -> uint32_t : TRACE_VERSION of the writer
+ * @c: recordSize -> uint32_t : sizeof(TraceRecord)
+ * @d: usesTSC -> uint32_t : 1 if timestamps are TSC ticks, 0 if nanoseconds
+ * @e: count -> uint64_t : number of records following the header
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t usesTSC;
+    uint64_t count;
+} TraceHeader;
+
+/**
+ * struct TraceRing - Per thread buffer that records are appended to
+ * @a: count -> int : number of records currently buffered
+ * @b: records -> TraceRecord[] : the buffered records
+ */
+typedef struct {
+    int count;
+    TraceRecord records[TRACE_RING_CAPACITY];
+} TraceRing;
+
+extern bool traceEnabled;
+extern __thread TraceRing* traceRing;
+
+/**
+ * @brief Creates (or truncates) the trace file at the given path, maps it
+ * into memory and enables tracing. closeTrace() is registered with atexit()
+ * so that the file is finalized even if the process exits on an error.
+ * Returns false if the file could not be created or mapped.
+ *
+ * @param path
+ * @return true
+ * @return false
+ */
+bool openTrace(const char* path);
+
+/**
+ * @brief Flushes the rings of all threads, trims the file to the records
+ * written and unmaps it. Tracing is disabled afterwards. Does nothing if
+ * no trace is open. Other threads must have stopped recording, as their
+ * rings are flushed without them.
+ *
+ */
+void closeTrace();
+
+/**
+ * @brief Copies the records buffered by the calling thread to the mapped
+ * file and empties its ring.
+ *
+ */
+void flushTrace();
+
+/**
+ * @brief Allocates and registers a ring for the calling thread. Only called
+ * the first time a thread records an event.
+ *
+ * @return TraceRing*
+ */
+TraceRing* newTraceRing();
+
+static inline uint64_t traceTimestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Appends one record to the calling thread's ring, flushing it to
+ * the file once it is full. Does nothing if tracing is disabled.
+ *
+ * @param event
+ * @param core
+ * @param id
+ * @param from
+ * @param to
+ * @param detail
+ */
+static inline void traceRecord(TraceEvent event, int core, uint32_t id, int from, int to, int detail) {
+    if (!traceEnabled) {
+        return;
+    }
+    TraceRing* ring = traceRing;
+    if (ring == NULL) {
+        ring = newTraceRing();
+    }
+    TraceRecord* record = &ring->records[ring->count];
+    record->timestamp = traceTimestamp();
+    record->id = id;
+    record->core = (uint8_t)core;
+    record->event = (uint8_t)event;
+    record->transition = (uint8_t)((from << 4) | (to & 0x0f));
+    record->detail = (uint8_t)detail;
+    if (++ring->count == TRACE_RING_CAPACITY) {
+        flushTrace();
+    }
+}
+
+#endif
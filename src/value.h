@@ -1,6 +1,9 @@
 #ifndef value_h
 #define value_h
 
+#include <stdbool.h>
+#include <stdint.h>
+
 // Forward declarations of Object and String structs
 typedef struct Object Object;
 typedef struct String String;
@@ -10,19 +13,54 @@ typedef enum {
     OBJ_VALUE,
 } ValueType;
 
+// Set in the bits of an object, which are at least 2 byte aligned
+#define OBJECT_TAG ((uint64_t)1)
+
 /**
- * struct Value - Stores an integer or object
- * @a: type -> ValueType : either NUM_VALUE or OBJ_VALUE
- * @b: as -> union { int number; Object* obj } : actual data
+ * struct Value - Stores an integer or object in 8 bytes. Only made and
+ * read through the functions below.
+ * @a: bits -> uint64_t : a number in the high 32 bits with the low bits
+ * clear, or a pointer to an Object with OBJECT_TAG set. All bits clear
+ * is the number 0.
  */
 typedef struct {
-    ValueType type;
-    union {
-        int number;
-        Object* obj;
-    } as;
+    uint64_t bits;
 } Value;
 
+static inline Value numberValue(int number) {
+    return (Value){(uint64_t)(uint32_t)number << 32};
+}
+
+static inline Value objectValue(Object* obj) {
+    return (Value){(uint64_t)(uintptr_t)obj | OBJECT_TAG};
+}
+
+static inline bool isObject(Value value) {
+    return (value.bits & OBJECT_TAG) != 0;
+}
+
+static inline bool isNumber(Value value) {
+    return !isObject(value);
+}
+
+static inline int asNumber(Value value) {
+    return (int)(uint32_t)(value.bits >> 32);
+}
+
+static inline Object* asObject(Value value) {
+    return (Object*)(uintptr_t)(value.bits & ~OBJECT_TAG);
+}
+
+// NUM_VALUE or OBJ_VALUE, as stored in images
+static inline ValueType valueType(Value value) {
+    return isObject(value) ? OBJ_VALUE : NUM_VALUE;
+}
+
+// Strings are interned, so objects are equal if they are the same
+static inline bool valuesEqual(Value a, Value b) {
+    return a.bits == b.bits;
+}
+
 /**
  * struct ValueArray - An array of Value(s)
  * @a: capacity -> int : maximum number of Value(s)
@@ -0,0 +1,190 @@
+#include <stdbool.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+// AVX2 kernels are compiled for every x86-64 build, and only run if the
+// processor has it
+#define VECTOR_AVX2
+#endif
+
+#include "vector.h"
+
+#ifdef VECTOR_AVX2
+static bool hasAvx2() {
+    static int supported = -1;
+    if (supported == -1) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") != 0;
+    }
+    return supported;
+}
+
+// The AVX2 kernels return the number of elements done, a multiple of 8
+
+__attribute__((target("avx2")))
+static int addAvx2(int32_t* destination, const int32_t* a, const int32_t* b, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i sum = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), \
+            _mm256_loadu_si256((const __m256i*)(b + i)));
+        _mm256_storeu_si256((__m256i*)(destination + i), sum);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int subtractAvx2(int32_t* destination, const int32_t* a, const int32_t* b, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i difference = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), \
+            _mm256_loadu_si256((const __m256i*)(b + i)));
+        _mm256_storeu_si256((__m256i*)(destination + i), difference);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int multiplyAvx2(int32_t* destination, const int32_t* a, const int32_t* b, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i product = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), \
+            _mm256_loadu_si256((const __m256i*)(b + i)));
+        _mm256_storeu_si256((__m256i*)(destination + i), product);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int fillAvx2(int32_t* destination, int32_t value, int count) {
+    __m256i values = _mm256_set1_epi32(value);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i*)(destination + i), values);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int sumAvx2(const int32_t* values, int count, uint32_t* sum) {
+    __m256i sums = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        sums = _mm256_add_epi32(sums, _mm256_loadu_si256((const __m256i*)(values + i)));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, sums);
+    for (int lane = 0; lane < 8; lane++) {
+        *sum += lanes[lane];
+    }
+    return i;
+}
+#endif
+
+#ifdef __SSE2__
+// SSE2 has no 32 bit multiply, the low halves of two 64 bit products are
+// taken from the even and the odd elements
+static inline __m128i multiplySse2(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), \
+        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#endif
+
+void vectorAdd(int32_t* destination, const int32_t* a, const int32_t* b, int count) {
+    int i = 0;
+#ifdef VECTOR_AVX2
+    if (hasAvx2()) {
+        i = addAvx2(destination, a, b, count);
+    }
+#endif
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(destination + i), _mm_add_epi32( \
+            _mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+    }
+#endif
+    for (; i < count; i++) {
+        destination[i] = (int32_t)((uint32_t)a[i] + (uint32_t)b[i]);
+    }
+}
+
+void vectorSubtract(int32_t* destination, const int32_t* a, const int32_t* b, int count) {
+    int i = 0;
+#ifdef VECTOR_AVX2
+    if (hasAvx2()) {
+        i = subtractAvx2(destination, a, b, count);
+    }
+#endif
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(destination + i), _mm_sub_epi32( \
+            _mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+    }
+#endif
+    for (; i < count; i++) {
+        destination[i] = (int32_t)((uint32_t)a[i] - (uint32_t)b[i]);
+    }
+}
+
+void vectorMultiply(int32_t* destination, const int32_t* a, const int32_t* b, int count) {
+    int i = 0;
+#ifdef VECTOR_AVX2
+    if (hasAvx2()) {
+        i = multiplyAvx2(destination, a, b, count);
+    }
+#endif
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(destination + i), multiplySse2( \
+            _mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+    }
+#endif
+    for (; i < count; i++) {
+        destination[i] = (int32_t)((uint32_t)a[i] * (uint32_t)b[i]);
+    }
+}
+
+void vectorFill(int32_t* destination, int32_t value, int count) {
+    int i = 0;
+#ifdef VECTOR_AVX2
+    if (hasAvx2()) {
+        i = fillAvx2(destination, value, count);
+    }
+#endif
+#ifdef __SSE2__
+    __m128i values = _mm_set1_epi32(value);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(destination + i), values);
+    }
+#endif
+    for (; i < count; i++) {
+        destination[i] = value;
+    }
+}
+
+int32_t vectorSum(const int32_t* values, int count) {
+    uint32_t sum = 0;
+    int i = 0;
+#ifdef VECTOR_AVX2
+    if (hasAvx2()) {
+        i = sumAvx2(values, count, &sum);
+    }
+#endif
+#ifdef __SSE2__
+    __m128i sums = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        sums = _mm_add_epi32(sums, _mm_loadu_si128((const __m128i*)(values + i)));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, sums);
+    sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < count; i++) {
+        sum += (uint32_t)values[i];
+    }
+    return (int32_t)sum;
+}
@@ -0,0 +1,62 @@
+#ifndef vector_h
+#define vector_h
+
+#include <stdint.h>
+
+/**
+ * Kernels of the vector instructions, run by the bus on blocks of global
+ * memory gathered into contiguous arrays. Arithmetic wraps around like the
+ * scalar opcodes. Each kernel uses AVX2 when the processor has it, SSE2
+ * otherwise, and plain loops on other architectures. The destination may
+ * be one of the sources.
+ */
+
+/**
+ * @brief Sets destination[i] to a[i] + b[i] for count elements.
+ *
+ * @param destination
+ * @param a
+ * @param b
+ * @param count
+ */
+void vectorAdd(int32_t* destination, const int32_t* a, const int32_t* b, int count);
+
+/**
+ * @brief Sets destination[i] to a[i] - b[i] for count elements.
+ *
+ * @param destination
+ * @param a
+ * @param b
+ * @param count
+ */
+void vectorSubtract(int32_t* destination, const int32_t* a, const int32_t* b, int count);
+
+/**
+ * @brief Sets destination[i] to a[i] * b[i] for count elements.
+ *
+ * @param destination
+ * @param a
+ * @param b
+ * @param count
+ */
+void vectorMultiply(int32_t* destination, const int32_t* a, const int32_t* b, int count);
+
+/**
+ * @brief Sets count elements of destination to value.
+ *
+ * @param destination
+ * @param value
+ * @param count
+ */
+void vectorFill(int32_t* destination, int32_t value, int count);
+
+/**
+ * @brief Returns the sum of count elements of values.
+ *
+ * @param values
+ * @param count
+ * @return int32_t
+ */
+int32_t vectorSum(const int32_t* values, int count);
+
+#endif
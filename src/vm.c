@@ -1,6 +1,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <stdarg.h>
@@ -10,10 +11,35 @@
 
 #include "compiler.h"
 #include "memmng.h"
+#include "trace.h"
 #include "vm.h"
 
+/**
+ * @brief Maps the frames and reserves the stack, with a guard page on both
+ * sides so running off either end faults. No page of the stack is
+ * accessible until push() needs it.
+ * 
+ * @param vm 
+ */
 static void initStack(VM* vm) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    vm->frames = (CallFrame*)mmap(NULL, sizeof(CallFrame) * FRAMES_CAPACITY, PROT_READ | PROT_WRITE, \
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    uint8_t* reserved = (uint8_t*)mmap(NULL, sizeof(Value) * STACK_CAPACITY + 2 * page, PROT_NONE, \
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (vm->frames == MAP_FAILED || reserved == MAP_FAILED) {
+        perror("Could not map the stack");
+        exit(-1);
+    }
+    vm->stack = (Value*)(reserved + page);
     vm->stackTop = vm->stack;
+    vm->stackLimit = vm->stack;
+}
+
+static void freeStack(VM* vm) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    munmap(vm->frames, sizeof(CallFrame) * FRAMES_CAPACITY);
+    munmap((uint8_t*)vm->stack - page, sizeof(Value) * STACK_CAPACITY + 2 * page);
 }
 
 static void runtimeError(VM* vm, const char* format, ...) {
@@ -27,7 +53,7 @@ static void runtimeError(VM* vm, const char* format, ...) {
         CallFrame* frame = &vm->frames[i];
         FunctionObject* function = frame->function;
         size_t instruction = frame->ip - function->sequence.code - 1;
-        printf("--line %d-- in ", function->sequence.lines[instruction]);
+        printf("--line %d-- in ", getLineNumber(&function->sequence, (int)instruction));
         if (function->name == NULL) {
             printf("main program\n");
         } else {
@@ -38,22 +64,52 @@ static void runtimeError(VM* vm, const char* format, ...) {
 
 void initVM(VM* vm) {
     initStack(vm);
-    vm->objects = NULL;
+    initHeap(&vm->heap);
     vm->frameCount = 0;
-    initTable(&vm->strings);
+    initInternTable(&vm->strings);
     initCache(&vm->cache);
     vm->clock = 0;
+    initCycleCounter(&vm->cycles);
+    vm->profiler = NULL;
+    vm->image = NULL;
+    vm->imageSize = 0;
 }
 
 void freeVM(VM* vm) {
-    freeTable(&vm->strings);
-    freeObjects(vm->objects);
+    freeStack(vm);
+    freeInternTable(&vm->strings);
+    freeHeap(&vm->heap);
     freeCache(&vm->cache);
+    if (vm->profiler != NULL) {
+        freeProfiler(vm->profiler);
+        vm->profiler = NULL;
+    }
+    if (vm->image != NULL) {
+        munmap(vm->image, vm->imageSize);
+        vm->image = NULL;
+    }
 }
 
-void push(VM* vm, Value value) {
+static bool growStack(VM* vm) {
+    if (vm->stackLimit == vm->stack + STACK_CAPACITY) {
+        runtimeError(vm, "Stack overflow.");
+        return false;
+    }
+    if (mprotect(vm->stackLimit, sizeof(Value) * STACK_CHUNK, PROT_READ | PROT_WRITE) == -1) {
+        perror("Could not grow the stack");
+        exit(-1);
+    }
+    vm->stackLimit += STACK_CHUNK;
+    return true;
+}
+
+bool push(VM* vm, Value value) {
+    if (vm->stackTop == vm->stackLimit && !growStack(vm)) {
+        return false;
+    }
     *vm->stackTop = value;
     vm->stackTop++;
+    return true;
 }
 
 Value pop(VM* vm) {
@@ -76,37 +132,28 @@ static bool call(VM* vm, FunctionObject* function) {
     return true;
 }
 
-static bool callValue(VM* vm, Value callee) {
-    if (callee.as.obj->type == FUNCTION_OBJECT) {
-        return call(vm, (FunctionObject*)callee.as.obj);
-    }
-    runtimeError(vm, "Can only call functions.");
-    return false;
+static uint32_t traceId(Value id) {
+    return isObject(id) ? ((String*)asObject(id))->hash : (uint32_t)asNumber(id);
 }
 
-// Clock should belong to the main method of running program
-static int replaceLRU(Cache* cache, int* clock) {
-    // puts("In replace");
-    int minIndex = 0;
-    for (int i = 1; i < 3; i++) {
-        if (cache->lastUsed[minIndex] > cache->lastUsed[i]) {
-            minIndex = i;
-        }
-    }
-    cache->lastUsed[minIndex] = *clock;
-    (*clock)++;
-    // puts("After replace");
-    return minIndex;
+static int traceFlags(Value id) {
+    return isObject(id) ? 0 : TRACE_BY_ADDRESS;
 }
 
 static bool sendBusRead(int socket_fd, Value id, VM* vm, int lineIndex) {
     // puts("In read");
+    traceRecord(TRACE_BUS_READ, 0, traceId(id), INVALID, SHARED, traceFlags(id));
+    chargeTransfers(&vm->cycles);
+    chargeCycles(&vm->cycles, costModel.arbitration);
+    if (vm->profiler != NULL) {
+        profileMiss(vm->profiler);
+    }
     char buffer[1024] = "1 ";
     int i, address, altAddress, upperB, lowerB, altUB, altLB;
     Value value;
     String *key, *recKey;
-    if (id.type == OBJ_VALUE) {     // If String -> name
-        key = (String*)id.as.obj;
+    if (isObject(id)) {     // If String -> name
+        key = (String*)asObject(id);
         for (i = 0; i < key->length && i < 1021; i++) {
             buffer[i + 2] = key->characters[i];
         }
@@ -116,7 +163,7 @@ static bool sendBusRead(int socket_fd, Value id, VM* vm, int lineIndex) {
         buffer[2] = ' ';
         char temp[64];
         memset(temp, '\0', sizeof(temp));
-        sprintf(temp, "%d", id.as.number);
+        sprintf(temp, "%d", asNumber(id));
         for (i = 0; temp[i] != '\0'; i++) {
             buffer[i + 3] = temp[i];
         }
@@ -135,7 +182,7 @@ static bool sendBusRead(int socket_fd, Value id, VM* vm, int lineIndex) {
     // printf("Read: %s\n", buffer);
 
     // If number, read name first, then read data as normal
-    if (id.type == NUM_VALUE) {  
+    if (isNumber(id)) {  
         i = 0; 
         char name[1024];  
         while (buffer[i] != '\0') {
@@ -143,7 +190,7 @@ static bool sendBusRead(int socket_fd, Value id, VM* vm, int lineIndex) {
             i++;
         }
         name[i] = '\0';
-        recKey = copyString(&vm->strings, vm->objects, name, i);
+        recKey = copyString(&vm->strings, &vm->heap, name, i);
         // Read data now
         memset(buffer, '\0', sizeof(buffer));
         if (read(socket_fd, buffer, sizeof(buffer)) <= 0) {
@@ -152,14 +199,16 @@ static bool sendBusRead(int socket_fd, Value id, VM* vm, int lineIndex) {
         }
         // printf("Read: %s\n", buffer);
     }
+    // The line comes from the other cache when it held it modified
+    chargeCycles(&vm->cycles, buffer[REPLY_SUPPLIED] ? costModel.transfer : costModel.memory);
     // puts("Getting data from bus");
     i = 0;
     // return false for entry not set in memory
     if (memcmp(buffer, "nfd", 3) == 0) {
         return false;
     } else {    // set cache values
-        if (id.type == OBJ_VALUE) {
-            recKey = copyString(&vm->strings, vm->objects, key->characters, key->length);
+        if (isObject(id)) {
+            recKey = copyString(&vm->strings, &vm->heap, key->characters, key->length);
         }
         // puts("Reading address");
         int j = 0;
@@ -176,7 +225,7 @@ static bool sendBusRead(int socket_fd, Value id, VM* vm, int lineIndex) {
         while (buffer[i] != ' ') {
             temp[j++] = buffer[i++];
         }
-        value = (Value){NUM_VALUE, {.number = atoi(temp)}};
+        value = numberValue(atoi(temp));
         // Read upper bound
         i++, j = 0;
         memset(temp, '\0', sizeof(temp));
@@ -245,12 +294,18 @@ static bool sendBusRead(int socket_fd, Value id, VM* vm, int lineIndex) {
 
 static bool sendBusReadX(int socket_fd, Value id, VM* vm, int lineIndex) {
     // puts("In read x");
+    traceRecord(TRACE_BUS_READ_X, 0, traceId(id), INVALID, MODIFIED, traceFlags(id));
+    chargeTransfers(&vm->cycles);
+    chargeCycles(&vm->cycles, costModel.arbitration);
+    if (vm->profiler != NULL) {
+        profileMiss(vm->profiler);
+    }
     char buffer[1024] = "2 ";
     int i, address, altAddress, upperB, lowerB, altUB, altLB;
     Value value;
     String *key, *recKey;
-    if (id.type == OBJ_VALUE) {     // If String -> name
-        key = (String*)id.as.obj;
+    if (isObject(id)) {     // If String -> name
+        key = (String*)asObject(id);
         for (i = 0; i < key->length && i < 1021; i++) {
             buffer[i + 2] = key->characters[i];
         }
@@ -260,7 +315,7 @@ static bool sendBusReadX(int socket_fd, Value id, VM* vm, int lineIndex) {
         buffer[2] = ' ';
         char temp[64];
         memset(temp, '\0', sizeof(temp));
-        sprintf(temp, "%d", id.as.number);
+        sprintf(temp, "%d", asNumber(id));
         for (i = 0; temp[i] != '\0'; i++) {
             buffer[i + 3] = temp[i];
         }
@@ -279,7 +334,7 @@ static bool sendBusReadX(int socket_fd, Value id, VM* vm, int lineIndex) {
     }
     // printf("Read: %s\n", buffer);
     // If number, read name first, then read data as normal
-    if (id.type == NUM_VALUE) {  
+    if (isNumber(id)) {  
         i = 0; 
         char name[1024];  
         while (buffer[i] != '\0') {
@@ -287,7 +342,7 @@ static bool sendBusReadX(int socket_fd, Value id, VM* vm, int lineIndex) {
             i++;
         }
         name[i] = '\0';
-        recKey = copyString(&vm->strings, vm->objects, name, i);
+        recKey = copyString(&vm->strings, &vm->heap, name, i);
         // Read data now
         memset(buffer, '\0', sizeof(buffer));
         if (read(socket_fd, buffer, sizeof(buffer)) <= 0) {
@@ -296,14 +351,15 @@ static bool sendBusReadX(int socket_fd, Value id, VM* vm, int lineIndex) {
         }
         // printf("Read: %s\n", buffer);
     }
+    chargeCycles(&vm->cycles, buffer[REPLY_SUPPLIED] ? costModel.transfer : costModel.memory);
 
     i = 0;
     // return false for entry not set in memory
     if (memcmp(buffer, "nfd", 3) == 0) {
         return false;
     } else {    // set cache values
-        if (id.type == OBJ_VALUE) {
-            recKey = copyString(&vm->strings, vm->objects, key->characters, key->length);
+        if (isObject(id)) {
+            recKey = copyString(&vm->strings, &vm->heap, key->characters, key->length);
         }
         int j = 0;
         char temp[64];
@@ -319,7 +375,7 @@ static bool sendBusReadX(int socket_fd, Value id, VM* vm, int lineIndex) {
         while (buffer[i] != ' ') {
             temp[j++] = buffer[i++];
         }
-        value = (Value){NUM_VALUE, {.number = atoi(temp)}};
+        value = numberValue(atoi(temp));
         // Read upper bound
         i++, j = 0;
         memset(temp, '\0', sizeof(temp));
@@ -383,10 +439,11 @@ static bool sendBusReadX(int socket_fd, Value id, VM* vm, int lineIndex) {
 
 void invalidate(int socket_fd, Value id) {
     // puts("In invalidate()");
+    traceRecord(TRACE_INVALIDATE, 0, traceId(id), SHARED, MODIFIED, traceFlags(id));
     char buffer[1024] = "0 ";
     int i = 0;
-    if (id.type == OBJ_VALUE) {     // Invalidate by name
-        String* name = (String*)id.as.obj;
+    if (isObject(id)) {     // Invalidate by name
+        String* name = (String*)asObject(id);
         for (i = 0; i < name->length && i < 1021; i++) {
             buffer[i + 2] = name->characters[i];
         }
@@ -396,7 +453,7 @@ void invalidate(int socket_fd, Value id) {
         buffer[2] = ' ';
         char temp[64];
         memset(temp, '\0', sizeof(temp));
-        sprintf(temp, "%d", id.as.number);
+        sprintf(temp, "%d", asNumber(id));
         for (i = 0; temp[i] != '\0'; i++) {
             buffer[i + 3] = temp[i];
         }
@@ -411,6 +468,7 @@ void invalidate(int socket_fd, Value id) {
 }
 
 void sendWriteBack(int socket_fd, int address, Value value) {
+    traceRecord(TRACE_WRITE_BACK, 0, (uint32_t)address, MODIFIED, INVALID, TRACE_BY_ADDRESS);
     char buffer[1024] = "3 ", temp[64];
     memset(temp, '\0', sizeof(temp));
     sprintf(temp, "%d", address);
@@ -420,7 +478,7 @@ void sendWriteBack(int socket_fd, int address, Value value) {
     }
     buffer[i++] = ' ';
     memset(temp, '\0', sizeof(temp));
-    sprintf(temp, "%d", value.as.number);
+    sprintf(temp, "%d", asNumber(value));
     j = 0;
     while (temp[j] != '\0') {
         buffer[i++] = temp[j++];
@@ -432,11 +490,287 @@ void sendWriteBack(int socket_fd, int address, Value value) {
     }
 }
 
+static bool readBytes(int socket_fd, void* bytes, size_t size) {
+    // Bulk replies are larger than what a single read returns
+    for (size_t done = 0; done < size;) {
+        ssize_t valread = read(socket_fd, (char*)bytes + done, size - done);
+        if (valread <= 0) {
+            return false;
+        }
+        done += valread;
+    }
+    return true;
+}
+
+/**
+ * @brief Sends the request of a bulk transfer of count values, starting at
+ * the variable of the given name or at the given address.
+ * 
+ * @param socket_fd 
+ * @param type '4' for a bulk read, '5' for a bulk write
+ * @param id 
+ * @param count 
+ */
+static void sendBulkRequest(int socket_fd, char type, Value id, int count) {
+    char buffer[1024] = {0};
+    if (isObject(id)) {
+        String* name = (String*)asObject(id);
+        snprintf(buffer, sizeof(buffer), "%c %.*s %d", type, name->length, name->characters, count);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%ca %d %d", type, asNumber(id), count);
+    }
+    if (write(socket_fd, buffer, 1024) <= 0) {
+        perror("Could not write to bus");
+        exit(-1);
+    }
+}
+
+/**
+ * @brief Reads count values of global memory in one transaction and pushes
+ * them, the first one deepest. Returns false if the range is not within
+ * one block of memory. The values bypass the cache.
+ * 
+ * @param socket_fd 
+ * @param vm 
+ * @param id 
+ * @param count 
+ * @return true 
+ * @return false 
+ */
+static bool sendBulkRead(int socket_fd, VM* vm, Value id, int count) {
+    traceRecord(TRACE_BULK_READ, 0, traceId(id), INVALID, INVALID, traceFlags(id));
+    chargeCycles(&vm->cycles, costModel.arbitration + costModel.memory);
+    if (vm->profiler != NULL) {
+        profileMiss(vm->profiler);
+    }
+    sendBulkRequest(socket_fd, '4', id, count);
+    char buffer[1024];
+    if (!readBytes(socket_fd, buffer, sizeof(buffer))) {
+        perror("Could not read from bus");
+        exit(-1);
+    }
+    if (memcmp(buffer, "nfd", 3) == 0) {
+        return false;
+    }
+    int32_t* values = (int32_t*)reallocate(NULL, 0, sizeof(int32_t) * count);
+    if (!readBytes(socket_fd, values, sizeof(int32_t) * count)) {
+        perror("Could not read from bus");
+        exit(-1);
+    }
+    for (int i = 0; i < count; i++) {
+        push(vm, numberValue(values[i]));
+    }
+    reallocate(values, sizeof(int32_t) * count, 0);
+    return true;
+}
+
+/**
+ * @brief Invalidates the lines of the cache the bus wrote, listed at the
+ * end of its reply as their count followed by the addresses they are
+ * stored at, which differ from the written ones for an alias. A count of
+ * -1 invalidates every line.
+ * 
+ * @param vm 
+ * @param list 
+ */
+static void invalidateWritten(VM* vm, const char* list) {
+    char* end;
+    int count = (int)strtol(list, &end, 10);
+    for (int i = 0; i < 3 && count == -1; i++) {
+        vm->cache.states[i] = INVALID;
+    }
+    for (int n = 0; n < count; n++) {
+        int address = (int)strtol(end, &end, 10);
+        for (int i = 0; i < 3; i++) {
+            if (vm->cache.entries[i].address == address) {
+                vm->cache.states[i] = INVALID;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Writes count values to global memory in one transaction, every
+ * cached copy of them is invalidated, including those of this core, which
+ * would otherwise be written back over them. Returns false if the range is
+ * not within one block of memory.
+ * 
+ * @param socket_fd 
+ * @param vm 
+ * @param id 
+ * @param values 
+ * @param count 
+ * @return true 
+ * @return false 
+ */
+static bool sendBulkWrite(int socket_fd, VM* vm, Value id, const Value* values, int count) {
+    traceRecord(TRACE_BULK_WRITE, 0, traceId(id), INVALID, INVALID, traceFlags(id));
+    chargeCycles(&vm->cycles, costModel.arbitration + costModel.memory);
+    if (vm->profiler != NULL) {
+        profileMiss(vm->profiler);
+    }
+    int32_t* numbers = (int32_t*)reallocate(NULL, 0, sizeof(int32_t) * count);
+    for (int i = 0; i < count; i++) {
+        numbers[i] = asNumber(values[i]);
+    }
+    sendBulkRequest(socket_fd, '5', id, count);
+    if (write(socket_fd, numbers, sizeof(int32_t) * count) < (ssize_t)(sizeof(int32_t) * count)) {
+        perror("Could not write to bus");
+        exit(-1);
+    }
+    reallocate(numbers, sizeof(int32_t) * count, 0);
+    char buffer[1024];
+    if (!readBytes(socket_fd, buffer, sizeof(buffer))) {
+        perror("Could not read from bus");
+        exit(-1);
+    }
+    if (memcmp(buffer, "ok", 2) != 0) {
+        return false;
+    }
+    // "ok", the first address, then the lines written
+    invalidateWritten(vm, strchr(buffer + 3, ' '));
+    return true;
+}
+
+// Kind of each vector instruction in its message, and its number of operands
+static const char* vectorKinds[] = {"add", "sub", "mul", "fill", "copy", "sum"};
+static const int vectorOperands[] = {3, 3, 3, 2, 2, 1};
+
+/**
+ * @brief Runs a vector instruction at the bus, over count values from each
+ * operand on. The first operand is the destination, except for a sum,
+ * whose result is set. The second operand of a fill is the value. Returns
+ * false if a range is not within one block of memory.
+ * 
+ * @param socket_fd 
+ * @param vm 
+ * @param opcode 
+ * @param operands 
+ * @param count 
+ * @param result 
+ * @return true 
+ * @return false 
+ */
+static bool sendVector(int socket_fd, VM* vm, uint8_t opcode, const Value* operands, int count, int* result) {
+    traceRecord(TRACE_VECTOR, 0, traceId(operands[0]), INVALID, INVALID, traceFlags(operands[0]));
+    chargeCycles(&vm->cycles, costModel.arbitration + costModel.memory);
+    if (vm->profiler != NULL) {
+        profileMiss(vm->profiler);
+    }
+    char buffer[1024] = {0};
+    int length = snprintf(buffer, sizeof(buffer), "6 %s %d", vectorKinds[opcode - OP_VECTOR_ADD], count);
+    for (int i = 0; i < vectorOperands[opcode - OP_VECTOR_ADD] && length < (int)sizeof(buffer); i++) {
+        if (isObject(operands[i])) {
+            String* name = (String*)asObject(operands[i]);
+            length += snprintf(buffer + length, sizeof(buffer) - length, " %.*s", name->length, name->characters);
+        } else {
+            length += snprintf(buffer + length, sizeof(buffer) - length, " %d", asNumber(operands[i]));
+        }
+    }
+    if (length >= (int)sizeof(buffer)) {
+        // Names too long for a message are not in memory either
+        return false;
+    }
+    if (write(socket_fd, buffer, 1024) <= 0) {
+        perror("Could not write to bus");
+        exit(-1);
+    }
+    if (!readBytes(socket_fd, buffer, sizeof(buffer))) {
+        perror("Could not read from bus");
+        exit(-1);
+    }
+    if (memcmp(buffer, "ok", 2) != 0) {
+        return false;
+    }
+    *result = atoi(buffer + 3);
+    if (opcode != OP_VECTOR_SUM) {
+        invalidateWritten(vm, strchr(buffer + 3, ' '));
+    }
+    return true;
+}
+
+// Kind of each atomic instruction in its message, and its number of arguments after the target
+static const char* atomicKinds[] = {"add", "cas", "xchg"};
+static const int atomicArguments[] = {1, 2, 1};
+
+/**
+ * @brief Runs an atomic instruction at the bus on the global target, and
+ * sets previous to its value before. The line holding it is invalidated
+ * if it was written, the bus has the only up to date copy. Returns false
+ * if target is not in memory.
+ * 
+ * @param socket_fd 
+ * @param vm 
+ * @param opcode 
+ * @param target 
+ * @param arguments 
+ * @param previous 
+ * @return true 
+ * @return false 
+ */
+static bool sendAtomic(int socket_fd, VM* vm, uint8_t opcode, Value target, const Value* arguments, int* previous) {
+    traceRecord(TRACE_ATOMIC, 0, traceId(target), INVALID, INVALID, traceFlags(target));
+    chargeCycles(&vm->cycles, costModel.arbitration + costModel.memory);
+    if (vm->profiler != NULL) {
+        profileMiss(vm->profiler);
+    }
+    char buffer[1024] = {0};
+    const char* kind = atomicKinds[opcode - OP_FETCH_ADD];
+    int length;
+    if (isObject(target)) {
+        String* name = (String*)asObject(target);
+        length = snprintf(buffer, sizeof(buffer), "7 %s %.*s", kind, name->length, name->characters);
+    } else {
+        length = snprintf(buffer, sizeof(buffer), "7 %s %d", kind, asNumber(target));
+    }
+    for (int i = 0; i < atomicArguments[opcode - OP_FETCH_ADD] && length < (int)sizeof(buffer); i++) {
+        length += snprintf(buffer + length, sizeof(buffer) - length, " %d", asNumber(arguments[i]));
+    }
+    if (length >= (int)sizeof(buffer)) {
+        return false;
+    }
+    if (write(socket_fd, buffer, 1024) <= 0) {
+        perror("Could not write to bus");
+        exit(-1);
+    }
+    if (!readBytes(socket_fd, buffer, sizeof(buffer))) {
+        perror("Could not read from bus");
+        exit(-1);
+    }
+    int address, end;
+    if (memcmp(buffer, "ok", 2) != 0 || sscanf(buffer + 3, "%d %d%n", &address, previous, &end) != 2) {
+        return false;
+    }
+    // None listed if a compare failed
+    invalidateWritten(vm, buffer + 3 + end);
+    return true;
+}
+
+/**
+ * @brief Returns what a bulk transfer at target names: the address a
+ * pointer local points to, or else target itself, the name of a global or
+ * an address computed by OP_ADD.
+ * 
+ * @param frame 
+ * @param target 
+ * @return Value 
+ */
+static Value bulkTarget(CallFrame* frame, Value target) {
+    Value value;
+    if (isObject(target)) {
+        int address = tableGetValue(&frame->locals, (String*)asObject(target), &value);
+        if (address >= 0) {
+            return numberValue(address);
+        }
+    }
+    return target;
+}
+
 static int findLineByName(Action action, int socket_fd, VM* vm, Value name) {
     // puts("Find by name");
-    // printf("Name: %s\n", ((String*)name.as.obj)->characters);
+    // printf("Name: %s\n", ((String*)asObject(name))->characters);
     for (int index = 0; index < 3; index++) {
-        if (vm->cache.entries[index].key == (String*)name.as.obj) {  // normal hit
+        if (vm->cache.entries[index].key == (String*)asObject(name)) {  // normal hit
             // puts("After find line success - no read");
             return index;
         } else if (vm->cache.entries[index].key == NULL) {   // cache is not full
@@ -472,8 +806,8 @@ static int findLineByName(Action action, int socket_fd, VM* vm, Value name) {
 static int findLineByAddress(Action action, int socket_fd, VM* vm, Value address) {
     // puts("Find by address");
     for (int index = 0; index < 3; index++) {
-        if (vm->cache.entries[index].address == address.as.number || \
-            vm->cache.addressData[index][2] == address.as.number) {  // normal hit
+        if (vm->cache.entries[index].address == asNumber(address) || \
+            vm->cache.addressData[index][2] == asNumber(address)) {  // normal hit
             // puts("After find line success - no read");
             // if (vm->cache.states[index] == INVALID) {
             //     sendBusRead(socket_fd, address, vm, index);
@@ -512,8 +846,9 @@ static int findLineByAddress(Action action, int socket_fd, VM* vm, Value address
 
 int getLine(int socket_fd, VM* vm, Value id) {
     // puts("In get line");
-    int index;
-    if (id.type == OBJ_VALUE) {
+    int index, lineCount = vm->cache.count;
+    State previous = INVALID;
+    if (isObject(id)) {
         // puts("Find by name");
         index = findLineByName(PROCESSOR_READ, socket_fd, vm, id);
     } else {
@@ -522,11 +857,19 @@ int getLine(int socket_fd, VM* vm, Value id) {
     // If found
     if (index >= 0) {
         // pthread_mutex_lock(&vm->cache.lineLock[index]);
-        if (vm->cache.states[index] == INVALID) { // If invalid trigger a bus read
+        if (vm->cache.count == lineCount) {     // Line was not filled by findLine
+            previous = vm->cache.states[index];
+        }
+        BusAction busAction;
+        State next = processorTransition(PROTOCOL_MSI, vm->cache.states[index], \
+            PROCESSOR_READ, true, &busAction);
+        if (busAction == BUS_READ) { // If invalid trigger a bus read
             // If in cache, it is already in memory
             sendBusRead(socket_fd, id, vm, index);
-            vm->cache.states[index] = SHARED;
-        }    
+        } else if (vm->cache.count == lineCount) {
+            chargeCycles(&vm->cycles, costModel.hit);
+        }
+        vm->cache.states[index] = next;
         // pthread_mutex_unlock(&vm->cache.lineLock[index]);   
     } else {    // Normal miss
         // Get LRU line
@@ -540,15 +883,20 @@ int getLine(int socket_fd, VM* vm, Value id) {
             if (vm->cache.states[index] == MODIFIED) {
                 // pthread_mutex_unlock(&vm->cache.lineLock[index]);
                 sendWriteBack(socket_fd, address, val);
+                chargeCycles(&vm->cycles, costModel.arbitration + costModel.memory);
                 // pthread_mutex_lock(&vm->cache.lineLock[index]);
             }
             vm->cache.states[index] = SHARED;
             // pthread_mutex_unlock(&vm->cache.lineLock[index]);
         } else {    // If not found in memory
             // puts("After get line");
+            traceRecord(TRACE_PROCESSOR_READ, 0, traceId(id), INVALID, INVALID, \
+                traceFlags(id) | TRACE_NOT_FOUND);
             return -1;
         }
     }
+    traceRecord(TRACE_PROCESSOR_READ, 0, traceId(id), previous, vm->cache.states[index], \
+        traceFlags(id) | (previous != INVALID ? TRACE_HIT : 0));
     // puts("After get line");
     // printf("Index: %d\n", index);
     return index;
@@ -557,8 +905,9 @@ int getLine(int socket_fd, VM* vm, Value id) {
 // Change to handle address too------------------------------------
 int setLine(int socket_fd, VM* vm, Value id, Value value) {
     // puts("In set Line");
-    int index;
-    if (id.type == OBJ_VALUE) {
+    int index, lineCount = vm->cache.count;
+    State previous = INVALID;
+    if (isObject(id)) {
         index = findLineByName(PROCESSOR_WRITE, socket_fd, vm, id);
     } else {
         index = findLineByAddress(PROCESSOR_WRITE, socket_fd, vm, id);
@@ -566,19 +915,26 @@ int setLine(int socket_fd, VM* vm, Value id, Value value) {
     // If found 
     if (index >= 0) {
         // pthread_mutex_lock(&vm->cache.lineLock[index]);
-        if (vm->cache.states[index] == MODIFIED) {     // Normal hit
-            vm->cache.entries[index].value = value;
-        } else if (vm->cache.states[index] == SHARED) {    // Coherence
+        if (vm->cache.count == lineCount) {     // Line was not filled by findLine
+            previous = vm->cache.states[index];
+        }
+        BusAction busAction;
+        State next = processorTransition(PROTOCOL_MSI, vm->cache.states[index], \
+            PROCESSOR_WRITE, true, &busAction);
+        if (busAction == BUS_UPGRADE) {     // Coherence
             invalidate(socket_fd, id);
-            // sendBusReadX(socket_fd, name, cache, index);
-            vm->cache.entries[index].value = value;
-            vm->cache.states[index] = MODIFIED;
-        } else if (vm->cache.states[index] == INVALID) {   // Normal miss
+            chargeCycles(&vm->cycles, costModel.arbitration + costModel.invalidation);
+            if (vm->profiler != NULL) {
+                profileMiss(vm->profiler);
+            }
+        } else if (busAction == BUS_READ_X) {   // Normal miss
             // Place write miss on bus 
             sendBusReadX(socket_fd, id, vm, index);
-            vm->cache.entries[index].value = value;
-            vm->cache.states[index] = MODIFIED;            
+        } else if (vm->cache.count == lineCount) {
+            chargeCycles(&vm->cycles, costModel.hit);
         }
+        vm->cache.entries[index].value = value;
+        vm->cache.states[index] = next;
         // pthread_mutex_unlock(&vm->cache.lineLock[index]);
     } else {    // Normal miss
         // Get LRU line
@@ -591,15 +947,20 @@ int setLine(int socket_fd, VM* vm, Value id, Value value) {
             // pthread_mutex_lock(&vm->cache.lineLock[index]);
             if (vm->cache.states[index] == MODIFIED) {
                 sendWriteBack(socket_fd, address, val);
+                chargeCycles(&vm->cycles, costModel.arbitration + costModel.memory);
             }
             vm->cache.entries[index].value = value;
             vm->cache.states[index] = MODIFIED;
             // pthread_mutex_unlock(&vm->cache.lineLock[index]);
         } else {    // If not found in memory
             // puts("After set line");
+            traceRecord(TRACE_PROCESSOR_WRITE, 0, traceId(id), INVALID, INVALID, \
+                traceFlags(id) | TRACE_NOT_FOUND);
             return -1;
         }
     }
+    traceRecord(TRACE_PROCESSOR_WRITE, 0, traceId(id), previous, MODIFIED, \
+        traceFlags(id) | (previous == MODIFIED ? TRACE_HIT : 0));
     // puts("After set line");
     return index;
 }
@@ -610,6 +971,7 @@ static InterpretResult run(int socket_fd, VM* vm) {
     int address;
     CallFrame* frame = &vm->frames[vm->frameCount - 1];
     CallFrame* tempFrame = frame;
+    int wide = 0;
     for (;;) {
         // printf("\nCache contents: \n");
         // for (int i = 0; i < 3; i++) {
@@ -625,12 +987,24 @@ static InterpretResult run(int socket_fd, VM* vm) {
         //     }
         // }
         // sleep(1);
+        traceRecord(TRACE_INSTRUCTION, 0, (uint32_t)(frame->ip - frame->function->sequence.code), \
+            INVALID, INVALID, *frame->ip);
+        if (timingEnabled) {
+            countInstruction(&vm->cycles, *frame->ip);
+        }
+        if (vm->profiler != NULL) {
+            profileInstruction(vm->profiler, frame->function, \
+                (int)(frame->ip - frame->function->sequence.code), *frame->ip);
+        }
+        // High byte of the constant index, only set right after OP_WIDE
+        int high = wide;
+        wide = 0;
         uint8_t instruction;
         switch (instruction = (*frame->ip++)) {
             case OP_LVALUE: {
                 // puts("In lvalue");
-                Value name = frame->function->sequence.constants.values[*frame->ip++];
-                Value val = (Value){NUM_VALUE, {.number = 0}};
+                Value name = frame->function->sequence.constants.values[high | *frame->ip++];
+                Value val = numberValue(0);
                 // pthread_mutex_lock(&vm->vmLock);
                 // while (!vm->vmRun) {
                 //     pthread_cond_wait(&vm->vmCond, &vm->vmLock);
@@ -641,12 +1015,12 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 // puts("Run acquired mutex");
                 if (getLine(socket_fd, vm, name) == -1) {
                     if (!inReturn) {
-                        if (tableGetValue(&tempFrame->locals, (String*)name.as.obj, &val) == -1) {
-                            tableSetValue(&tempFrame->locals, (String*)name.as.obj, val);
+                        if (tableGetValue(&tempFrame->locals, (String*)asObject(name), &val) == -1) {
+                            tableSetValue(&tempFrame->locals, (String*)asObject(name), val);
                         }
                     } else {
-                        if (tableGetValue(&frame->locals, (String*)name.as.obj, &val) == -1) {
-                            tableSetValue(&frame->locals, (String*)name.as.obj, val);
+                        if (tableGetValue(&frame->locals, (String*)asObject(name), &val) == -1) {
+                            tableSetValue(&frame->locals, (String*)asObject(name), val);
                         }
                     }
                 }
@@ -656,14 +1030,16 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 // vm->snoopRun = 1;
                 // pthread_cond_signal(&vm->snoopCond);
                 // pthread_mutex_unlock(&vm->snoopLock);
-                push(vm, name);
+                if (!push(vm, name)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
                 // puts("After lvalue");
                 break;
             }
             case OP_RVALUE: {
                 // puts("In rvalue");
-                Value name = frame->function->sequence.constants.values[*frame->ip++];
-                Value val = (Value){NUM_VALUE, {.number = 0}};
+                Value name = frame->function->sequence.constants.values[high | *frame->ip++];
+                Value val = numberValue(0);
                 // pthread_mutex_lock(&vm->vmLock);
                 // while (!vm->vmRun) {
                 //     pthread_cond_wait(&vm->vmCond, &vm->vmLock);
@@ -675,12 +1051,12 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 int index = getLine(socket_fd, vm, name);
                 if (index == -1) {
                     if (!inReturn) {
-                        if (tableGetValue(&frame->locals, (String*)name.as.obj, &val) == -1) {
-                            tableSetValue(&frame->locals, (String*)name.as.obj, val);
+                        if (tableGetValue(&frame->locals, (String*)asObject(name), &val) == -1) {
+                            tableSetValue(&frame->locals, (String*)asObject(name), val);
                         }
                     } else {
-                        if (tableGetValue(&tempFrame->locals, (String*)name.as.obj, &val) == -1) {
-                            tableSetValue(&tempFrame->locals, (String*)name.as.obj, val);
+                        if (tableGetValue(&tempFrame->locals, (String*)asObject(name), &val) == -1) {
+                            tableSetValue(&tempFrame->locals, (String*)asObject(name), val);
                         }
                     }
                 } else {    // If found in global memory
@@ -694,7 +1070,9 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 // vm->snoopRun = 1;
                 // pthread_cond_signal(&vm->snoopCond);
                 // pthread_mutex_unlock(&vm->snoopLock);
-                push(vm, val);
+                if (!push(vm, val)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
                 // puts("After rvalue");
                 break;
             }
@@ -702,7 +1080,7 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 // puts("In add");
                 Value b = pop(vm);
                 Value a = pop(vm);
-                if (a.type == OBJ_VALUE) {
+                if (isObject(a)) {
                     // pthread_mutex_lock(&vm->vmLock);
                     // while (!vm->vmRun) {
                     //     pthread_cond_wait(&vm->vmCond, &vm->vmLock);
@@ -714,24 +1092,24 @@ static InterpretResult run(int socket_fd, VM* vm) {
                     int index = getLine(socket_fd, vm, a);
                     Value val;
                     if (index == -1) {      // If not defined in global memory
-                        address = tableGetValue(&frame->locals, (String*)a.as.obj, &val);
+                        address = tableGetValue(&frame->locals, (String*)asObject(a), &val);
                         if (address < 0) {          // If not found in local memory either
                             runtimeError(vm, "Variable doesn't have an address");
                         } else {
-                            index = getLine(socket_fd, vm, (Value){NUM_VALUE, {.number = address}});
+                            index = getLine(socket_fd, vm, numberValue(address));
                         }
                     }
                     // If out of bounds
                     // pthread_mutex_lock(&vm->cache.lineLock[index]);
-                    if (vm->cache.entries[index].address + b.as.number > vm->cache.addressData[index][0]) {
+                    if (vm->cache.entries[index].address + asNumber(b) > vm->cache.addressData[index][0]) {
                         // index = vm->cache.addressData[index][2];
-                        if (vm->cache.addressData[index][2] + b.as.number > vm->cache.addressData[index][3]) {
+                        if (vm->cache.addressData[index][2] + asNumber(b) > vm->cache.addressData[index][3]) {
                             runtimeError(vm, "Cannot access memory location");
                         } else {
-                            push(vm, (Value){NUM_VALUE, {.number = vm->cache.addressData[index][2] + b.as.number}});
+                            push(vm, numberValue(vm->cache.addressData[index][2] + asNumber(b)));
                         }
                     } else {
-                        push(vm, (Value){NUM_VALUE, {.number = vm->cache.entries[index].address + b.as.number}});
+                        push(vm, numberValue(vm->cache.entries[index].address + asNumber(b)));
                     }
                     // pthread_mutex_unlock(&vm->cache.lineLock[index]);
                     // puts("Run released mutex");
@@ -742,7 +1120,7 @@ static InterpretResult run(int socket_fd, VM* vm) {
                     // pthread_mutex_unlock(&vm->snoopLock);
                     isNumAddress = true;
                 } else {
-                    push(vm, (Value){NUM_VALUE, {.number = (a.as.number + b.as.number)}});
+                    push(vm, numberValue(asNumber(a) + asNumber(b)));
                 }
                 // puts("After add");
                 break;
@@ -751,7 +1129,7 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 // puts("In sub");
                 Value b = pop(vm);
                 Value a = pop(vm);
-                if (a.type == OBJ_VALUE) {
+                if (isObject(a)) {
                     // pthread_mutex_lock(&vm->vmLock);
                     // while (!vm->vmRun) {
                     //     pthread_cond_wait(&vm->vmCond, &vm->vmLock);
@@ -763,23 +1141,23 @@ static InterpretResult run(int socket_fd, VM* vm) {
                     int index = getLine(socket_fd, vm, a);
                     Value val;
                     if (index == -1) {    // If not defined in global memory 
-                        address = tableGetValue(&frame->locals, (String*)a.as.obj, &val);
+                        address = tableGetValue(&frame->locals, (String*)asObject(a), &val);
                         if (address < 0) {          // If not found in local memory either
                             runtimeError(vm, "Variable doesn't have an address");
                         } else {
-                            index = getLine(socket_fd, vm, (Value){NUM_VALUE, {.number = address}});
+                            index = getLine(socket_fd, vm, numberValue(address));
                         }
                     }
                     // pthread_mutex_lock(&vm->cache.lineLock[index]);
-                    if (vm->cache.entries[index].address - b.as.number < vm->cache.addressData[index][1]) {
-                        if (vm->cache.addressData[index][2] - b.as.number < vm->cache.addressData[index][4]) {
+                    if (vm->cache.entries[index].address - asNumber(b) < vm->cache.addressData[index][1]) {
+                        if (vm->cache.addressData[index][2] - asNumber(b) < vm->cache.addressData[index][4]) {
                             runtimeError(vm, "Cannot access memory location");
                         } else {
-                            push(vm, (Value){NUM_VALUE, {.number = vm->cache.addressData[index][2] - b.as.number}});
+                            push(vm, numberValue(vm->cache.addressData[index][2] - asNumber(b)));
                         }
                         
                     } else {
-                        push(vm, (Value){NUM_VALUE, {.number = vm->cache.entries[index].address - b.as.number}});
+                        push(vm, numberValue(vm->cache.entries[index].address - asNumber(b)));
                     }
                     // pthread_mutex_unlock(&vm->cache.lineLock[index]);
                     // puts("Run released mutex");
@@ -790,123 +1168,127 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 // pthread_mutex_unlock(&vm->snoopLock);
                     isNumAddress = true;
                 } else {
-                    push(vm, (Value){NUM_VALUE, {.number = (a.as.number - b.as.number)}});
+                    push(vm, numberValue(asNumber(a) - asNumber(b)));
                 }
                 // puts("After sub");
                 break;
             }
             case OP_MULTIPLY: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
-                push(vm, (Value){NUM_VALUE, {.number = (a * b)}});
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
+                push(vm, numberValue(a * b));
                 break;
             }
             case OP_DIVIDE: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
-                push(vm, (Value){NUM_VALUE, {.number = (a / b)}});
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
+                push(vm, numberValue(a / b));
                 break;
             }
             case OP_REMAINDER: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
-                push(vm, (Value){NUM_VALUE, {.number = (a % b)}});
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
+                push(vm, numberValue(a % b));
                 break;
             }
             case OP_AND: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
-                push(vm, (Value){NUM_VALUE, {.number = (a && b)}});
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
+                push(vm, numberValue(a && b));
                 break;
             }
             case OP_OR: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
-                push(vm, (Value){NUM_VALUE, {.number = (a || b)}});
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
+                push(vm, numberValue(a || b));
                 break;
             }
             case OP_NOT: {
-                push(vm, (Value){NUM_VALUE, {.number = !(pop(vm).as.number)}});
+                push(vm, numberValue(!(asNumber(pop(vm)))));
                 break;
             }
             case OP_NOT_EQUAL: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
                 int result = 0;
                 if (a != b) {
                     result = 1;
                 }
-                push(vm, (Value){NUM_VALUE, {.number = result}});
+                push(vm, numberValue(result));
                 break;
             }
             case OP_EQUAL: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
                 int result = 0;
                 if (a == b) {
                     result = 1;
                 }
-                push(vm, (Value){NUM_VALUE, {.number = result}});
+                push(vm, numberValue(result));
                 break;
             }
             case OP_LESS: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
                 int result = 0;
                 if (a < b) {
                     result = 1;
                 }
-                push(vm, (Value){NUM_VALUE, {.number = result}});
+                push(vm, numberValue(result));
                 break;
             }
             case OP_LESS_EQUAL: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
                 int result = 0;
                 if (a <= b) {
                     result = 1;
                 }
-                push(vm, (Value){NUM_VALUE, {.number = result}});
+                push(vm, numberValue(result));
                 break;
             }
             case OP_GREATER: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
                 int result = 0;
                 if (a > b) {
                     result = 1;
                 }
-                push(vm, (Value){NUM_VALUE, {.number = result}});
+                push(vm, numberValue(result));
                 break;
             }
             case OP_GREATER_EQUAL: {
-                int b = pop(vm).as.number;
-                int a = pop(vm).as.number;
+                int b = asNumber(pop(vm));
+                int a = asNumber(pop(vm));
                 int result = 0;
                 if (a >= b) {
                     result = 1;
                 }
-                push(vm, (Value){NUM_VALUE, {.number = result}});
+                push(vm, numberValue(result));
                 break;
             }
             case OP_PRINT: 
-                printf("%d\n", peek(vm, 0).as.number);
+                printf("%d\n", asNumber(peek(vm, 0)));
                 break;
             case OP_SHOW: {
-                Value string = frame->function->sequence.constants.values[*frame->ip++];
-                printf("%.*s", ((String*)string.as.obj)->length, ((String*)string.as.obj)->characters);
+                Value string = frame->function->sequence.constants.values[high | *frame->ip++];
+                printf("%.*s", ((String*)asObject(string))->length, ((String*)asObject(string))->characters);
                 break;
             }
             case OP_POP: 
                 pop(vm);
                 break;
             case OP_PUSH: {
-                Value val = frame->function->sequence.constants.values[*frame->ip++];
-                push(vm, val);
+                Value val = frame->function->sequence.constants.values[high | *frame->ip++];
+                if (!push(vm, val)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
                 break;
             }
             case OP_COPY:
-                push(vm, peek(vm, 0));
+                if (!push(vm, peek(vm, 0))) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
                 break;
             case OP_ASSIGN: {
                 // puts("In assign");
@@ -924,14 +1306,14 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 int index = getLine(socket_fd, vm, name);
                 if (index == -1) {      // If variable is not global    
                     if (!inReturn) {
-                        tableSetValue(&tempFrame->locals, (String*)name.as.obj, val);
-                        address = tableGetValue(&tempFrame->locals, (String*)name.as.obj, &temp);
+                        tableSetValue(&tempFrame->locals, (String*)asObject(name), val);
+                        address = tableGetValue(&tempFrame->locals, (String*)asObject(name), &temp);
                     } else {
-                        tableSetValue(&frame->locals, (String*)name.as.obj, val);
-                        address = tableGetValue(&frame->locals, (String*)name.as.obj, &temp);
+                        tableSetValue(&frame->locals, (String*)asObject(name), val);
+                        address = tableGetValue(&frame->locals, (String*)asObject(name), &temp);
                     }
                     if (address >= 0) {
-                        setLine(socket_fd, vm, (Value){NUM_VALUE, {.number = address}}, val);
+                        setLine(socket_fd, vm, numberValue(address), val);
                         // setValue(socket_fd, val, address);
                     }
                 } else {
@@ -950,7 +1332,7 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 // puts("In assign address");
                 Value name2 = pop(vm);
                 Value name1 = pop(vm);
-                Value val = (Value){NUM_VALUE, {.number = 0}};
+                Value val = numberValue(0);
                 // pthread_mutex_lock(&vm->vmLock);
                 // while (!vm->vmRun) {
                 //     pthread_cond_wait(&vm->vmCond, &vm->vmLock);
@@ -962,8 +1344,8 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 int index = getLine(socket_fd, vm, name2);
                 if (isNumAddress) {
                     isNumAddress = false;
-                    tableChangeAddress(&frame->locals, (String*)name1.as.obj, name2.as.number);
-                    tableSetValue(&frame->locals, (String*)name1.as.obj, vm->cache.entries[index].value);
+                    tableChangeAddress(&frame->locals, (String*)asObject(name1), asNumber(name2));
+                    tableSetValue(&frame->locals, (String*)asObject(name1), vm->cache.entries[index].value);
                     // pthread_mutex_unlock(&vm->cacheLock);
                 // pthread_mutex_lock(&vm->snoopLock);
                 // vm->snoopRun = 1;
@@ -972,13 +1354,13 @@ static InterpretResult run(int socket_fd, VM* vm) {
                     break;
                 }
                 if (index == -1) {     // If variable is not globally defined
-                    address = tableGetValue(&frame->locals, (String*)name2.as.obj, &val);
-                    tableChangeAddress(&frame->locals, (String*)name1.as.obj, address);
-                    tableSetValue(&frame->locals, (String*)name1.as.obj, val);
+                    address = tableGetValue(&frame->locals, (String*)asObject(name2), &val);
+                    tableChangeAddress(&frame->locals, (String*)asObject(name1), address);
+                    tableSetValue(&frame->locals, (String*)asObject(name1), val);
                 } else {
                     // pthread_mutex_lock(&vm->cache.lineLock[index]);
-                    tableChangeAddress(&frame->locals, (String*)name1.as.obj, vm->cache.entries[index].address);
-                    tableSetValue(&frame->locals, (String*)name1.as.obj, vm->cache.entries[index].value);
+                    tableChangeAddress(&frame->locals, (String*)asObject(name1), vm->cache.entries[index].address);
+                    tableSetValue(&frame->locals, (String*)asObject(name1), vm->cache.entries[index].value);
                     // pthread_mutex_unlock(&vm->cache.lineLock[index]);
                 }
                 // puts("Run released mutex");
@@ -990,13 +1372,107 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 // puts("After assign address");
                 break;
             }
+            case OP_LOAD: {
+                // target count -> the count values from target on
+                if (2 >= vm->stackTop - vm->stack) {
+                    runtimeError(vm, "Not enough values to load.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                int count = asNumber(pop(vm));
+                Value target = bulkTarget(frame, pop(vm));
+                if (count < 1) {
+                    runtimeError(vm, "Count must be positive.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                // Checked up front, as the values are pushed once read
+                if (count > vm->stack + STACK_CAPACITY - vm->stackTop) {
+                    runtimeError(vm, "Stack overflow.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (!sendBulkRead(socket_fd, vm, target, count)) {
+                    runtimeError(vm, "Cannot access memory location");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OP_STORE: {
+                // target, then count values and the count -> nothing
+                int count = asNumber(pop(vm));
+                if (count < 1 || count >= vm->stackTop - vm->stack) {
+                    runtimeError(vm, "Not enough values to store.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                Value* values = vm->stackTop - count;
+                Value target = bulkTarget(frame, values[-1]);
+                vm->stackTop = values - 1;
+                // The values stay in place until the next push
+                if (!sendBulkWrite(socket_fd, vm, target, values, count)) {
+                    runtimeError(vm, "Cannot access memory location");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OP_VECTOR_ADD:
+            case OP_VECTOR_SUBTRACT:
+            case OP_VECTOR_MULTIPLY:
+            case OP_VECTOR_FILL:
+            case OP_VECTOR_COPY:
+            case OP_VECTOR_SUM: {
+                // destination and sources, or the value of a fill, then the
+                // count -> nothing, or the sum for a sum
+                if (vectorOperands[instruction - OP_VECTOR_ADD] + 1 >= vm->stackTop - vm->stack) {
+                    runtimeError(vm, "Not enough values for the vector instruction.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                int count = asNumber(pop(vm));
+                if (count < 1) {
+                    runtimeError(vm, "Count must be positive.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                Value* operands = vm->stackTop - vectorOperands[instruction - OP_VECTOR_ADD];
+                vm->stackTop = operands;
+                for (int i = 0; i < vectorOperands[instruction - OP_VECTOR_ADD]; i++) {
+                    if (instruction != OP_VECTOR_FILL || i == 0) {
+                        operands[i] = bulkTarget(frame, operands[i]);
+                    }
+                }
+                int result;
+                if (!sendVector(socket_fd, vm, instruction, operands, count, &result)) {
+                    runtimeError(vm, "Cannot access memory location");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (instruction == OP_VECTOR_SUM) {
+                    push(vm, numberValue(result));
+                }
+                break;
+            }
+            case OP_FETCH_ADD:
+            case OP_COMPARE_SWAP:
+            case OP_EXCHANGE: {
+                // target, then the delta, the expected and new values, or
+                // the new value -> the value before
+                if (atomicArguments[instruction - OP_FETCH_ADD] + 1 >= vm->stackTop - vm->stack) {
+                    runtimeError(vm, "Not enough values for the atomic instruction.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                Value* arguments = vm->stackTop - atomicArguments[instruction - OP_FETCH_ADD];
+                Value target = bulkTarget(frame, arguments[-1]);
+                vm->stackTop = arguments - 1;
+                int previous;
+                if (!sendAtomic(socket_fd, vm, instruction, target, arguments, &previous)) {
+                    runtimeError(vm, "Cannot access memory location");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                push(vm, numberValue(previous));
+                break;
+            }
             case OP_JUMP: {
-                Value name = frame->function->sequence.constants.values[*frame->ip++];
+                Value name = frame->function->sequence.constants.values[high | *frame->ip++];
                 frame->ip += 2;
                 int address = (int)(frame->ip[-2] << 8 | frame->ip[-1]);
                 Value jumpToAddress;
-                if (tableGetValue(&frame->function->labels, (String*)name.as.obj, &jumpToAddress) == -2) {
-                    int offset = jumpToAddress.as.number - address - 3;
+                if (tableGetValue(&frame->function->labels, (String*)asObject(name), &jumpToAddress) == -2) {
+                    int offset = asNumber(jumpToAddress) - address - 3;
                     frame->ip += offset;
                 } else {
                     runtimeError(vm, "No label defined for this jump.");
@@ -1004,13 +1480,13 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 break;
             }
             case OP_JUMP_IF_TRUE: {
-                Value name = frame->function->sequence.constants.values[*frame->ip++];
+                Value name = frame->function->sequence.constants.values[high | *frame->ip++];
                 frame->ip += 2;
-                if (pop(vm).as.number != 0) {
+                if (asNumber(pop(vm)) != 0) {
                     int address = (int)(frame->ip[-2] << 8 | frame->ip[-1]);
                     Value jumpToAddress;
-                    if (tableGetValue(&frame->function->labels, (String*)name.as.obj, &jumpToAddress) == -2) {
-                        int offset = jumpToAddress.as.number - address - 3;
+                    if (tableGetValue(&frame->function->labels, (String*)asObject(name), &jumpToAddress) == -2) {
+                        int offset = asNumber(jumpToAddress) - address - 3;
                         frame->ip += offset;
                     } else {
                         runtimeError(vm, "No label defined for this jump.");
@@ -1019,13 +1495,13 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 break;
             }
             case OP_JUMP_IF_FALSE: {
-                Value name = frame->function->sequence.constants.values[*frame->ip++];
+                Value name = frame->function->sequence.constants.values[high | *frame->ip++];
                 frame->ip += 2;
-                if (pop(vm).as.number == 0) {
+                if (asNumber(pop(vm)) == 0) {
                     int address = (int)(frame->ip[-2] << 8 | frame->ip[-1]);
                     Value jumpToAddress;
-                    if (tableGetValue(&frame->function->labels, (String*)name.as.obj, &jumpToAddress) == -2) {
-                        int offset = jumpToAddress.as.number - address - 3;
+                    if (tableGetValue(&frame->function->labels, (String*)asObject(name), &jumpToAddress) == -2) {
+                        int offset = asNumber(jumpToAddress) - address - 3;
                         frame->ip += offset;
                     } else {
                         runtimeError(vm, "No label defined for this jump.");
@@ -1045,31 +1521,80 @@ static InterpretResult run(int socket_fd, VM* vm) {
                 break;
             }
             case OP_CALL: {
-                Value name = frame->function->sequence.constants.values[*frame->ip++];
-                Value function;
-                if (tableGetValue(&(&vm->frames[0])->function->labels, (String*)name.as.obj, &function) == -1) {
+                // Resolved by resolveCalls() once the program was compiled or loaded
+                FunctionObject* function = frame->function->targets[high | *frame->ip++];
+                if (function == NULL) {
                     runtimeError(vm, "No function with that name.");
+                    return INTERPRET_RUNTIME_ERROR;
                 }
-                if (!callValue(vm, function)) {
+                if (!call(vm, function)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 frame = tempFrame;
+                if (vm->profiler != NULL) {
+                    profileCall(vm->profiler, frame->function);
+                }
+                break;
+            }
+            case OP_TAIL_CALL: {
+                FunctionObject* function = frame->function->targets[high | *frame->ip++];
+                if (function == NULL) {
+                    runtimeError(vm, "No function with that name.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                // Main keeps the labels calls are resolved in, and without a
+                // begin there are no locals to hand over: call as usual
+                if (frame == &vm->frames[0] || tempFrame == frame) {
+                    if (!call(vm, function)) {
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    frame = tempFrame;
+                    if (vm->profiler != NULL) {
+                        profileCall(vm->profiler, frame->function);
+                    }
+                } else {
+                    // The return of the caller comes right after, so the callee
+                    // takes over its frame with the locals set since begin
+                    freeTable(&frame->locals);
+                    frame->locals = tempFrame->locals;
+                    frame->function = function;
+                    frame->ip = frame->function->sequence.code;
+                    tempFrame = frame;
+                    if (vm->profiler != NULL) {
+                        profileReturn(vm->profiler);
+                        profileCall(vm->profiler, frame->function);
+                    }
+                }
                 break;
             }
             case OP_RETURN: {
+                if (vm->profiler != NULL) {
+                    profileReturn(vm->profiler);
+                }
                 vm->frameCount--;
                 frame = &vm->frames[vm->frameCount - 1];
                 inReturn = true;
                 break;
             }
+            case OP_WIDE: {
+                wide = *frame->ip++ << 8;
+                break;
+            }
             case OP_HALT: {
                 // If any cache line is dirty at end of program, write back to memory,
                 // Invalidate everything
                 for (int i = 0; i < vm->cache.count; i++) {
                     if (vm->cache.entries[i].key != NULL && vm->cache.states[i] == MODIFIED) {
                         sendWriteBack(socket_fd, vm->cache.entries[i].address, vm->cache.entries[i].value);
+                        chargeCycles(&vm->cycles, costModel.arbitration + costModel.memory);
                     }
                 }
+                if (timingEnabled) {
+                    printCycles(&vm->cycles);
+                }
+                if (vm->profiler != NULL) {
+                    reportProfile(vm->profiler);
+                }
                 char buffer[1024] = "ret";
                 if (write(socket_fd, buffer, 1024) <= 0) {
                     perror("Could not write to bus");
@@ -1099,8 +1624,11 @@ InterpretResult interpret(int socket_fd, VM* vm, const char* source) {
     if (function == NULL) {
         return INTERPRET_COMPILE_ERROR;
     }
-    
-    push(vm, (Value){OBJ_VALUE, {.obj = (Object*)function}});
+    return interpretFunction(socket_fd, vm, function);
+}
+
+InterpretResult interpretFunction(int socket_fd, VM* vm, FunctionObject* function) {
+    push(vm, objectValue((Object*)function));
     call(vm, function);
 
     return run(socket_fd, vm);
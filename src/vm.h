@@ -5,12 +5,19 @@
 #include <pthread.h>
 
 #include "cache.h"
-// #include "object.h"
+#include "profiler.h"
+#include "object.h"
 #include "sequence.h"
 #include "symbolTable.h"
+#include "timing.h"
 
 #define FRAMES_CAPACITY 128
 #define STACK_CAPACITY (FRAMES_CAPACITY * (UINT8_MAX + 1))
+// Number of Values the stack is grown by, a multiple of the page size
+#define STACK_CHUNK 4096
+// Byte of the bus reply to a BusRd or BusRdX that is set when the line was
+// supplied by the other core's cache instead of memory
+#define REPLY_SUPPLIED 1023
 
 /**
  * struct CallFrame - Used to manage function Calls
@@ -28,24 +35,35 @@ typedef struct {
 /**
  * struct VM - Stores all data the VM will need -
  * typedef for struct created as forward declaration in "object.h"
- * @a: frames -> CallFrame[] : stores all frames created from calls 
+ * @a: frames -> CallFrame* : stores all frames created from calls, mapped
+ * for FRAMES_CAPACITY frames whose pages are only touched once used
  * @b: frameCount -> int : stores the number of frames
- * @c: stack -> Value[] : contains all constants (number or object)
- * @d: stackTop -> Value* : keeps track of the top of stack
- * @e: strings -> Table : stores all strings
- * @f: objects -> Object* : Array of objects
+ * @c: stack -> Value* : contains all constants (number or object), reserved
+ * for STACK_CAPACITY Values between two guard pages
+ * @d: stackTop, stackLimit -> Value* : keeps track of the top of stack, and
+ * of the end of the part of it that is accessible, grown by push()
+ * @e: strings -> InternTable : stores all strings, also read by the snoop thread
+ * @f: heap -> Heap : owner of all strings and functions of the VM
  * @g: cache -> Cache : struct that contains all cache data
  * @h: clock -> int : clock that is used by replacement algorithm
+ * @i: cycles -> CycleCounter : simulated time spent by this core
+ * @j: profiler -> Profiler* : execution profile, NULL unless --profile is given
+ * @k: image, imageSize -> uint8_t*, size_t : mapping of the loaded .abmc image, if any
  */
 struct VM {
-    CallFrame frames[FRAMES_CAPACITY];
+    CallFrame* frames;
     int frameCount;
-    Value stack[STACK_CAPACITY];
+    Value* stack;
     Value* stackTop;
-    Table strings;
-    Object* objects;
+    Value* stackLimit;
+    InternTable strings;
+    Heap heap;
     Cache cache;
     int clock;
+    CycleCounter cycles;
+    Profiler* profiler;
+    uint8_t* image;
+    size_t imageSize;
 };
 
 typedef enum {
@@ -80,14 +98,29 @@ void freeVM(VM* vm);
  */
 InterpretResult interpret(int socket_fd, VM* vm, const char* source);
 
+/**
+ * @brief Same as interpret(), for a main function that is already
+ * compiled, e.g. loaded from an image.
+ * 
+ * @param socket_fd
+ * @param vm
+ * @param function
+ * @return InterpretResult 
+ */
+InterpretResult interpretFunction(int socket_fd, VM* vm, FunctionObject* function);
+
 /**
  * @brief Pushes the given value to vm's Value stack and increments 
- * stackTop to keep track.
+ * stackTop to keep track. Makes the next STACK_CHUNK Values accessible
+ * when stackLimit is reached. Reports a stack overflow and returns false
+ * without pushing if the stack is full.
  * 
  * @param vm
  * @param value 
+ * @return true 
+ * @return false 
  */
-void push(VM* vm, Value value);
+bool push(VM* vm, Value value);
 
 /**
  * @brief Pops and returns the value at the top of vm's Value stack.